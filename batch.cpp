@@ -0,0 +1,362 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <algorithm>
+
+#include "parallel.h"
+
+int scene_tool(char const* tool, char const* const* args, char const* const* args_end);
+
+void batch_run_help()
+{
+	std::cout << " Syntax: scenecvt batch-run [/j <n>] [/Mem <MB>] <manifest>"  << std::endl << std::endl;
+
+	std::cout << " Arguments:"  << std::endl;
+	std::cout << "  /j <int>       Run up to <int> conversions concurrently (default: hardware threads)"  << std::endl;
+	std::cout << "  /Mem <int>     Limit estimated memory of concurrent conversions to <int> MB (default 4096)"  << std::endl;
+	std::cout << "  <manifest>     Text file listing one job per line, either a recorded .rc.bat file"  << std::endl;
+	std::cout << "                 or a 'scene' tool command line; empty lines & lines starting with # are skipped"  << std::endl;
+}
+
+namespace
+{
+
+// Assimp's in-memory scenes are a multiple of the input file size
+size_t const job_memory_factor = 8;
+
+struct Job
+{
+	std::string line;
+	std::vector<std::string> args;
+	size_t memoryEstimate;
+	std::string error;
+	double seconds;
+	bool failed;
+	bool replay; // recorded command, see set_command_replay
+};
+
+std::vector<std::string> split_command_line(std::string const& line)
+{
+	std::vector<std::string> args;
+	std::string arg;
+	bool quoted = false, hasArg = false;
+
+	for (char c : line)
+	{
+		if (c == '"') {
+			quoted = !quoted;
+			hasArg = true;
+		} else if (!quoted && (c == ' ' || c == '\t' || c == '\r')) {
+			if (hasArg) args.push_back(arg);
+			arg.clear();
+			hasArg = false;
+		} else {
+			arg += c;
+			hasArg = true;
+		}
+	}
+	if (hasArg) args.push_back(arg);
+
+	return args;
+}
+
+size_t file_size(char const* path)
+{
+	std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+	return file ? size_t(file.tellg()) : 0;
+}
+
+} // namespace
+
+// Splits the given command line into scene tool arguments, skipping a "scenecvt scene [batch]" prefix.
+// Sets replay if the command carries the batch token of recorded commands.
+std::vector<std::string> scene_command_args(std::string const& command, bool& replay)
+{
+	replay = false;
+	auto args = split_command_line(command);
+
+	auto arg = args.begin();
+	if (arg != args.end() && stdx::strieq(arg->c_str(), "scenecvt"))
+	{
+		if (++arg == args.end() || !stdx::strieq(arg->c_str(), "scene"))
+			throwx( std::runtime_error("Only 'scene' tool commands supported") );
+		++arg;
+	}
+	if (arg != args.end() && stdx::strieq(arg->c_str(), "batch"))
+	{
+		replay = true;
+		++arg;
+	}
+
+	return std::vector<std::string>(arg, args.end());
+}
+
+namespace
+{
+
+// Parses the given manifest line into scene tool arguments.
+void parse_job(Job& job)
+{
+	std::string command = job.line;
+
+	// Recorded command file, expand its directory
+	bool commandFile = (command.size() > 4 && stdx::strieq(command.c_str() + command.size() - 4, ".bat"));
+	if (commandFile)
+	{
+		std::ifstream batFile(command.c_str());
+		if (!std::getline(batFile, command))
+			throwx( std::runtime_error("Cannot read command file") );
+
+		std::string batDir = job.line;
+		batDir.erase(batDir.find_last_of("/\\") + 1);
+		for (size_t pos; (pos = command.find("%~dp0")) != std::string::npos; )
+			command.replace(pos, 5, batDir);
+	}
+
+	job.args = scene_command_args(command, job.replay);
+	job.replay |= commandFile;
+	if (job.args.size() < 2)
+		throwx( std::runtime_error("Job requires input & output") );
+
+	// Estimate from all existing files but the output
+	job.memoryEstimate = 0;
+	for (size_t i = 0; i + 1 < job.args.size(); ++i)
+		job.memoryEstimate += job_memory_factor * file_size(job.args[i].c_str());
+}
+
+// Admits jobs while their summed memory estimates fit the budget. A job exceeding the budget
+// on its own is admitted once nothing else is running.
+class MemoryBudget
+{
+public:
+	explicit MemoryBudget(size_t budget) : budget(budget), used(0) { }
+
+	void acquire(size_t amount)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		released.wait(lock, [&]() { return used == 0 || used + amount <= budget; });
+		used += amount;
+	}
+
+	void release(size_t amount)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			used -= amount;
+		}
+		released.notify_all();
+	}
+
+private:
+	size_t budget;
+	size_t used;
+	std::mutex mutex;
+	std::condition_variable released;
+};
+
+// Per-worker job queues. Workers pop from the front of their own queue and steal from the back of others.
+class JobQueues
+{
+public:
+	explicit JobQueues(unsigned workerCount) : queues(workerCount) { }
+
+	void push(unsigned worker, size_t job)
+	{
+		queues[worker].jobs.push_back(job);
+	}
+
+	bool pop(unsigned worker, size_t& job)
+	{
+		for (size_t i = 0; i < queues.size(); ++i)
+		{
+			auto& queue = queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.jobs.empty()) continue;
+
+			if (i == 0) {
+				job = queue.jobs.front();
+				queue.jobs.pop_front();
+			} else {
+				job = queue.jobs.back();
+				queue.jobs.pop_back();
+			}
+			return true;
+		}
+		return false;
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<size_t> jobs;
+	};
+	std::vector<Queue> queues;
+};
+
+} // namespace
+
+int batch_run_tool(char const* tool, char const* const* args, char const* const* args_end)
+{
+	if (args_end - args < 1 || stdx::strieq(*args, "help"))
+	{
+		batch_run_help();
+		return 0;
+	}
+
+	auto manifestPath = *--args_end;
+
+	unsigned workerCount = 0;
+	unsigned long long memoryBudgetMB = 4096;
+
+	for (auto arg = args; arg < args_end; ++arg)
+	{
+		if (stdx::check_flag(*arg, "j")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &workerCount) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'batch-run help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Mem")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%llu", &memoryBudgetMB) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'batch-run help' for help: " << *arg << std::endl;
+		}
+		else
+			std::cout << "Unrecognized argument, consult 'batch-run help' for help: " << *arg << std::endl;
+	}
+
+	std::vector<Job> jobs;
+	{
+		std::ifstream manifest(manifestPath);
+		if (!manifest)
+			throwx( std::runtime_error("Cannot open batch manifest") );
+
+		std::string line;
+		while (std::getline(manifest, line))
+		{
+			line.erase(line.find_last_not_of(" \t\r") + 1);
+			line.erase(0, line.find_first_not_of(" \t"));
+			if (line.empty() || line[0] == '#') continue;
+
+			Job job = { line };
+			job.memoryEstimate = 0;
+			job.seconds = 0.0;
+			job.failed = false;
+			job.replay = false;
+			jobs.push_back(job);
+		}
+	}
+
+	if (workerCount == 0) workerCount = worker_count(jobs.size());
+	workerCount = std::max(1U, std::min(workerCount, unsigned(std::max(jobs.size(), size_t(1)))));
+
+	for (auto& job : jobs)
+	{
+		try { parse_job(job); }
+		catch (std::exception const& excpt)
+		{
+			job.failed = true;
+			job.error = excpt.what();
+		}
+	}
+
+	// Largest jobs first, dealt round-robin so that stealing balances the tail
+	std::vector<size_t> order(jobs.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return jobs[a].memoryEstimate > jobs[b].memoryEstimate; });
+
+	JobQueues queues(workerCount);
+	for (size_t i = 0; i < order.size(); ++i)
+		queues.push(unsigned(i % workerCount), order[i]);
+
+	MemoryBudget budget(size_t(memoryBudgetMB) << 20U);
+	std::mutex progressMutex;
+	size_t finishedCount = 0;
+
+	std::cout << "Running " << jobs.size() << " jobs on " << workerCount << " workers" << std::endl;
+	auto batchStart = std::chrono::steady_clock::now();
+
+	auto&& work = [&](unsigned worker)
+	{
+		for (size_t jobIdx; queues.pop(worker, jobIdx); )
+		{
+			auto& job = jobs[jobIdx];
+
+			if (!job.failed)
+			{
+				budget.acquire(job.memoryEstimate);
+				auto jobStart = std::chrono::steady_clock::now();
+
+				// Isolate job failures from the batch
+				try
+				{
+					std::vector<char const*> jobArgs;
+					for (auto& arg : job.args)
+						jobArgs.push_back(arg.c_str());
+
+					set_command_replay(job.replay);
+					if (scene_tool("scene", jobArgs.data(), jobArgs.data() + jobArgs.size()) != 0)
+					{
+						job.failed = true;
+						job.error = "Non-zero exit code";
+					}
+				}
+				catch (std::exception const& excpt)
+				{
+					job.failed = true;
+					job.error = excpt.what();
+				}
+				catch (...)
+				{
+					job.failed = true;
+					job.error = "Unknown error";
+				}
+
+				job.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+				budget.release(job.memoryEstimate);
+			}
+
+			std::lock_guard<std::mutex> lock(progressMutex);
+			++finishedCount;
+			std::cout << "[" << finishedCount << "/" << jobs.size() << "] "
+				<< (job.failed ? "FAILED " : "OK ") << job.line << " (" << job.seconds << " s)" << std::endl;
+		}
+	};
+
+	// Share the cores among concurrent jobs instead of each job's stages using all of them
+	ScopedWorkerLimit jobWorkerLimit(std::max(1U, worker_count() / workerCount));
+
+	std::vector<std::thread> workers;
+	for (unsigned i = 1; i < workerCount; ++i)
+		workers.emplace_back(work, i);
+	work(0);
+
+	for (auto& worker : workers)
+		worker.join();
+
+	double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+
+	size_t failedCount = 0;
+	for (auto& job : jobs)
+		failedCount += job.failed;
+
+	std::cout << std::endl << "Batch finished in " << batchSeconds << " s: "
+		<< (jobs.size() - failedCount) << " succeeded, " << failedCount << " failed" << std::endl;
+	for (auto& job : jobs)
+		if (job.failed)
+			std::cout << " FAILED " << job.line << ": " << job.error << std::endl;
+
+	return failedCount ? -1 : 0;
+}
@@ -0,0 +1,341 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+#include <assimp/material.h>
+
+#include <scenex>
+
+#include "merge.h"
+#include "scenefile.h"
+#include "simd.h"
+#include "stats.h"
+
+bool const stdx::is_debugger_present = IsDebuggerPresent() != FALSE;
+
+namespace
+{
+
+struct SyntheticSceneDesc
+{
+	unsigned meshes = 256;
+	unsigned vertices = 4096; // per mesh
+	unsigned materials = 16;
+	unsigned depth = 4;       // node hierarchy depth, leaves instance meshes
+	unsigned branching = 4;
+
+	bool normals = true;
+	bool texcoords = true;
+	bool colors = false;
+	bool tangents = false;
+
+	unsigned seed = 1;
+};
+
+// Deterministic synthetic scene: triangle strips over random vertices, a full node tree
+// whose leaves instance the meshes round-robin.
+std::unique_ptr<aiScene> generate_scene(SyntheticSceneDesc const& desc)
+{
+	std::mt19937 rng(desc.seed);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	std::unique_ptr<aiScene> scene(new aiScene());
+
+	scene->mNumMaterials = std::max(desc.materials, 1U);
+	scene->mMaterials = new aiMaterial*[scene->mNumMaterials];
+	for (unsigned i = 0; i < scene->mNumMaterials; ++i)
+	{
+		auto material = new aiMaterial();
+		aiColor3D diffuse(0.5f + 0.5f * unit(rng), 0.5f + 0.5f * unit(rng), 0.5f + 0.5f * unit(rng));
+		material->AddProperty(&diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+		aiString texture("textures/synthetic" + std::to_string(i % 8) + ".png");
+		material->AddProperty(&texture, AI_MATKEY_TEXTURE_DIFFUSE(0));
+		scene->mMaterials[i] = material;
+	}
+
+	scene->mNumMeshes = desc.meshes;
+	scene->mMeshes = new aiMesh*[desc.meshes];
+	for (unsigned i = 0; i < desc.meshes; ++i)
+	{
+		auto mesh = new aiMesh();
+		unsigned vertexCount = std::max(desc.vertices, 3U);
+		mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+		mesh->mMaterialIndex = i % scene->mNumMaterials;
+		mesh->mNumVertices = vertexCount;
+
+		auto&& randomVectors = [&]()
+		{
+			auto vectors = new aiVector3D[vertexCount];
+			for (unsigned j = 0; j < vertexCount; ++j)
+				vectors[j] = aiVector3D(unit(rng), unit(rng), unit(rng));
+			return vectors;
+		};
+		mesh->mVertices = randomVectors();
+		if (desc.normals) mesh->mNormals = randomVectors();
+		if (desc.tangents)
+		{
+			mesh->mTangents = randomVectors();
+			mesh->mBitangents = randomVectors();
+		}
+		if (desc.texcoords)
+		{
+			mesh->mTextureCoords[0] = randomVectors();
+			mesh->mNumUVComponents[0] = 2;
+		}
+		if (desc.colors)
+		{
+			mesh->mColors[0] = new aiColor4D[vertexCount];
+			for (unsigned j = 0; j < vertexCount; ++j)
+				mesh->mColors[0][j] = aiColor4D(0.5f + 0.5f * unit(rng), 0.5f + 0.5f * unit(rng), 0.5f + 0.5f * unit(rng), 1.0f);
+		}
+
+		mesh->mNumFaces = vertexCount - 2;
+		mesh->mFaces = new aiFace[mesh->mNumFaces];
+		for (unsigned j = 0; j < mesh->mNumFaces; ++j)
+		{
+			auto& face = mesh->mFaces[j];
+			face.mNumIndices = 3;
+			face.mIndices = new unsigned[3];
+			face.mIndices[0] = j;
+			face.mIndices[1] = j + 1 + (j & 1);
+			face.mIndices[2] = j + 2 - (j & 1);
+		}
+
+		scene->mMeshes[i] = mesh;
+	}
+
+	unsigned nextMesh = 0;
+	std::function<aiNode* (unsigned)> createNode = [&](unsigned level) -> aiNode*
+	{
+		auto node = new aiNode();
+		node->mTransformation.a4 = 4.0f * unit(rng);
+		node->mTransformation.b4 = 4.0f * unit(rng);
+		node->mTransformation.c4 = 4.0f * unit(rng);
+
+		if (level >= desc.depth || desc.meshes == 0)
+		{
+			node->mNumMeshes = 1;
+			node->mMeshes = new unsigned[1];
+			node->mMeshes[0] = nextMesh++ % std::max(desc.meshes, 1U);
+			return node;
+		}
+
+		node->mNumChildren = std::max(desc.branching, 1U);
+		node->mChildren = new aiNode*[node->mNumChildren];
+		for (unsigned i = 0; i < node->mNumChildren; ++i)
+		{
+			node->mChildren[i] = createNode(level + 1);
+			node->mChildren[i]->mParent = node;
+		}
+		return node;
+	};
+	scene->mRootNode = createNode(0);
+
+	return scene;
+}
+
+struct BenchResult
+{
+	std::string name;
+	size_t elements;
+	double minSeconds, medianSeconds;
+};
+
+// Runs the given measurement repeatedly after one warm-up run. The measurement returns the
+// seconds of its timed section, so that setup work stays excluded.
+template <class Measure>
+BenchResult run_bench(char const* name, size_t elements, unsigned repeats, Measure&& measure)
+{
+	measure();
+
+	std::vector<double> seconds(std::max(repeats, 1U));
+	for (auto& s : seconds)
+		s = measure();
+	std::sort(seconds.begin(), seconds.end());
+
+	BenchResult result = { name, elements, seconds.front(), seconds[seconds.size() / 2] };
+	std::cerr << name << ": " << result.medianSeconds * 1000.0 << " ms (median)" << std::endl;
+	return result;
+}
+
+template <class Fun>
+double time_seconds(Fun&& fun)
+{
+	auto start = std::chrono::steady_clock::now();
+	fun();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void bench_help()
+{
+	std::cout << " Syntax: scenecvt_bench [/m <n>] [/v <n>] [/a <ntcg>] [/d <n>] [/b <n>] [/mat <n>] [/r <n>] [/o <file>]"  << std::endl << std::endl;
+
+	std::cout << " Arguments:"  << std::endl;
+	std::cout << "  /m <int>       Number of meshes (default 256)"  << std::endl;
+	std::cout << "  /v <int>       Vertices per mesh (default 4096)"  << std::endl;
+	std::cout << "  /a <chars>     Vertex attributes: n normals, t tex coords, c colors, g tangents (default nt)"  << std::endl;
+	std::cout << "  /d <int>       Node hierarchy depth (default 4)"  << std::endl;
+	std::cout << "  /b <int>       Node hierarchy branching (default 4)"  << std::endl;
+	std::cout << "  /mat <int>     Number of materials (default 16)"  << std::endl;
+	std::cout << "  /r <int>       Timed repetitions per benchmark (default 10)"  << std::endl;
+	std::cout << "  /o <file>      Write JSON results to <file> instead of stdout"  << std::endl;
+}
+
+} // namespace
+
+int main(int argc, const char* argv[])
+{
+	auto args = argv + 1;
+	auto args_end = argv + argc;
+
+	SyntheticSceneDesc desc;
+	unsigned repeats = 10;
+	std::string outputPath;
+
+	for (auto arg = args; arg < args_end; ++arg)
+	{
+		auto&& readUnsigned = [&](unsigned& value)
+		{
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &value) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number: " << *arg << std::endl;
+		};
+
+		if (stdx::strieq(*arg, "help")) {
+			bench_help();
+			return 0;
+		}
+		else if (stdx::check_flag(*arg, "m")) readUnsigned(desc.meshes);
+		else if (stdx::check_flag(*arg, "v")) readUnsigned(desc.vertices);
+		else if (stdx::check_flag(*arg, "d")) readUnsigned(desc.depth);
+		else if (stdx::check_flag(*arg, "b")) readUnsigned(desc.branching);
+		else if (stdx::check_flag(*arg, "mat")) readUnsigned(desc.materials);
+		else if (stdx::check_flag(*arg, "r")) readUnsigned(repeats);
+		else if (stdx::check_flag(*arg, "a")) {
+			if (arg + 1 < args_end) {
+				std::string attribs = *++arg;
+				desc.normals = attribs.find('n') != std::string::npos;
+				desc.texcoords = attribs.find('t') != std::string::npos;
+				desc.colors = attribs.find('c') != std::string::npos;
+				desc.tangents = attribs.find('g') != std::string::npos;
+			} else
+				std::cout << "Argument requires attributes: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "o")) {
+			if (arg + 1 < args_end)
+				outputPath = *++arg;
+			else
+				std::cout << "Argument requires file: " << *arg << std::endl;
+		}
+		else
+			std::cout << "Unrecognized argument, consult 'scenecvt_bench help' for help: " << *arg << std::endl;
+	}
+
+	auto inScene = generate_scene(desc);
+	size_t vertexCount = size_t(desc.meshes) * std::max(desc.vertices, 3U);
+	std::vector<BenchResult> results;
+
+	// Attribute conversion kernels
+	{
+		std::mt19937 rng(desc.seed);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		std::vector<float> src(4 * vertexCount);
+		for (auto& v : src) v = unit(rng);
+
+		std::vector<unsigned> packed(vertexCount);
+		results.push_back(run_bench("pack_colors", vertexCount, repeats, [&]()
+		{
+			return time_seconds([&]() { simd::pack_colors(packed.data(), src.data(), vertexCount); });
+		}));
+
+		std::vector<float> narrowed(2 * vertexCount);
+		results.push_back(run_bench("narrow_xy", vertexCount, repeats, [&]()
+		{
+			return time_seconds([&]() { simd::narrow_xy(narrowed.data(), src.data(), vertexCount); });
+		}));
+
+		std::vector<unsigned> indices(3 * vertexCount, 0);
+		results.push_back(run_bench("rebase_indices", indices.size(), repeats, [&]()
+		{
+			return time_seconds([&]() { simd::rebase_indices(indices.data(), indices.size(), 1); });
+		}));
+
+		results.push_back(run_bench("minmax_xyz", vertexCount, repeats, [&]()
+		{
+			float min[3] = { 1.0f, 1.0f, 1.0f }, max[3] = { 0.0f, 0.0f, 0.0f };
+			return time_seconds([&]() { simd::minmax_xyz(min, max, src.data(), vertexCount); });
+		}));
+	}
+
+	// Node traversal & counting
+	SceneCounts counts;
+	results.push_back(run_bench("count_meshes", inScene->mNumMeshes, repeats, [&]()
+	{
+		counts = SceneCounts();
+		return time_seconds([&]() { count_meshes(counts, *inScene); });
+	}));
+
+	// Merge
+	scene::Scene outScene;
+	ConversionStats stats;
+	results.push_back(run_bench("write_meshes", counts.vertices, repeats, [&]()
+	{
+		outScene = scene::Scene();
+		allocate_scene(outScene, counts);
+		SceneCounts cursor;
+		MergeTables tables;
+		return time_seconds([&]() { write_meshes(outScene, *inScene, cursor, tables, stats, "", 0); });
+	}));
+
+	// Serialization
+	results.push_back(run_bench("dump_scene", counts.vertices, repeats, [&]()
+	{
+		return time_seconds([&]() { auto bytes = scene::dump_scene(outScene); (void) bytes; });
+	}));
+
+	std::string scenePath = outputPath.empty() ? "scenecvt_bench.scene" : outputPath + ".scene";
+	results.push_back(run_bench("write_scene", counts.vertices, repeats, [&]()
+	{
+		return time_seconds([&]() { scenefile::write_scene(scenePath.c_str(), outScene); });
+	}));
+	remove(scenePath.c_str());
+
+	// Machine-readable results
+	std::ofstream outputFile;
+	if (!outputPath.empty())
+		outputFile.open(outputPath.c_str(), std::ios_base::trunc);
+	std::ostream& out = outputPath.empty() ? std::cout : outputFile;
+
+	out << "{\n";
+	out << "\t\"config\": { \"meshes\": " << desc.meshes << ", \"vertices\": " << desc.vertices
+		<< ", \"materials\": " << desc.materials << ", \"depth\": " << desc.depth << ", \"branching\": " << desc.branching
+		<< ", \"normals\": " << desc.normals << ", \"texcoords\": " << desc.texcoords
+		<< ", \"colors\": " << desc.colors << ", \"tangents\": " << desc.tangents << ", \"repeats\": " << repeats << " },\n";
+	out << "\t\"instructionSet\": \"" << simd::instruction_set() << "\",\n";
+	out << "\t\"benchmarks\": [";
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		auto& result = results[i];
+		out << (i ? ",\n\t\t" : "\n\t\t") << "{ \"name\": \"" << result.name << "\", \"elements\": " << result.elements
+			<< ", \"minSeconds\": " << result.minSeconds << ", \"medianSeconds\": " << result.medianSeconds
+			<< ", \"elementsPerSecond\": " << (result.medianSeconds > 0.0 ? double(result.elements) / result.medianSeconds : 0.0) << " }";
+	}
+	out << "\n\t]\n";
+	out << "}\n";
+
+	return 0;
+}
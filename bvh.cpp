@@ -0,0 +1,274 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <cfloat>
+
+#include <scenex>
+
+#include "scenefile.h"
+#include "scenepass.h"
+#include "parallel.h"
+
+namespace
+{
+
+using scenefile::BvhNode;
+
+struct PrimBounds
+{
+	float min[3];
+	float max[3];
+};
+
+inline float half_area(float const* min, float const* max)
+{
+	float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return dx * dy + dy * dz + dz * dx;
+}
+
+inline void reset_bounds(float* min, float* max)
+{
+	for (int c = 0; c < 3; ++c)
+	{
+		min[c] = FLT_MAX;
+		max[c] = -FLT_MAX;
+	}
+}
+
+inline void extend_bounds(float* min, float* max, float const* pmin, float const* pmax)
+{
+	for (int c = 0; c < 3; ++c)
+	{
+		min[c] = (pmin[c] < min[c]) ? pmin[c] : min[c];
+		max[c] = (pmax[c] > max[c]) ? pmax[c] : max[c];
+	}
+}
+
+unsigned const bvh_bin_count = 16;
+unsigned const bvh_max_leaf_size = 8;
+float const bvh_traversal_cost = 1.0f;
+
+// Binned SAH builder. Nodes are emitted in depth-first order with adjacent siblings, node &
+// primitive indices are relative to the returned arrays.
+void build_bvh(std::vector<BvhNode>& nodes, std::vector<unsigned>& order, std::vector<PrimBounds> const& prims)
+{
+	nodes.clear();
+	order.resize(prims.size());
+	if (prims.empty()) return;
+
+	std::vector<float> centers(prims.size() * 3);
+	for (size_t i = 0; i < prims.size(); ++i)
+	{
+		order[i] = unsigned(i);
+		for (int c = 0; c < 3; ++c)
+			centers[3 * i + c] = 0.5f * (prims[i].min[c] + prims[i].max[c]);
+	}
+
+	struct Task { unsigned node, begin, end; };
+	std::vector<Task> stack;
+
+	nodes.push_back(BvhNode());
+	Task root = { 0, 0, unsigned(prims.size()) };
+	stack.push_back(root);
+
+	while (!stack.empty())
+	{
+		auto task = stack.back();
+		stack.pop_back();
+
+		BvhNode node;
+		float centerMin[3], centerMax[3];
+		reset_bounds(node.min, node.max);
+		reset_bounds(centerMin, centerMax);
+
+		for (auto i = task.begin; i < task.end; ++i)
+		{
+			auto& prim = prims[order[i]];
+			extend_bounds(node.min, node.max, prim.min, prim.max);
+			extend_bounds(centerMin, centerMax, &centers[3 * order[i]], &centers[3 * order[i]]);
+		}
+
+		unsigned count = task.end - task.begin;
+		node.first = task.begin;
+		node.count = count;
+
+		// Find best SAH split over binned centroids
+		int bestAxis = -1;
+		unsigned bestBin = 0;
+		float bestCost = FLT_MAX;
+
+		if (count > 1)
+		{
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				float extent = centerMax[axis] - centerMin[axis];
+				if (!(extent > 0.0f)) continue;
+				float binScale = float(bvh_bin_count) / extent;
+
+				PrimBounds bins[bvh_bin_count];
+				unsigned binCounts[bvh_bin_count] = { };
+				for (auto& bin : bins)
+					reset_bounds(bin.min, bin.max);
+
+				for (auto i = task.begin; i < task.end; ++i)
+				{
+					auto bin = std::min(unsigned((centers[3 * order[i] + axis] - centerMin[axis]) * binScale), bvh_bin_count - 1);
+					extend_bounds(bins[bin].min, bins[bin].max, prims[order[i]].min, prims[order[i]].max);
+					++binCounts[bin];
+				}
+
+				// Sweep from the right, then evaluate splits from the left
+				float rightCosts[bvh_bin_count];
+				{
+					PrimBounds right;
+					reset_bounds(right.min, right.max);
+					unsigned rightCount = 0;
+					for (unsigned b = bvh_bin_count; b-- > 1; )
+					{
+						extend_bounds(right.min, right.max, bins[b].min, bins[b].max);
+						rightCount += binCounts[b];
+						rightCosts[b] = rightCount ? half_area(right.min, right.max) * float(rightCount) : 0.0f;
+					}
+				}
+
+				PrimBounds left;
+				reset_bounds(left.min, left.max);
+				unsigned leftCount = 0;
+				for (unsigned b = 0; b + 1 < bvh_bin_count; ++b)
+				{
+					extend_bounds(left.min, left.max, bins[b].min, bins[b].max);
+					leftCount += binCounts[b];
+					if (leftCount == 0 || leftCount == count) continue;
+
+					float cost = half_area(left.min, left.max) * float(leftCount) + rightCosts[b + 1];
+					if (cost < bestCost)
+					{
+						bestCost = cost;
+						bestAxis = axis;
+						bestBin = b;
+					}
+				}
+			}
+		}
+
+		float nodeArea = half_area(node.min, node.max);
+		float leafCost = nodeArea * float(count);
+		bool split = (bestAxis >= 0)
+			? (count > bvh_max_leaf_size || bvh_traversal_cost * nodeArea + bestCost < leafCost)
+			: (count > bvh_max_leaf_size); // coincident centroids: split in the middle if too large
+
+		if (split)
+		{
+			unsigned mid;
+			if (bestAxis >= 0)
+			{
+				float binScale = float(bvh_bin_count) / (centerMax[bestAxis] - centerMin[bestAxis]);
+				auto midIt = std::partition(order.begin() + task.begin, order.begin() + task.end, [&](unsigned prim)
+				{
+					return std::min(unsigned((centers[3 * prim + bestAxis] - centerMin[bestAxis]) * binScale), bvh_bin_count - 1) <= bestBin;
+				});
+				mid = unsigned(midIt - order.begin());
+			}
+			else
+				mid = task.begin + count / 2;
+
+			node.first = unsigned(nodes.size());
+			node.count = 0;
+			nodes.resize(nodes.size() + 2);
+
+			// Left child on top of the stack for depth-first order
+			Task right = { node.first + 1, mid, task.end };
+			Task left = { node.first, task.begin, mid };
+			stack.push_back(right);
+			stack.push_back(left);
+		}
+
+		nodes[task.node] = node;
+	}
+}
+
+} // namespace
+
+void build_bvhs(scenefile::Extensions& extensions, scene::Scene const& scene)
+{
+	// Top level over instances
+	{
+		std::vector<PrimBounds> prims(scene.instances.size());
+		for (size_t i = 0; i < prims.size(); ++i)
+		{
+			auto& bounds = scene.instances[i].bounds;
+			for (int c = 0; c < 3; ++c)
+			{
+				prims[i].min[c] = bounds.min.c[c];
+				prims[i].max[c] = bounds.max.c[c];
+			}
+		}
+
+		std::vector<BvhNode> nodes;
+		std::vector<unsigned> order;
+		build_bvh(nodes, order, prims);
+
+		extensions.add("TLNO", std::move(nodes));
+		extensions.add("TLPR", std::move(order));
+	}
+
+	// Bottom level over triangles, one BVH per mesh
+	{
+		size_t meshCount = scene.meshes.size();
+		std::vector< std::vector<BvhNode> > meshNodes(meshCount);
+		std::vector< std::vector<unsigned> > meshOrders(meshCount);
+
+		parallel_for(meshCount, [&](size_t meshIdx)
+		{
+			auto& mesh = scene.meshes[meshIdx];
+			auto indices = scene.indices.data() + mesh.primitives.first;
+
+			std::vector<PrimBounds> prims((mesh.primitives.last - mesh.primitives.first) / 3);
+			for (size_t i = 0; i < prims.size(); ++i)
+			{
+				reset_bounds(prims[i].min, prims[i].max);
+				for (int j = 0; j < 3; ++j)
+				{
+					auto& v = scene.positions[indices[3 * i + j]];
+					extend_bounds(prims[i].min, prims[i].max, v.c, v.c);
+				}
+			}
+
+			build_bvh(meshNodes[meshIdx], meshOrders[meshIdx], prims);
+		});
+
+		std::vector<scenefile::BvhMesh> meshTable(meshCount);
+		size_t nodeCount = 0, primitiveCount = 0;
+		for (size_t i = 0; i < meshCount; ++i)
+		{
+			scenefile::BvhMesh entry = { unsigned(nodeCount), unsigned(meshNodes[i].size()), unsigned(primitiveCount), unsigned(meshOrders[i].size()) };
+			meshTable[i] = entry;
+			nodeCount += meshNodes[i].size();
+			primitiveCount += meshOrders[i].size();
+		}
+
+		std::vector<BvhNode> nodes(nodeCount);
+		std::vector<unsigned> order(primitiveCount);
+
+		// Concatenate with absolute indices
+		parallel_for(meshCount, [&](size_t meshIdx)
+		{
+			auto& entry = meshTable[meshIdx];
+			auto node = nodes.data() + entry.firstNode;
+			for (auto& meshNode : meshNodes[meshIdx])
+			{
+				*node = meshNode;
+				node->first += (node->count == 0) ? entry.firstNode : entry.firstPrimitive;
+				++node;
+			}
+			std::copy(meshOrders[meshIdx].begin(), meshOrders[meshIdx].end(), order.begin() + entry.firstPrimitive);
+		});
+
+		extensions.add("BLNO", std::move(nodes));
+		extensions.add("BLPR", std::move(order));
+		extensions.add("BLMS", std::move(meshTable));
+	}
+}
@@ -0,0 +1,166 @@
+#include "pch.h"
+
+#include "cache.h"
+#include "hash.h"
+
+#include "stdx"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+
+#ifdef WIN32
+	#include <direct.h>
+#else
+	#include <sys/stat.h>
+#endif
+
+#include "scenefile.h"
+
+namespace
+{
+
+char const* const manifest_magic = "scenecvt-cache 1";
+
+bool file_exists(char const* path)
+{
+	return std::ifstream(path, std::ios_base::binary).is_open();
+}
+
+void make_dir(char const* path)
+{
+#ifdef WIN32
+	_mkdir(path);
+#else
+	mkdir(path, 0777);
+#endif
+}
+
+void copy_file(char const* dest, char const* src)
+{
+	std::ifstream in(src, std::ios_base::binary);
+	std::ofstream out(dest, std::ios_base::binary | std::ios_base::trunc);
+	if (!in || !out)
+		throwx( std::runtime_error("Cache file copy") );
+	out << in.rdbuf();
+	if (!out)
+		throwx( std::runtime_error("Cache file copy") );
+}
+
+// Records the paths of all files opened through it.
+class TrackingIOSystem : public Assimp::DefaultIOSystem
+{
+public:
+	explicit TrackingIOSystem(ConversionCache& cache) : cache(cache) { }
+
+	Assimp::IOStream* Open(char const* file, char const* mode) override
+	{
+		auto stream = DefaultIOSystem::Open(file, mode);
+		if (stream) cache.add_dependency(file);
+		return stream;
+	}
+
+private:
+	ConversionCache& cache;
+};
+
+} // namespace
+
+std::uint64_t hash_file(char const* path)
+{
+	std::ifstream file(path, std::ios_base::binary);
+	if (!file)
+		throwx( std::runtime_error("Cache input hashing") );
+
+	Hasher hasher;
+	std::vector<char> block(1 << 20);
+	while (file)
+	{
+		file.read(block.data(), block.size());
+		hasher.add(block.data(), size_t(file.gcount()));
+	}
+	return hasher.result();
+}
+
+ConversionCache::ConversionCache(char const* dir, std::uint64_t key)
+{
+	make_dir(dir);
+
+	std::ostringstream path;
+	path << dir << '/' << std::hex << std::setw(16) << std::setfill('0') << key;
+	entryPath = path.str();
+}
+
+bool ConversionCache::restore(char const* output)
+{
+	std::ifstream manifest(entryPath + ".manifest");
+	std::string line;
+	if (!std::getline(manifest, line) || line != manifest_magic)
+		return false;
+
+	// Dependencies: <hash> <path>
+	while (std::getline(manifest, line))
+	{
+		std::uint64_t hash;
+		int pathOffset = 0;
+		if (sscanf(line.c_str(), "%llx %n", reinterpret_cast<unsigned long long*>(&hash), &pathOffset) != 1 || pathOffset == 0)
+			return false;
+
+		auto path = line.c_str() + pathOffset;
+		if (!file_exists(path) || hash_file(path) != hash)
+			return false;
+	}
+
+	copy_file(output, (entryPath + ".scene").c_str());
+
+	auto cachedExtensions = entryPath + ".scene.ext";
+	if (file_exists(cachedExtensions.c_str()))
+		copy_file(scenefile::extension_path(output).c_str(), cachedExtensions.c_str());
+	else
+		remove(scenefile::extension_path(output).c_str());
+
+	return true;
+}
+
+void ConversionCache::store(char const* output, bool withExtensions)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// Invalidate until complete
+	remove((entryPath + ".manifest").c_str());
+
+	copy_file((entryPath + ".scene").c_str(), output);
+
+	auto cachedExtensions = entryPath + ".scene.ext";
+	if (withExtensions)
+		copy_file(cachedExtensions.c_str(), scenefile::extension_path(output).c_str());
+	else
+		remove(cachedExtensions.c_str());
+
+	std::sort(dependencies.begin(), dependencies.end());
+	dependencies.erase(std::unique(dependencies.begin(), dependencies.end()), dependencies.end());
+
+	// Manifest last, marks the entry complete
+	std::ofstream manifest(entryPath + ".manifest", std::ios_base::trunc);
+	manifest << manifest_magic << '\n';
+	for (auto& dependency : dependencies)
+		manifest << std::hex << std::setw(16) << std::setfill('0') << hash_file(dependency.c_str()) << ' ' << dependency << '\n';
+	if (!manifest)
+		throwx( std::runtime_error("Cache manifest write") );
+}
+
+Assimp::IOSystem* ConversionCache::track_dependencies()
+{
+	return new TrackingIOSystem(*this);
+}
+
+void ConversionCache::add_dependency(std::string const& path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	dependencies.push_back(path);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+namespace Assimp { class IOSystem; }
+
+std::uint64_t hash_file(char const* path);
+
+// Persistent conversion cache. Entries are keyed by a hash of converter version, flags, input paths & bytes,
+// and are only reused if all dependencies recorded on conversion (e.g. material & texture files) are unchanged.
+class ConversionCache
+{
+public:
+	ConversionCache(char const* dir, std::uint64_t key);
+
+	// Restores the cached output (and extension sidecar) if the entry is up to date.
+	bool restore(char const* output);
+	// Stores the given output (and extension sidecar) along with all recorded dependencies.
+	void store(char const* output, bool withExtensions);
+
+	// Returns a new IO system recording all files opened by an importer. Ownership passes to the importer.
+	Assimp::IOSystem* track_dependencies();
+	void add_dependency(std::string const& path);
+
+private:
+	std::string entryPath;
+	std::mutex mutex;
+	std::vector<std::string> dependencies;
+};
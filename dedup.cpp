@@ -0,0 +1,343 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <unordered_map>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+#include <scenex>
+
+#include "scenepass.h"
+#include "parallel.h"
+#include "hash.h"
+
+namespace
+{
+
+// Orthonormal frame spanned by the first non-degenerate triangle of a mesh. Copies of a mesh
+// differing by a rigid transform have identical geometry relative to their frames.
+struct MeshFrame
+{
+	float origin[3];
+	float axes[3][3]; // local x, y, z in world space
+	float extent;     // local bounds extent, power of two
+	std::uint64_t hash;
+	bool candidate;
+};
+
+// Geometry is considered equal within this fraction of the mesh extent
+float const dedup_position_tolerance = 1.0e-4f;
+float const dedup_direction_tolerance = 1.0e-3f;
+float const dedup_texcoord_tolerance = 1.0e-5f;
+// Hash grid, coarser than the tolerance
+float const dedup_hash_cells = 64.0f;
+
+inline void to_local(float* local, MeshFrame const& frame, float const* p)
+{
+	float d[3] = { p[0] - frame.origin[0], p[1] - frame.origin[1], p[2] - frame.origin[2] };
+	for (int k = 0; k < 3; ++k)
+		local[k] = frame.axes[k][0] * d[0] + frame.axes[k][1] * d[1] + frame.axes[k][2] * d[2];
+}
+
+inline void to_local_direction(float* local, MeshFrame const& frame, float const* v)
+{
+	for (int k = 0; k < 3; ++k)
+		local[k] = frame.axes[k][0] * v[0] + frame.axes[k][1] * v[1] + frame.axes[k][2] * v[2];
+}
+
+void compute_frame(MeshFrame& frame, scene::Scene const& scene, scene::Mesh const& mesh, VertexRange const& range)
+{
+	auto indices = scene.indices.data() + mesh.primitives.first;
+	size_t indexCount = mesh.primitives.last - mesh.primitives.first;
+
+	frame.candidate = !range.shared && indexCount > 0;
+	if (!frame.candidate) return;
+
+	// Identity if fully degenerate, only translated copies match
+	auto& firstPos = scene.positions[indices[0]];
+	for (int c = 0; c < 3; ++c)
+	{
+		frame.origin[c] = firstPos.c[c];
+		for (int k = 0; k < 3; ++k)
+			frame.axes[k][c] = float(k == c);
+	}
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3)
+	{
+		auto& p0 = scene.positions[indices[i]];
+		auto& p1 = scene.positions[indices[i + 1]];
+		auto& p2 = scene.positions[indices[i + 2]];
+
+		float e1[3], e2[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			e1[c] = p1.c[c] - p0.c[c];
+			e2[c] = p2.c[c] - p0.c[c];
+		}
+		float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+
+		float e1Len = std::sqrt(e1[0] * e1[0] + e1[1] * e1[1] + e1[2] * e1[2]);
+		float nLen = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (!(nLen > 1.0e-6f * e1Len * e1Len)) continue;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			frame.origin[c] = p0.c[c];
+			frame.axes[0][c] = e1[c] / e1Len;
+			frame.axes[2][c] = n[c] / nLen;
+		}
+		// y = z x x
+		auto& x = frame.axes[0];
+		auto& z = frame.axes[2];
+		frame.axes[1][0] = z[1] * x[2] - z[2] * x[1];
+		frame.axes[1][1] = z[2] * x[0] - z[0] * x[2];
+		frame.axes[1][2] = z[0] * x[1] - z[1] * x[0];
+		break;
+	}
+
+	// Local extent, rounded up to a power of two for stable hash cells
+	float maxAbs = 0.0f;
+	for (auto v = range.first; v < range.last; ++v)
+	{
+		float local[3];
+		to_local(local, frame, scene.positions[v].c);
+		for (int c = 0; c < 3; ++c)
+			maxAbs = std::max(maxAbs, std::abs(local[c]));
+	}
+	int exponent;
+	std::frexp(maxAbs, &exponent);
+	frame.extent = std::ldexp(1.0f, exponent);
+
+	Hasher hasher;
+	hasher.add_value(mesh.material);
+	hasher.add_value(range.last - range.first);
+	for (size_t i = 0; i < indexCount; ++i)
+		hasher.add_value(indices[i] - range.first);
+
+	float cellScale = dedup_hash_cells / frame.extent;
+	for (auto v = range.first; v < range.last; ++v)
+	{
+		float local[3];
+		to_local(local, frame, scene.positions[v].c);
+		// Cell centered at the frame axes, on which the first triangle lies
+		std::int32_t cell[3];
+		for (int c = 0; c < 3; ++c)
+			cell[c] = std::int32_t(std::floor(local[c] * cellScale + 0.5f));
+		hasher.add_value(cell);
+
+		if (!scene.colors.empty())
+			hasher.add_value(scene.colors[v]);
+	}
+
+	frame.hash = hasher.result();
+}
+
+bool equal_within(float const* a, float const* b, int count, float tolerance)
+{
+	for (int c = 0; c < count; ++c)
+		if (!(std::abs(a[c] - b[c]) <= tolerance))
+			return false;
+	return true;
+}
+
+// Verifies that the two meshes match relative to their frames.
+bool geometry_equal(scene::Scene const& scene, scene::Mesh const& meshA, VertexRange const& rangeA, MeshFrame const& frameA
+	, scene::Mesh const& meshB, VertexRange const& rangeB, MeshFrame const& frameB)
+{
+	if (meshA.material != meshB.material
+		|| meshA.primitives.last - meshA.primitives.first != meshB.primitives.last - meshB.primitives.first
+		|| rangeA.last - rangeA.first != rangeB.last - rangeB.first)
+		return false;
+
+	for (auto i = meshA.primitives.first, j = meshB.primitives.first; i < meshA.primitives.last; ++i, ++j)
+		if (scene.indices[i] - rangeA.first != scene.indices[j] - rangeB.first)
+			return false;
+
+	float positionTolerance = dedup_position_tolerance * std::max(frameA.extent, frameB.extent);
+	for (auto a = rangeA.first, b = rangeB.first; a < rangeA.last; ++a, ++b)
+	{
+		float la[3], lb[3];
+		to_local(la, frameA, scene.positions[a].c);
+		to_local(lb, frameB, scene.positions[b].c);
+		if (!equal_within(la, lb, 3, positionTolerance))
+			return false;
+
+		auto&& directionEqual = [&](std::vector<math::vec3> const& stream)
+		{
+			if (stream.empty()) return true;
+			to_local_direction(la, frameA, stream[a].c);
+			to_local_direction(lb, frameB, stream[b].c);
+			return equal_within(la, lb, 3, dedup_direction_tolerance);
+		};
+		if (!directionEqual(scene.normals) || !directionEqual(scene.tangents) || !directionEqual(scene.bitangents))
+			return false;
+
+		if (!scene.colors.empty() && scene.colors[a] != scene.colors[b])
+			return false;
+		if (!scene.texcoords.empty() && !equal_within(scene.texcoords[a].c, scene.texcoords[b].c, 2, dedup_texcoord_tolerance))
+			return false;
+	}
+
+	return true;
+}
+
+// Rigid transform mapping the geometry of frame 'from' onto frame 'to'.
+math::mat4x3 frame_transform(MeshFrame const& from, MeshFrame const& to)
+{
+	math::mat4x3 result;
+	for (int i = 0; i < 3; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+			result.cls[j].c[i] = to.axes[0][i] * from.axes[0][j] + to.axes[1][i] * from.axes[1][j] + to.axes[2][i] * from.axes[2][j];
+	}
+	for (int i = 0; i < 3; ++i)
+	{
+		result.cls[3].c[i] = to.origin[i];
+		for (int j = 0; j < 3; ++j)
+			result.cls[3].c[i] -= result.cls[j].c[i] * from.origin[j];
+	}
+	return result;
+}
+
+math::mat4x3 concat_transforms(math::mat4x3 const& outer, math::mat4x3 const& inner)
+{
+	math::mat4x3 result;
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 3; ++i)
+		{
+			result.cls[j].c[i] = (j == 3) ? outer.cls[3].c[i] : 0.0f;
+			for (int k = 0; k < 3; ++k)
+				result.cls[j].c[i] += outer.cls[k].c[i] * inner.cls[j].c[k];
+		}
+	return result;
+}
+
+template <class T>
+void compact_stream(std::vector<T>& stream, std::vector<unsigned> const& vertexRemap, size_t newCount)
+{
+	if (stream.empty()) return;
+
+	for (size_t i = 0; i < vertexRemap.size(); ++i)
+		if (vertexRemap[i] != ~0U)
+			stream[vertexRemap[i]] = stream[i];
+	stream.resize(newCount);
+}
+
+} // namespace
+
+void deduplicate_meshes(scene::Scene& scene, bool report)
+{
+	size_t meshCount = scene.meshes.size();
+	auto ranges = mesh_vertex_ranges(scene);
+
+	std::vector<MeshFrame> frames(meshCount);
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		compute_frame(frames[meshIdx], scene, scene.meshes[meshIdx], ranges[meshIdx]);
+	});
+
+	// Match each mesh against earlier representatives of equal hash
+	std::unordered_multimap<std::uint64_t, unsigned> representatives;
+	std::vector<unsigned> duplicateOf(meshCount, ~0U);
+	size_t duplicateCount = 0;
+
+	for (unsigned meshIdx = 0; meshIdx < meshCount; ++meshIdx)
+	{
+		auto& frame = frames[meshIdx];
+		if (!frame.candidate) continue;
+
+		auto candidates = representatives.equal_range(frame.hash);
+		for (auto it = candidates.first; it != candidates.second; ++it)
+		{
+			auto repIdx = it->second;
+			if (geometry_equal(scene, scene.meshes[repIdx], ranges[repIdx], frames[repIdx], scene.meshes[meshIdx], ranges[meshIdx], frame))
+			{
+				duplicateOf[meshIdx] = repIdx;
+				++duplicateCount;
+				break;
+			}
+		}
+
+		if (duplicateOf[meshIdx] == ~0U)
+			representatives.insert(std::make_pair(frame.hash, meshIdx));
+	}
+
+	if (duplicateCount == 0)
+	{
+		if (report)
+			std::cout << "Deduplication: no duplicate meshes" << std::endl;
+		return;
+	}
+
+	// New mesh indices
+	std::vector<unsigned> meshRemap(meshCount);
+	unsigned keptMeshCount = 0;
+	for (size_t i = 0; i < meshCount; ++i)
+		if (duplicateOf[i] == ~0U)
+			meshRemap[i] = keptMeshCount++;
+	for (size_t i = 0; i < meshCount; ++i)
+		if (duplicateOf[i] != ~0U)
+			meshRemap[i] = meshRemap[duplicateOf[i]];
+
+	// Re-target instances of duplicates to their representatives
+	parallel_for(scene.instances.size(), [&](size_t instanceIdx)
+	{
+		auto& instance = scene.instances[instanceIdx];
+		auto repIdx = duplicateOf[instance.mesh];
+		if (repIdx != ~0U)
+		{
+			instance.transform = concat_transforms(instance.transform, frame_transform(frames[repIdx], frames[instance.mesh]));
+			instance.bounds = transform_bounds(scene.meshes[repIdx].bounds, instance.transform);
+		}
+		instance.mesh = meshRemap[instance.mesh];
+	});
+
+	// Drop vertices of duplicates
+	size_t vertexCount = scene.positions.size();
+	std::vector<unsigned> vertexRemap(vertexCount, 0);
+	for (size_t i = 0; i < meshCount; ++i)
+		if (duplicateOf[i] != ~0U)
+			std::fill(vertexRemap.begin() + ranges[i].first, vertexRemap.begin() + ranges[i].last, ~0U);
+
+	size_t keptVertexCount = 0;
+	for (auto& v : vertexRemap)
+		if (v != ~0U)
+			v = unsigned(keptVertexCount++);
+
+	compact_stream(scene.positions, vertexRemap, keptVertexCount);
+	compact_stream(scene.normals, vertexRemap, keptVertexCount);
+	compact_stream(scene.colors, vertexRemap, keptVertexCount);
+	compact_stream(scene.texcoords, vertexRemap, keptVertexCount);
+	compact_stream(scene.tangents, vertexRemap, keptVertexCount);
+	compact_stream(scene.bitangents, vertexRemap, keptVertexCount);
+
+	// Drop primitives & meshes of duplicates
+	std::vector<unsigned> keptIndices;
+	std::vector<scene::Mesh> keptMeshes;
+	keptIndices.reserve(scene.indices.size());
+	keptMeshes.reserve(keptMeshCount);
+	for (size_t i = 0; i < meshCount; ++i)
+	{
+		if (duplicateOf[i] != ~0U) continue;
+
+		auto mesh = scene.meshes[i];
+		auto first = unsigned(keptIndices.size());
+		for (auto j = mesh.primitives.first; j < mesh.primitives.last; ++j)
+			keptIndices.push_back(vertexRemap[scene.indices[j]]);
+		mesh.primitives.first = first;
+		mesh.primitives.last = unsigned(keptIndices.size());
+		keptMeshes.push_back(mesh);
+	}
+
+	size_t removedIndexCount = scene.indices.size() - keptIndices.size();
+	scene.indices.swap(keptIndices);
+	scene.meshes.swap(keptMeshes);
+
+	if (report)
+		std::cout << "Deduplication: " << duplicateCount << " of " << meshCount << " meshes turned into instances, "
+			<< (vertexCount - keptVertexCount) << " vertices & " << removedIndexCount << " indices removed" << std::endl;
+}
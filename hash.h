@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// MurmurHash64A (Austin Appleby)
+inline std::uint64_t murmur_hash64(void const* key, size_t length, std::uint64_t seed)
+{
+	std::uint64_t const m = 0xc6a4a7935bd1e995ULL;
+	int const r = 47;
+
+	std::uint64_t h = seed ^ (length * m);
+
+	auto data = static_cast<unsigned char const*>(key);
+	auto dataEnd = data + (length & ~size_t(7));
+	for (; data != dataEnd; data += 8)
+	{
+		std::uint64_t k;
+		memcpy(&k, data, sizeof(k));
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	switch (length & 7)
+	{
+	case 7: h ^= std::uint64_t(data[6]) << 48U; // fall through
+	case 6: h ^= std::uint64_t(data[5]) << 40U; // fall through
+	case 5: h ^= std::uint64_t(data[4]) << 32U; // fall through
+	case 4: h ^= std::uint64_t(data[3]) << 24U; // fall through
+	case 3: h ^= std::uint64_t(data[2]) << 16U; // fall through
+	case 2: h ^= std::uint64_t(data[1]) << 8U; // fall through
+	case 1: h ^= std::uint64_t(data[0]);
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+// Incremental hash over a sequence of byte ranges & values.
+struct Hasher
+{
+	std::uint64_t state;
+
+	explicit Hasher(std::uint64_t seed = 0) : state(seed) { }
+
+	void add(void const* data, size_t length) { state = murmur_hash64(data, length, state); }
+	void add(char const* str) { add(str, strlen(str) + 1); }
+	void add(std::string const& str) { add(str.c_str(), str.size() + 1); }
+
+	template <class T>
+	void add_value(T const& value) { add(&value, sizeof(value)); }
+
+	std::uint64_t result() const { return state; }
+};
@@ -0,0 +1,53 @@
+#include "pch.h"
+
+#include "importpool.h"
+
+#include <assimp/Importer.hpp>
+
+ImporterPool& ImporterPool::shared()
+{
+	static ImporterPool pool;
+	return pool;
+}
+
+ImporterPool::~ImporterPool()
+{
+	for (auto importer : idle)
+		delete importer;
+}
+
+ImporterPool::Lease ImporterPool::acquire()
+{
+	Assimp::Importer* importer = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!idle.empty())
+		{
+			importer = idle.back();
+			idle.pop_back();
+		}
+	}
+	if (!importer)
+		importer = new Assimp::Importer();
+
+	Release release = { this };
+	return Lease(importer, release);
+}
+
+void ImporterPool::warm_up(size_t count)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	while (idle.size() < count)
+		idle.push_back(new Assimp::Importer());
+}
+
+void ImporterPool::Release::operator ()(Assimp::Importer* importer) const
+{
+	// Handlers may reference state of the finished conversion
+	importer->FreeScene();
+	importer->SetIOHandler(nullptr);
+	importer->SetProgressHandler(nullptr);
+
+	std::lock_guard<std::mutex> lock(pool->mutex);
+	pool->idle.push_back(importer);
+}
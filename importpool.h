@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <mutex>
+
+namespace Assimp { class Importer; }
+
+// Process-wide pool of Assimp importers. Constructing an importer registers all loaders &
+// post-processing steps, pooling keeps this off the path of repeated conversions in
+// long-running processes (batch-run, serve).
+class ImporterPool
+{
+public:
+	// Returns importers to the pool, reset to default IO & progress handlers
+	struct Release
+	{
+		ImporterPool* pool;
+		void operator ()(Assimp::Importer* importer) const;
+	};
+	typedef std::unique_ptr<Assimp::Importer, Release> Lease;
+
+	static ImporterPool& shared();
+
+	~ImporterPool();
+
+	// Returns an idle importer or creates a new one. Importer properties persist across
+	// leases, callers set all properties they rely on.
+	Lease acquire();
+	// Creates importers up front until the given number is idle.
+	void warm_up(size_t count);
+
+private:
+	std::mutex mutex;
+	std::vector<Assimp::Importer*> idle;
+};
@@ -0,0 +1,350 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+#include <scenex>
+
+#include "parallel.h"
+#include "scenefile.h"
+#include "sceneview.h"
+
+void inspect_help()
+{
+	std::cout << " Syntax: scenecvt inspect [/Ie <int>] <scene>"  << std::endl << std::endl;
+
+	std::cout << " Arguments:"  << std::endl;
+	std::cout << "  /Ie <int>      Print up to <int> errors per check (default 10)"  << std::endl;
+	std::cout << "  <scene>        Scene file to validate, <scene>.ext is listed if present"  << std::endl;
+}
+
+namespace
+{
+
+using scenefile::MappedScene;
+
+// Index range checks run in blocks of this many elements
+size_t const inspect_block_size = 1 << 20;
+
+double milliseconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Counts failed checks, printing the first few of each kind.
+struct ErrorLog
+{
+	unsigned maxPrinted = 10;
+	size_t total = 0;
+
+	size_t begin_check() const { return total; }
+
+	template <class Message>
+	void fail(size_t checkBegin, Message&& message)
+	{
+		if (total++ - checkBegin < maxPrinted)
+			std::cout << "  Error: " << message() << std::endl;
+	}
+
+	void end_check(size_t checkBegin, char const* check) const
+	{
+		if (total - checkBegin > maxPrinted)
+			std::cout << "  ... " << (total - checkBegin) << " errors in total (" << check << ")" << std::endl;
+	}
+};
+
+void validate_scene(ErrorLog& log, MappedScene const& scene, size_t vertexCount)
+{
+	// Vertex streams
+	{
+		auto check = log.begin_check();
+		auto&& checkStream = [&](auto const& view, char const* name)
+		{
+			if (!view.empty() && view.size() != vertexCount)
+				log.fail(check, [&]() { return std::string(name) + " has " + std::to_string(view.size()) + " elements for " + std::to_string(vertexCount) + " vertices"; });
+		};
+		checkStream(scene.normals, "normals");
+		checkStream(scene.colors, "colors");
+		checkStream(scene.texcoords, "texcoords");
+		checkStream(scene.tangents, "tangents");
+		checkStream(scene.bitangents, "bitangents");
+		log.end_check(check, "vertex streams");
+	}
+
+	// Index range, in parallel blocks over the mapping
+	{
+		auto check = log.begin_check();
+		size_t blockCount = (scene.indices.size() + inspect_block_size - 1) / inspect_block_size;
+		std::vector<size_t> firstInvalid(blockCount, size_t(-1));
+		std::vector<size_t> invalidCounts(blockCount, 0);
+
+		parallel_for(blockCount, [&](size_t blockIdx)
+		{
+			size_t first = blockIdx * inspect_block_size;
+			size_t last = std::min(first + inspect_block_size, scene.indices.size());
+			size_t invalid = 0;
+			for (size_t i = first; i < last; ++i)
+				if (scene.indices[i] >= vertexCount)
+				{
+					if (invalid++ == 0) firstInvalid[blockIdx] = i;
+				}
+			invalidCounts[blockIdx] = invalid;
+		});
+
+		for (size_t blockIdx = 0; blockIdx < blockCount; ++blockIdx)
+			if (invalidCounts[blockIdx])
+			{
+				auto i = firstInvalid[blockIdx];
+				log.fail(check, [&]() { return std::to_string(invalidCounts[blockIdx]) + " indices out of range in block from " + std::to_string(blockIdx * inspect_block_size)
+					+ ", first: indices[" + std::to_string(i) + "] = " + std::to_string(scene.indices[i]) + " >= " + std::to_string(vertexCount); });
+			}
+		log.end_check(check, "index range");
+	}
+
+	// Meshes
+	{
+		auto check = log.begin_check();
+		for (size_t i = 0; i < scene.meshes.size(); ++i)
+		{
+			auto mesh = scene.meshes[i];
+			if (mesh.primitives.first > mesh.primitives.last || mesh.primitives.last > scene.indices.size() || (mesh.primitives.last - mesh.primitives.first) % 3 != 0)
+				log.fail(check, [&]() { return "meshes[" + std::to_string(i) + "] primitives [" + std::to_string(mesh.primitives.first) + ", " + std::to_string(mesh.primitives.last)
+					+ ") invalid for " + std::to_string(scene.indices.size()) + " indices"; });
+			if (mesh.material >= scene.materials.size())
+				log.fail(check, [&]() { return "meshes[" + std::to_string(i) + "] material " + std::to_string(mesh.material) + " >= " + std::to_string(scene.materials.size()); });
+		}
+		log.end_check(check, "meshes");
+	}
+
+	// Instances
+	{
+		auto check = log.begin_check();
+		for (size_t i = 0; i < scene.instances.size(); ++i)
+		{
+			auto mesh = scene.instances[i].mesh;
+			if (mesh >= scene.meshes.size())
+				log.fail(check, [&]() { return "instances[" + std::to_string(i) + "] mesh " + std::to_string(mesh) + " >= " + std::to_string(scene.meshes.size()); });
+		}
+		log.end_check(check, "instances");
+	}
+
+	// Material textures, stored as offsets of null-terminated texture paths
+	{
+		auto check = log.begin_check();
+		auto paths = scene.texturePaths.data();
+		size_t pathsSize = scene.texturePaths.size();
+		if (pathsSize > 0 && paths[pathsSize - 1] != 0)
+			log.fail(check, [&]() { return std::string("texturePaths not null-terminated"); });
+
+		for (size_t i = 0; i < scene.materials.size(); ++i)
+		{
+			auto tex = scene.materials[i].tex;
+			unsigned const textures[] = { tex.diffuse, tex.emissive, tex.specular, tex.shininess, tex.reflectivity, tex.filter, tex.normal, tex.bump };
+			for (auto texture : textures)
+				if (texture >= pathsSize || (texture > 0 && paths[texture - 1] != 0))
+					log.fail(check, [&]() { return "materials[" + std::to_string(i) + "] texture offset " + std::to_string(texture) + " not a path in " + std::to_string(pathsSize) + " bytes of texturePaths"; });
+		}
+		log.end_check(check, "material textures");
+	}
+
+	if (scene.trailing_bytes())
+	{
+		auto check = log.begin_check();
+		log.fail(check, [&]() { return std::to_string(scene.trailing_bytes()) + " trailing bytes after the last section"; });
+	}
+}
+
+void print_statistics(MappedScene const& scene, size_t vertexCount)
+{
+	size_t triangles = 0, instancedTriangles = 0;
+	for (auto mesh : scene.meshes)
+		if (mesh.primitives.last > mesh.primitives.first)
+			triangles += (mesh.primitives.last - mesh.primitives.first) / 3;
+	for (auto instance : scene.instances)
+		if (instance.mesh < scene.meshes.size())
+		{
+			auto mesh = scene.meshes[instance.mesh];
+			if (mesh.primitives.last > mesh.primitives.first)
+				instancedTriangles += (mesh.primitives.last - mesh.primitives.first) / 3;
+		}
+
+	size_t texturePathCount = 0;
+	for (auto c : scene.texturePaths)
+		texturePathCount += (c == 0);
+
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (auto instance : scene.instances)
+		for (int c = 0; c < 3; ++c)
+		{
+			min[c] = std::min(min[c], instance.bounds.min.c[c]);
+			max[c] = std::max(max[c], instance.bounds.max.c[c]);
+		}
+
+	std::cout << "Statistics:" << std::endl;
+	std::cout << "  vertices:            " << vertexCount << std::endl;
+	std::cout << "  triangles:           " << triangles << std::endl;
+	std::cout << "  meshes:              " << scene.meshes.size() << std::endl;
+	std::cout << "  instances:           " << scene.instances.size() << std::endl;
+	std::cout << "  instanced triangles: " << instancedTriangles << std::endl;
+	std::cout << "  materials:           " << scene.materials.size() << std::endl;
+	std::cout << "  texture paths:       " << texturePathCount << std::endl;
+	if (!scene.instances.empty())
+		std::cout << "  bounds:              (" << min[0] << ", " << min[1] << ", " << min[2] << ") - (" << max[0] << ", " << max[1] << ", " << max[2] << ")" << std::endl;
+}
+
+bool known_extension_header(scenefile::ExtHeader const& header)
+{
+	// Version 1 sidecars of /Q outputs replaced the float streams, which are then empty
+	return header.magic == scenefile::fourcc("SCXT") && header.version >= 1 && header.version <= scenefile::ext_version;
+}
+
+// Per-vertex element size of the quantized vertex stream chunks, 0 for other chunks.
+size_t quantized_vertex_size(std::uint32_t tag)
+{
+	if (tag == scenefile::fourcc("QPOS")) return 4 * sizeof(std::uint16_t);
+	if (tag == scenefile::fourcc("QNRM") || tag == scenefile::fourcc("QTAN") || tag == scenefile::fourcc("QBTN") || tag == scenefile::fourcc("QTEX"))
+		return 2 * sizeof(std::uint16_t);
+	return 0;
+}
+
+// Vertex count of the quantized positions in the extension sidecar, 0 if there are none.
+size_t quantized_vertex_count(char const* scenePath)
+{
+	auto path = scenefile::extension_path(scenePath);
+	if (!std::ifstream(path.c_str(), std::ios_base::binary).is_open())
+		return 0;
+
+	MappedFile file(path.c_str());
+	scenefile::ExtHeader header;
+	if (file.size() < sizeof(header))
+		return 0;
+	memcpy(&header, file.data(), sizeof(header));
+	if (!known_extension_header(header) || !(header.flags & scenefile::ext_quantized_positions)
+		|| header.chunkCount > (file.size() - sizeof(header)) / sizeof(scenefile::ExtChunk))
+		return 0;
+
+	for (std::uint32_t i = 0; i < header.chunkCount; ++i)
+	{
+		scenefile::ExtChunk chunk;
+		memcpy(&chunk, file.data() + sizeof(header) + i * sizeof(chunk), sizeof(chunk));
+		if (chunk.tag == scenefile::fourcc("QPOS"))
+			return size_t(chunk.size / quantized_vertex_size(chunk.tag));
+	}
+	return 0;
+}
+
+// Lists the chunks of the extension sidecar, checking that they lie within the file
+// & that quantized vertex streams match the vertex count.
+void inspect_extensions(ErrorLog& log, char const* scenePath, size_t vertexCount)
+{
+	auto path = scenefile::extension_path(scenePath);
+	if (!std::ifstream(path.c_str(), std::ios_base::binary).is_open())
+		return;
+
+	MappedFile file(path.c_str());
+	auto check = log.begin_check();
+
+	scenefile::ExtHeader header;
+	if (file.size() < sizeof(header))
+	{
+		log.fail(check, [&]() { return path + " truncated"; });
+		return;
+	}
+	memcpy(&header, file.data(), sizeof(header));
+	if (!known_extension_header(header))
+	{
+		log.fail(check, [&]() { return path + " has unknown magic or version"; });
+		return;
+	}
+	if (header.chunkCount > (file.size() - sizeof(header)) / sizeof(scenefile::ExtChunk))
+	{
+		log.fail(check, [&]() { return path + " chunk table truncated"; });
+		return;
+	}
+
+	std::cout << "Extensions (" << path << ", flags 0x" << std::hex << header.flags << std::dec << "):" << std::endl;
+	for (std::uint32_t i = 0; i < header.chunkCount; ++i)
+	{
+		scenefile::ExtChunk chunk;
+		memcpy(&chunk, file.data() + sizeof(header) + i * sizeof(chunk), sizeof(chunk));
+
+		char tag[5] = { char(chunk.tag), char(chunk.tag >> 8U), char(chunk.tag >> 16U), char(chunk.tag >> 24U), 0 };
+		std::cout << "  " << tag << ": " << (chunk.elementSize ? chunk.size / chunk.elementSize : 0) << " x " << chunk.elementSize << " bytes" << std::endl;
+
+		if (chunk.offset > file.size() || chunk.size > file.size() - chunk.offset || (chunk.elementSize && chunk.size % chunk.elementSize))
+			log.fail(check, [&]() { return std::string("extension chunk ") + tag + " exceeds file or has partial elements"; });
+
+		auto vertexSize = quantized_vertex_size(chunk.tag);
+		if (vertexSize && chunk.size != vertexCount * vertexSize)
+			log.fail(check, [&]() { return std::string("extension chunk ") + tag + " has " + std::to_string(chunk.size / vertexSize) + " elements for " + std::to_string(vertexCount) + " vertices"; });
+	}
+	log.end_check(check, "extensions");
+}
+
+} // namespace
+
+int inspect_tool(char const* tool, char const* const* args, char const* const* args_end)
+{
+	char const* input = nullptr;
+	ErrorLog log;
+
+	for (auto arg = args; arg < args_end; ++arg)
+	{
+		if (stdx::strieq(*arg, "help")) {
+			inspect_help();
+			return 0;
+		}
+		else if (stdx::check_flag(*arg, "Ie")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &log.maxPrinted) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number: " << *arg << std::endl;
+		}
+		else if (!input)
+			input = *arg;
+		else
+			std::cout << "Unrecognized argument, consult 'scenecvt inspect help' for help: " << *arg << std::endl;
+	}
+
+	if (!input)
+	{
+		std::cout << "Missing scene file argument, consult 'scenecvt inspect help' for help" << std::endl;
+		return -1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	MappedScene scene(input);
+	std::cout << "Mapped " << input << " (" << scene.file().size() << " bytes) in " << milliseconds_since(start) << " ms" << std::endl;
+
+	std::cout << "Sections:" << std::endl;
+	scenefile::for_each_section(scene, [&](auto const& view, char const* name)
+	{
+		std::cout << "  " << name << ": " << view.size() << " x " << sizeof(view[0]) << " bytes" << std::endl;
+	});
+
+	// Positions of quantized outputs live in the sidecar only, unless floats were kept
+	size_t vertexCount = scene.positions.size();
+	if (vertexCount == 0)
+		vertexCount = quantized_vertex_count(input);
+
+	start = std::chrono::steady_clock::now();
+	validate_scene(log, scene, vertexCount);
+	inspect_extensions(log, input, vertexCount);
+	std::cout << "Validated in " << milliseconds_since(start) << " ms: " << (log.total ? std::to_string(log.total) + " errors" : std::string("OK")) << std::endl;
+
+	start = std::chrono::steady_clock::now();
+	print_statistics(scene, vertexCount);
+	std::cout << "Statistics in " << milliseconds_since(start) << " ms" << std::endl;
+
+	return log.total ? -1 : 0;
+}
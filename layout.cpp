@@ -0,0 +1,153 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
+
+#include <scenex>
+
+#include "scenepass.h"
+#include "parallel.h"
+
+namespace
+{
+
+// Spreads the lower 10 bits of v to every third bit.
+inline std::uint32_t spread_bits(std::uint32_t v)
+{
+	v &= 0x3FFU;
+	v = (v | (v << 16U)) & 0x030000FFU;
+	v = (v | (v << 8U)) & 0x0300F00FU;
+	v = (v | (v << 4U)) & 0x030C30C3U;
+	v = (v | (v << 2U)) & 0x09249249U;
+	return v;
+}
+
+// 30-bit Morton code of the given point within the given bounds.
+std::uint32_t morton_code(float const* p, float const* min, float const* max)
+{
+	std::uint32_t code = 0;
+	for (int c = 0; c < 3; ++c)
+	{
+		float extent = max[c] - min[c];
+		float t = (extent > 0.0f) ? (p[c] - min[c]) / extent : 0.0f;
+		auto cell = std::uint32_t(math::clamp(t, 0.0f, 1.0f) * 1023.0f);
+		code |= spread_bits(cell) << unsigned(2 - c);
+	}
+	return code;
+}
+
+struct SortKey
+{
+	unsigned material;
+	std::uint32_t morton;
+	unsigned index;
+
+	bool operator <(SortKey const& r) const
+	{
+		if (material != r.material) return material < r.material;
+		if (morton != r.morton) return morton < r.morton;
+		return index < r.index;
+	}
+};
+
+} // namespace
+
+void sort_meshes(scene::Scene& scene)
+{
+	size_t meshCount = scene.meshes.size(), instanceCount = scene.instances.size();
+
+	// World-space placement of meshes: union of their instances, object bounds if not instanced
+	std::vector<float> meshMin(3 * meshCount, FLT_MAX), meshMax(3 * meshCount, -FLT_MAX);
+	float sceneMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, sceneMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (auto& instance : scene.instances)
+		for (int c = 0; c < 3; ++c)
+		{
+			meshMin[3 * instance.mesh + c] = std::min(meshMin[3 * instance.mesh + c], instance.bounds.min.c[c]);
+			meshMax[3 * instance.mesh + c] = std::max(meshMax[3 * instance.mesh + c], instance.bounds.max.c[c]);
+		}
+	for (size_t i = 0; i < meshCount; ++i)
+		for (int c = 0; c < 3; ++c)
+		{
+			if (meshMin[3 * i + c] > meshMax[3 * i + c])
+			{
+				meshMin[3 * i + c] = scene.meshes[i].bounds.min.c[c];
+				meshMax[3 * i + c] = scene.meshes[i].bounds.max.c[c];
+			}
+			sceneMin[c] = std::min(sceneMin[c], meshMin[3 * i + c]);
+			sceneMax[c] = std::max(sceneMax[c], meshMax[3 * i + c]);
+		}
+
+	// Meshes by material, then along the curve
+	std::vector<SortKey> meshKeys(meshCount);
+	for (size_t i = 0; i < meshCount; ++i)
+	{
+		float center[3];
+		for (int c = 0; c < 3; ++c)
+			center[c] = 0.5f * (meshMin[3 * i + c] + meshMax[3 * i + c]);
+		SortKey key = { scene.meshes[i].material, morton_code(center, sceneMin, sceneMax), unsigned(i) };
+		meshKeys[i] = key;
+	}
+	std::sort(meshKeys.begin(), meshKeys.end());
+
+	std::vector<unsigned> meshRemap(meshCount);
+	for (size_t i = 0; i < meshCount; ++i)
+		meshRemap[meshKeys[i].index] = unsigned(i);
+
+	// Index ranges in new mesh order, vertices in order of first use
+	std::vector<scene::Mesh> meshes(meshCount);
+	std::vector<unsigned> indices;
+	indices.reserve(scene.indices.size());
+
+	size_t vertexCount = scene.positions.size();
+	std::vector<unsigned> vertexRemap(vertexCount, ~0U);
+	unsigned nextVertex = 0;
+
+	for (size_t i = 0; i < meshCount; ++i)
+	{
+		auto mesh = scene.meshes[meshKeys[i].index];
+		auto first = unsigned(indices.size());
+		for (auto j = mesh.primitives.first; j < mesh.primitives.last; ++j)
+		{
+			auto& v = vertexRemap[scene.indices[j]];
+			if (v == ~0U) v = nextVertex++;
+			indices.push_back(v);
+		}
+		mesh.primitives.first = first;
+		mesh.primitives.last = unsigned(indices.size());
+		meshes[i] = mesh;
+	}
+
+	// Keep unreferenced vertices behind
+	for (auto& v : vertexRemap)
+		if (v == ~0U) v = nextVertex++;
+
+	scene.meshes.swap(meshes);
+	scene.indices.swap(indices);
+
+	remap_vertices(scene, 0, vertexRemap);
+
+	// Instances by material, then along the curve
+	std::vector<SortKey> instanceKeys(instanceCount);
+	parallel_for(instanceCount, [&](size_t i)
+	{
+		auto& instance = scene.instances[i];
+		instance.mesh = meshRemap[instance.mesh];
+
+		float center[3];
+		for (int c = 0; c < 3; ++c)
+			center[c] = 0.5f * (instance.bounds.min.c[c] + instance.bounds.max.c[c]);
+		SortKey key = { scene.meshes[instance.mesh].material, morton_code(center, sceneMin, sceneMax), unsigned(i) };
+		instanceKeys[i] = key;
+	});
+	std::sort(instanceKeys.begin(), instanceKeys.end());
+
+	std::vector<scene::Instance> instances(instanceCount);
+	for (size_t i = 0; i < instanceCount; ++i)
+		instances[i] = scene.instances[instanceKeys[i].index];
+	scene.instances.swap(instances);
+}
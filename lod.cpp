@@ -0,0 +1,387 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+#include <scenex>
+
+#include "scenefile.h"
+#include "scenepass.h"
+#include "parallel.h"
+#include "hash.h"
+
+namespace
+{
+
+// Plane distance quadric, normalized by the accumulated weight so that evaluating yields squared distances
+struct Quadric
+{
+	double a00, a11, a22, a01, a02, a12;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	void add_plane(double const* n, double d, double w)
+	{
+		a00 += w * n[0] * n[0]; a11 += w * n[1] * n[1]; a22 += w * n[2] * n[2];
+		a01 += w * n[0] * n[1]; a02 += w * n[0] * n[2]; a12 += w * n[1] * n[2];
+		b0 += w * n[0] * d; b1 += w * n[1] * d; b2 += w * n[2] * d;
+		c += w * d * d;
+		weight += w;
+	}
+
+	void add(Quadric const& q)
+	{
+		a00 += q.a00; a11 += q.a11; a22 += q.a22;
+		a01 += q.a01; a02 += q.a02; a12 += q.a12;
+		b0 += q.b0; b1 += q.b1; b2 += q.b2;
+		c += q.c;
+		weight += q.weight;
+	}
+
+	double error(float const* p) const
+	{
+		double x = p[0], y = p[1], z = p[2];
+		double e = a00 * x * x + a11 * y * y + a22 * z * z
+			+ 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return (weight > 0.0) ? std::max(e, 0.0) / weight : 0.0;
+	}
+};
+
+struct Collapse
+{
+	unsigned from, to;
+	double error;
+};
+
+inline void triangle_normal(double* n, float const* p0, float const* p1, float const* p2)
+{
+	double e1[3], e2[3];
+	for (int c = 0; c < 3; ++c)
+	{
+		e1[c] = double(p1[c]) - p0[c];
+		e2[c] = double(p2[c]) - p0[c];
+	}
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+// Vertices sharing a position form a circular wedge list, of one vertex unless on an attribute seam.
+// Vertices on open borders of the position-welded mesh (mesh & material boundaries) are locked.
+struct VertexClasses
+{
+	std::vector<unsigned> wedges; // next vertex at the same position
+	std::vector<bool> locked;
+};
+
+// Simplifies a triangle list by half-edge collapses of least quadric error, collapsing vertices onto
+// existing vertices so that all attributes stay valid. Seam vertices collapse together with all their
+// wedges, each onto an adjacent wedge of the target position, so seams move along seam edges only.
+// Indices are local to the given vertex array.
+std::vector<unsigned> simplify(std::vector<unsigned> indices, math::vec3 const* positions, size_t vertexCount
+	, VertexClasses const& classes, size_t targetIndexCount, float& resultError)
+{
+	auto& wedges = classes.wedges;
+	auto& locked = classes.locked;
+	auto&& samePosition = [&](unsigned a, unsigned b) { return a == b || memcmp(positions[a].c, positions[b].c, sizeof(positions[a].c)) == 0; };
+
+	double maxError = 0.0;
+
+	std::vector<Quadric> quadrics(vertexCount, Quadric());
+	for (size_t i = 0; i < indices.size(); i += 3)
+	{
+		auto p0 = positions[indices[i]].c, p1 = positions[indices[i + 1]].c, p2 = positions[indices[i + 2]].c;
+		double n[3];
+		triangle_normal(n, p0, p1, p2);
+		double area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (area <= 0.0) continue;
+		for (auto& c : n) c /= area;
+		double d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+
+		for (int j = 0; j < 3; ++j)
+			quadrics[indices[i + j]].add_plane(n, d, area);
+	}
+
+	std::vector<unsigned> remap(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+		remap[i] = unsigned(i);
+
+	std::vector<unsigned> triangleOffsets(vertexCount + 1), vertexTriangles;
+	std::vector<Collapse> collapses, bestCollapses(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<unsigned> wedgeTargets;
+
+	while (indices.size() > targetIndexCount)
+	{
+		size_t triangleCount = indices.size() / 3;
+
+		// Vertex -> triangle adjacency
+		std::fill(triangleOffsets.begin(), triangleOffsets.end(), 0);
+		for (auto v : indices)
+			++triangleOffsets[v + 1];
+		for (size_t i = 0; i < vertexCount; ++i)
+			triangleOffsets[i + 1] += triangleOffsets[i];
+		vertexTriangles.resize(indices.size());
+		{
+			auto fill = triangleOffsets;
+			for (size_t i = 0; i < indices.size(); ++i)
+				vertexTriangles[fill[indices[i]]++] = unsigned(i / 3);
+		}
+
+		// Cheapest collapse along triangle edges per vertex
+		std::fill(bestCollapses.begin(), bestCollapses.end(), Collapse { ~0U, ~0U, DBL_MAX });
+		for (size_t i = 0; i < indices.size(); i += 3)
+			for (int j = 0; j < 3; ++j)
+			{
+				unsigned a = indices[i + j], b = indices[i + (j + 1) % 3];
+				for (int k = 0; k < 2; ++k, std::swap(a, b))
+				{
+					if (locked[a]) continue;
+					double error = 0.0;
+					for (unsigned w = a; ; )
+					{
+						error = std::max(error, quadrics[w].error(positions[b].c));
+						if ((w = wedges[w]) == a) break;
+					}
+					if (error < bestCollapses[a].error)
+					{
+						Collapse collapse = { a, b, error };
+						bestCollapses[a] = collapse;
+					}
+				}
+			}
+
+		collapses.clear();
+		for (auto& collapse : bestCollapses)
+			if (collapse.from != ~0U)
+				collapses.push_back(collapse);
+		if (collapses.empty()) break;
+
+		std::sort(collapses.begin(), collapses.end(), [](Collapse const& a, Collapse const& b) { return a.error < b.error; });
+
+		// Each collapse removes about two triangles, independent collapses are applied in one pass
+		size_t collapseBudget = std::max(size_t(1), (indices.size() - targetIndexCount) / 6);
+		size_t collapseCount = 0;
+		std::fill(touched.begin(), touched.end(), false);
+
+		for (auto& collapse : collapses)
+		{
+			if (collapseCount >= collapseBudget) break;
+
+			// Each wedge collapses onto an adjacent vertex at the target position, or none collapses
+			if (samePosition(collapse.from, collapse.to)) continue;
+			wedgeTargets.clear();
+			bool valid = true;
+			for (unsigned w = collapse.from; valid; )
+			{
+				valid = !touched[w];
+				unsigned target = ~0U;
+				for (auto t = triangleOffsets[w]; t < triangleOffsets[w + 1] && valid && target != collapse.to; ++t)
+					for (int j = 0; j < 3; ++j)
+					{
+						unsigned v = indices[3 * vertexTriangles[t] + j];
+						if (target != collapse.to && samePosition(v, collapse.to))
+							target = v;
+					}
+				valid = valid && target != ~0U && !touched[target];
+				wedgeTargets.push_back(target);
+				if ((w = wedges[w]) == collapse.from) break;
+			}
+			if (!valid) continue;
+
+			// Reject collapses flipping adjacent triangles
+			bool flips = false;
+			for (unsigned w = collapse.from; !flips; )
+			{
+				for (auto t = triangleOffsets[w]; t < triangleOffsets[w + 1] && !flips; ++t)
+				{
+					auto tri = &indices[3 * vertexTriangles[t]];
+					if (samePosition(tri[0], collapse.to) || samePosition(tri[1], collapse.to) || samePosition(tri[2], collapse.to)) continue;
+
+					double before[3], after[3];
+					float const* p[3] = { positions[tri[0]].c, positions[tri[1]].c, positions[tri[2]].c };
+					triangle_normal(before, p[0], p[1], p[2]);
+					for (int j = 0; j < 3; ++j)
+						if (tri[j] == w) p[j] = positions[collapse.to].c;
+					triangle_normal(after, p[0], p[1], p[2]);
+
+					flips = before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0;
+				}
+				if ((w = wedges[w]) == collapse.from) break;
+			}
+			if (flips) continue;
+
+			// Lock the neighborhoods for the rest of this pass
+			size_t wedgeIdx = 0;
+			for (unsigned w = collapse.from; ; )
+			{
+				for (auto t = triangleOffsets[w]; t < triangleOffsets[w + 1]; ++t)
+					for (int j = 0; j < 3; ++j)
+						touched[indices[3 * vertexTriangles[t] + j]] = true;
+
+				unsigned target = wedgeTargets[wedgeIdx++];
+				touched[target] = true;
+				remap[w] = target;
+				quadrics[target].add(quadrics[w]);
+				if ((w = wedges[w]) == collapse.from) break;
+			}
+			maxError = std::max(maxError, collapse.error);
+			++collapseCount;
+		}
+		if (collapseCount == 0) break;
+
+		// Apply collapses, drop degenerate triangles, also those joining wedges of one position
+		size_t writeIdx = 0;
+		for (size_t i = 0; i < triangleCount; ++i)
+		{
+			unsigned a = remap[indices[3 * i]], b = remap[indices[3 * i + 1]], c = remap[indices[3 * i + 2]];
+			if (samePosition(a, b) || samePosition(b, c) || samePosition(c, a)) continue;
+			indices[writeIdx++] = a;
+			indices[writeIdx++] = b;
+			indices[writeIdx++] = c;
+		}
+		indices.resize(writeIdx);
+	}
+
+	resultError = float(std::sqrt(maxError));
+	return indices;
+}
+
+VertexClasses classify_vertices(std::vector<unsigned> const& indices, math::vec3 const* positions, size_t vertexCount)
+{
+	VertexClasses classes;
+	auto& wedges = classes.wedges;
+	auto& locked = classes.locked;
+	wedges.resize(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+		wedges[i] = unsigned(i);
+	locked.assign(vertexCount, false);
+
+	struct PositionHash
+	{
+		math::vec3 const* positions;
+		size_t operator ()(unsigned v) const { return size_t(murmur_hash64(positions[v].c, sizeof(positions[v].c), 0)); }
+	};
+	struct PositionEqual
+	{
+		math::vec3 const* positions;
+		bool operator ()(unsigned a, unsigned b) const { return memcmp(positions[a].c, positions[b].c, sizeof(positions[a].c)) == 0; }
+	};
+	std::unordered_map<unsigned, unsigned, PositionHash, PositionEqual> firstVertex(vertexCount, PositionHash{ positions }, PositionEqual{ positions });
+	std::vector<unsigned> welded = wedges;
+	for (auto v : indices)
+	{
+		auto ins = firstVertex.insert(std::make_pair(v, v));
+		unsigned first = ins.first->second;
+		welded[v] = first;
+		if (ins.second || wedges[v] != v || first == v) continue;
+
+		// Link into the wedge list of the first vertex
+		wedges[v] = wedges[first];
+		wedges[first] = v;
+	}
+
+	// Directed edges of the welded mesh without opposite edge are on a border, seams are not
+	std::unordered_map<std::uint64_t, unsigned> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i < indices.size(); i += 3)
+		for (int j = 0; j < 3; ++j)
+		{
+			unsigned a = welded[indices[i + j]], b = welded[indices[i + (j + 1) % 3]];
+			++edges[(std::uint64_t(a) << 32U) | b];
+		}
+	for (auto& edge : edges)
+	{
+		unsigned a = unsigned(edge.first >> 32U), b = unsigned(edge.first);
+		if (edges.find((std::uint64_t(b) << 32U) | a) == edges.end())
+			locked[a] = locked[b] = true;
+	}
+
+	// Lock whole wedge lists
+	for (size_t i = 0; i < vertexCount; ++i)
+		if (locked[welded[i]])
+			locked[i] = true;
+
+	return classes;
+}
+
+} // namespace
+
+void build_lods(scenefile::Extensions& extensions, scene::Scene& scene, unsigned levelCount, float ratio)
+{
+	size_t meshCount = scene.meshes.size();
+	auto ranges = mesh_vertex_ranges(scene);
+
+	// Per-mesh local triangle lists & vertex classes, shared by all levels
+	std::vector< std::vector<unsigned> > meshIndices(meshCount);
+	std::vector<VertexClasses> meshClasses(meshCount);
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		auto& mesh = scene.meshes[meshIdx];
+		auto& indices = meshIndices[meshIdx];
+		indices.assign(scene.indices.begin() + mesh.primitives.first, scene.indices.begin() + mesh.primitives.last);
+		for (auto& v : indices)
+			v -= ranges[meshIdx].first;
+
+		meshClasses[meshIdx] = classify_vertices(indices, scene.positions.data() + ranges[meshIdx].first, ranges[meshIdx].last - ranges[meshIdx].first);
+	});
+
+	// All levels of all meshes in parallel
+	std::vector< std::vector<unsigned> > levelIndices(meshCount * levelCount);
+	std::vector<float> levelErrors(meshCount * levelCount);
+	parallel_for(meshCount * levelCount, [&](size_t taskIdx)
+	{
+		size_t meshIdx = taskIdx / levelCount, level = taskIdx % levelCount + 1;
+		auto& range = ranges[meshIdx];
+
+		size_t targetIndexCount = size_t(double(meshIndices[meshIdx].size() / 3) * std::pow(double(ratio), double(level))) * 3;
+		auto& indices = levelIndices[taskIdx];
+		indices = simplify(meshIndices[meshIdx], scene.positions.data() + range.first, range.last - range.first
+			, meshClasses[meshIdx], targetIndexCount, levelErrors[taskIdx]);
+
+		for (auto& v : indices)
+			v += range.first;
+	});
+
+	// Append levels to the index stream, each mesh's levels end where simplification stops reducing
+	std::vector<scenefile::LodRange> lodRanges(meshCount);
+	std::vector<scenefile::LodLevel> levels;
+	levels.reserve(meshCount * levelCount);
+	for (size_t meshIdx = 0; meshIdx < meshCount; ++meshIdx)
+	{
+		lodRanges[meshIdx].firstLevel = unsigned(levels.size());
+
+		size_t prevIndexCount = meshIndices[meshIdx].size();
+		for (size_t level = 0; level < levelCount; ++level)
+		{
+			auto taskIdx = meshIdx * levelCount + level;
+			auto& indices = levelIndices[taskIdx];
+			if (indices.size() >= prevIndexCount)
+				break;
+			prevIndexCount = indices.size();
+
+			scenefile::LodLevel outLevel;
+			outLevel.first = unsigned(scene.indices.size());
+			outLevel.last = unsigned(scene.indices.size() + indices.size());
+			outLevel.error = levelErrors[taskIdx];
+			levels.push_back(outLevel);
+
+			scene.indices.insert(scene.indices.end(), indices.begin(), indices.end());
+			std::vector<unsigned>().swap(indices);
+		}
+
+		lodRanges[meshIdx].levelCount = unsigned(levels.size() - lodRanges[meshIdx].firstLevel);
+	}
+
+	extensions.add("LDMS", std::move(lodRanges));
+	extensions.add("LDLV", std::move(levels));
+}
@@ -11,13 +11,20 @@
 
 bool const stdx::is_debugger_present = IsDebuggerPresent() != FALSE;
 
-static bool touch_dont_overwrite = false;
+// Per thread, batch-run & serve run replayed & new commands side by side
+static thread_local bool touch_dont_overwrite = false;
 
 int scene_tool(char const* tool, char const* const* args, char const* const* args_end);
+int batch_run_tool(char const* tool, char const* const* args, char const* const* args_end);
+int inspect_tool(char const* tool, char const* const* args, char const* const* args_end);
+int serve_tool(char const* tool, char const* const* args, char const* const* args_end);
 int help_tool(char const* tool, char const* const* args, char const* const* args_end);
 
 char const* tools[] = {
 	  "scene"
+	, "batch-run"
+	, "inspect"
+	, "serve"
 	, "help"
 };
 
@@ -40,6 +47,12 @@ int main(int argc, const char* argv[])
 	{
 		if (stdx::strieq(tool, "scene"))
 			return scene_tool(tool, args, arg_end);
+		else if (stdx::strieq(tool, "batch-run"))
+			return batch_run_tool(tool, args, arg_end);
+		else if (stdx::strieq(tool, "inspect"))
+			return inspect_tool(tool, args, arg_end);
+		else if (stdx::strieq(tool, "serve"))
+			return serve_tool(tool, args, arg_end);
 		else
 			return help_tool(tool, args, arg_end);
 	}
@@ -52,6 +65,11 @@ int main(int argc, const char* argv[])
 	return 0;
 }
 
+void set_command_replay(bool replay)
+{
+	touch_dont_overwrite = replay;
+}
+
 // Stores the given command in a batch file to be played back later.
 void record_command(const char *tool, const char *file, const char *const *args, size_t argCount)
 {
@@ -0,0 +1,82 @@
+#include "pch.h"
+
+#include "mapfile.h"
+
+#include "stdx"
+
+#include <string>
+
+#ifndef WIN32
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(char const* path)
+{
+#ifdef WIN32
+	auto file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		throwx( std::runtime_error("Cannot open file for mapping: " + std::string(path)) );
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		throwx( std::runtime_error("Cannot query file size: " + std::string(path)) );
+	}
+	length = size_t(fileSize.QuadPart);
+
+	if (length > 0)
+	{
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mapping)
+			bytes = static_cast<char const*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	}
+	CloseHandle(file);
+
+	if (length > 0 && !bytes)
+	{
+		if (mapping) CloseHandle(mapping);
+		throwx( std::runtime_error("Cannot map file: " + std::string(path)) );
+	}
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0)
+		throwx( std::runtime_error("Cannot open file for mapping: " + std::string(path)) );
+
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0)
+	{
+		close(file);
+		throwx( std::runtime_error("Cannot query file size: " + std::string(path)) );
+	}
+	length = size_t(fileStat.st_size);
+
+	if (length > 0)
+	{
+		void* view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+		if (view != MAP_FAILED)
+		{
+			bytes = static_cast<char const*>(view);
+			madvise(view, length, MADV_SEQUENTIAL);
+		}
+	}
+	close(file);
+
+	if (length > 0 && !bytes)
+		throwx( std::runtime_error("Cannot map file: " + std::string(path)) );
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	if (!bytes) return;
+#ifdef WIN32
+	UnmapViewOfFile(bytes);
+	CloseHandle(mapping);
+#else
+	munmap(const_cast<char*>(bytes), length);
+#endif
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+// Read-only memory mapping of a whole file. Empty files map to an empty range.
+class MappedFile
+{
+public:
+	explicit MappedFile(char const* path);
+	~MappedFile();
+
+	MappedFile(MappedFile const&) = delete;
+	MappedFile& operator =(MappedFile const&) = delete;
+
+	char const* data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	char const* bytes = nullptr;
+	size_t length = 0;
+#ifdef WIN32
+	void* mapping = nullptr;
+#endif
+};
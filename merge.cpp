@@ -0,0 +1,483 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include <type_traits>
+#include <cfloat>
+
+#include "mathx"
+
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+#include <assimp/material.h>
+#include <assimp/color4.h>
+#include <assimp/vector3.h>
+
+#include <scenex>
+
+#include "merge.h"
+#include "parallel.h"
+#include "simd.h"
+#include "scenepass.h"
+#include "stats.h"
+
+namespace
+{
+
+template <class D, class S>
+void fastcpyn(D* dest, S const* src, size_t N)
+{
+	static_assert(sizeof(*dest) == sizeof(*src), "Incompatible types");
+	memcpy(dest, src, sizeof(*dest) * N);
+}
+
+template <class D, class S, class C>
+void castcpyn(D* dest, S const* src, size_t N, C&& cast)
+{
+	for (auto destEnd = dest + N; dest < destEnd; ++dest, ++src)
+		*dest = cast(*src);
+}
+
+template <class D, class S, class C>
+void cnvtcpyn(D* dest, S const* src, size_t N, C&& convert)
+{
+	for (auto destEnd = dest + N; dest < destEnd; ++dest, ++src)
+		convert(*dest, *src);
+}
+
+struct binary_converter
+{
+	template <class Dest, class Src>
+	void operator ()(Dest& dest, Src const& src) const
+	{
+		static_assert(sizeof(dest) <= sizeof(src), "Too few bytes");
+		dest = reinterpret_cast<Dest const&>(src);
+	}
+};
+
+struct binary_duplicator
+{
+	template <class Dest, class Src>
+	void operator ()(Dest& dest, Src const& src) const
+	{
+		static_assert(sizeof(dest) % sizeof(src) == 0, "Dest has to be a multiple of source");
+		typedef Src dest_array[sizeof(dest) / sizeof(src)];
+		for (auto& v : reinterpret_cast<dest_array&>(dest))
+			v = src;
+	}
+};
+
+inline unsigned color_cast(aiColor4t<float> const& c)
+{
+	return simd::pack_color(c.r, c.g, c.b, c.a);
+}
+
+// Vectorized color packing
+inline void castcpyn(unsigned* dest, aiColor4t<float> const* src, size_t N, unsigned (&cast)(aiColor4t<float> const&))
+{
+	if (&cast == &color_cast)
+		simd::pack_colors(dest, &src->r, N);
+	else
+		castcpyn<unsigned, aiColor4t<float>>(dest, src, N, cast);
+}
+
+// Vectorized 3D to 2D narrowing
+template <class D>
+typename std::enable_if<sizeof(D) == 2 * sizeof(float)>::type cnvtcpyn(D* dest, aiVector3t<float> const* src, size_t N, binary_converter)
+{
+	simd::narrow_xy(reinterpret_cast<float*>(dest), &src->x, N);
+}
+
+// Gathers triangle indices and rebases them onto the given base vertex
+void copy_triangles(unsigned* dest, aiFace const* faces, size_t faceCount, unsigned baseVertex)
+{
+	size_t const blockSize = 256; // keep blocks in L1 for rebasing
+	for (size_t blockBegin = 0; blockBegin < faceCount; blockBegin += blockSize)
+	{
+		auto blockDest = dest;
+
+		for (size_t i = blockBegin, ie = std::min(blockBegin + blockSize, faceCount); i < ie; ++i)
+			for (int j = 0; j < 3; ++j)
+				*dest++ = faces[i].mIndices[j];
+
+		simd::rebase_indices(blockDest, dest - blockDest, baseVertex);
+	}
+}
+
+template <class Type, class Fun, class A, class B, class C>
+void get_material_property(aiMaterial const& mat, A&& a, B&& b, C&& c, Fun&& fun)
+{
+	Type t;
+	if (AI_SUCCESS == mat.Get(a, b, c, t))
+		fun(t);
+}
+
+template <class Type, class Dest, class Converter, class A, class B, class C>
+void get_material_property(aiMaterial const& mat, A&& a, B&& b, C&& c, Dest& dest, Converter&& convert)
+{
+	Type t;
+	if (AI_SUCCESS == mat.Get(a, b, c, t))
+		convert(dest, t);
+}
+
+namespace {
+	struct PrintReflected {
+		template <class T>
+		void operator ()(T const& v, char const* t) const {
+			std::cout << t << ": " << v << '\n';
+		}
+	};
+
+	struct SerializeReflected {
+		std::string& bytes;
+
+		template <class T>
+		void operator ()(T const& v, char const*) const {
+			bytes.append(reinterpret_cast<char const*>(&v), sizeof(v));
+		}
+	};
+}
+
+// Unifies separators and removes redundant path segments.
+std::string normalize_texture_path(char const* path)
+{
+	std::string result;
+	for (; *path; ++path)
+	{
+		char c = (*path == '\\') ? '/' : *path;
+		// Duplicate separators, except for leading network paths
+		if (c == '/' && result.size() > 1 && result.back() == '/') continue;
+		result += c;
+
+		// Current directory segments
+		auto size = result.size();
+		if (c == '/' && size >= 2 && result[size - 2] == '.' && (size == 2 || result[size - 3] == '/'))
+			result.resize(size - 2);
+	}
+	return result;
+}
+
+} // namespace
+
+void count_meshes(SceneCounts& counts, aiScene const& inScene)
+{
+	for (unsigned i = 0, ie = inScene.mNumMeshes; i < ie; ++i)
+	{
+		auto& mesh = *inScene.mMeshes[i];
+		if (!mesh.HasPositions()) continue;
+
+		++counts.meshes;
+		counts.vertices += mesh.mNumVertices;
+		counts.indices += mesh.mNumFaces * 3;
+
+		counts.normals |= mesh.HasNormals();
+		counts.colors |= mesh.HasVertexColors(0);
+		counts.texcoords |= mesh.HasTextureCoords(0);
+		counts.tangents |= mesh.HasTangentsAndBitangents();
+	}
+
+	counts.materials += inScene.mNumMaterials;
+
+	std::function<void (aiNode const&)> addNodeMeshes = [&](aiNode const& node)
+	{
+		counts.instances += node.mNumMeshes;
+
+		if (node.mChildren)
+			for (unsigned i = 0, ie = node.mNumChildren; i < ie; ++i)
+				addNodeMeshes(*node.mChildren[i]);
+	};
+	addNodeMeshes(*inScene.mRootNode);
+}
+
+void allocate_scene(scene::Scene& outScene, SceneCounts const& counts)
+{
+	outScene.positions.resize(counts.vertices);
+	outScene.normals.resize(counts.normals ? counts.vertices : 0);
+	outScene.colors.resize(counts.colors ? counts.vertices : 0);
+	outScene.texcoords.resize(counts.texcoords ? counts.vertices : 0);
+	outScene.tangents.resize(counts.tangents ? counts.vertices : 0);
+	outScene.bitangents.resize(counts.tangents ? counts.vertices : 0);
+	outScene.indices.resize(counts.indices);
+
+	outScene.materials.resize(counts.materials);
+	outScene.meshes.resize(counts.meshes);
+	outScene.instances.resize(counts.instances);
+}
+
+void concatenate_chunks(scene::Scene& outScene, std::vector<scene::Scene>& chunks)
+{
+	std::vector<size_t> chunkVertexCounts;
+	size_t vertexCount = 0;
+	for (auto& chunk : chunks)
+	{
+		chunkVertexCounts.push_back(chunk.positions.size());
+		vertexCount += chunk.positions.size();
+	}
+
+	auto&& concatenate = [&](auto section, bool vertexAttribute)
+	{
+		auto& outSection = outScene.*section;
+
+		// Nothing to copy
+		if (chunks.size() == 1)
+		{
+			outSection.swap(chunks[0].*section);
+			return;
+		}
+
+		size_t count = 0;
+		for (auto& chunk : chunks)
+			count += (chunk.*section).size();
+		if (vertexAttribute && count > 0)
+			count = vertexCount;
+		outSection.resize(count);
+
+		size_t offset = 0;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			auto& chunkSection = chunks[i].*section;
+			std::copy(chunkSection.begin(), chunkSection.end(), outSection.begin() + offset);
+			offset += vertexAttribute ? chunkVertexCounts[i] : chunkSection.size();
+			typename std::decay<decltype(chunkSection)>::type().swap(chunkSection);
+		}
+	};
+
+	concatenate(&scene::Scene::positions, false);
+	concatenate(&scene::Scene::normals, true);
+	concatenate(&scene::Scene::colors, true);
+	concatenate(&scene::Scene::texcoords, true);
+	concatenate(&scene::Scene::tangents, true);
+	concatenate(&scene::Scene::bitangents, true);
+	concatenate(&scene::Scene::indices, false);
+	concatenate(&scene::Scene::meshes, false);
+	concatenate(&scene::Scene::instances, false);
+}
+
+void write_meshes(scene::Scene& outScene, aiScene const& inScene, SceneCounts& cursor, MergeTables& tables
+	, ConversionStats& stats, std::string const& stagePrefix, int verbosity, SceneCounts const& streamBase)
+{
+	size_t baseVertexCount = cursor.vertices;
+	size_t baseIndexCount = cursor.indices;
+	size_t baseMeshCount = cursor.meshes;
+	size_t baseInstanceCount = cursor.instances;
+
+	// Texture table
+	auto&& lookupTexture = [&](char const* path) -> unsigned
+	{
+		auto ins = tables.textureIdcs.insert( std::make_pair(normalize_texture_path(path), unsigned(outScene.texturePaths.size())) );
+		if (ins.second) outScene.texturePaths.insert(outScene.texturePaths.end(), path, path + strlen(path) + 1); // first spelling, include null-termination
+		return ins.first->second;
+	};
+	auto&& textureConvert = [&](unsigned& dest, aiString const& path) { dest = lookupTexture(path.C_Str()); };
+
+	// null dummy (textureIdx == 0)
+	if (outScene.texturePaths.empty())
+		lookupTexture("no:tex");
+
+	// Materials, deduplicated scene-wide if merging materials
+	std::vector<unsigned> materialIdcs(inScene.mNumMaterials);
+	{
+		ConversionStats::Stage stage(stats, stagePrefix + "materials");
+
+		for (unsigned i = 0, ie = inScene.mNumMaterials; i < ie; ++i)
+		{
+			auto& mat = *inScene.mMaterials[i];
+			scene::Material outMat;
+
+			outMat.reset_default();
+			
+			// Properties
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_AMBIENT, outMat.diffuse, binary_converter());
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_DIFFUSE, outMat.diffuse, binary_converter());
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_EMISSIVE, outMat.emissive, binary_converter());
+			
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_SPECULAR, outMat.specular, binary_converter());
+			outMat.reflectivity = outMat.specular;
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_REFLECTIVE, outMat.reflectivity, binary_converter());
+			get_material_property<float>(mat, AI_MATKEY_SHININESS_STRENGTH, [&](float pow) { for (auto& c : outMat.specular.c) c *= pow; });
+			get_material_property<float>(mat, AI_MATKEY_SHININESS, outMat.shininess, binary_duplicator());
+			
+			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_TRANSPARENT, outMat.filter, binary_converter());
+			get_material_property<float>(mat, AI_MATKEY_OPACITY, [&](float opac) { 
+				bool color_opaque = [&]() { for (auto& c : outMat.filter.c) if (c != 0.0f) return false; return true; }();
+				for (auto& c : outMat.filter.c) if (color_opaque) c = 1.0f - opac; else c *= 1.0f - opac;
+			});
+			get_material_property<float>(mat, AI_MATKEY_REFRACTI, outMat.refract, binary_duplicator());
+
+			// Textures
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_AMBIENT(0), outMat.tex.diffuse, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_DIFFUSE(0), outMat.tex.diffuse, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_EMISSIVE(0), outMat.tex.emissive, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_SPECULAR(0), outMat.tex.specular, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_SHININESS(0), outMat.tex.shininess, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_REFLECTION(0), outMat.tex.reflectivity, textureConvert);
+
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_OPACITY(0), outMat.tex.filter, textureConvert);
+
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_NORMALS(0), outMat.tex.normal, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_DISPLACEMENT(0), outMat.tex.bump, textureConvert);
+			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_HEIGHT(0), outMat.tex.bump, textureConvert);
+			get_material_property<float>(mat, AI_MATKEY_BUMPSCALING, outMat.tex.bumpScale, binary_duplicator());
+
+			if (verbosity >= 2)
+			{
+				std::cout << "Material: " << '\n';
+				outMat.reflect(outMat, PrintReflected());
+			}
+
+			if (tables.mergeMaterials)
+			{
+				std::string key;
+				outMat.reflect(outMat, SerializeReflected{key});
+				auto ins = tables.materialIdcs.insert( std::make_pair(std::move(key), unsigned(cursor.materials)) );
+				if (!ins.second)
+				{
+					materialIdcs[i] = ins.first->second;
+					continue;
+				}
+			}
+			materialIdcs[i] = unsigned(cursor.materials);
+			outScene.materials[cursor.materials++] = outMat;
+		}
+	}
+
+	// Geometry & meshes
+	{
+		ConversionStats::Stage stage(stats, stagePrefix + "geometry");
+
+		// Copy work, split into chunks of bounded size so that large meshes parallelize as well
+		struct CopyChunk
+		{
+			aiMesh const* mesh;
+			unsigned vertexOffset, vertexBegin, vertexEnd;
+			unsigned indexOffset, faceBegin, faceEnd;
+			unsigned outMesh;
+			float boundsMin[3], boundsMax[3];
+		};
+		std::vector<CopyChunk> copyChunks;
+		unsigned const chunkSize = 1U << 16U;
+
+		// Prefix-sum mesh offsets
+		unsigned vertexCount = unsigned(baseVertexCount);
+		unsigned indexCount = unsigned(baseIndexCount);
+		unsigned meshCount = unsigned(baseMeshCount);
+
+		for (unsigned i = 0, ie = inScene.mNumMeshes; i < ie; ++i)
+		{
+			auto& mesh = *inScene.mMeshes[i];
+			if (!mesh.HasPositions()) continue;
+
+			auto indexEnd = indexCount + mesh.mNumFaces * 3;
+
+			for (unsigned chunkBegin = 0; chunkBegin < mesh.mNumVertices || chunkBegin < mesh.mNumFaces; chunkBegin += chunkSize)
+			{
+				CopyChunk chunk = { &mesh
+					, vertexCount, std::min(chunkBegin, mesh.mNumVertices), std::min(chunkBegin + chunkSize, mesh.mNumVertices)
+					, indexCount, std::min(chunkBegin, mesh.mNumFaces), std::min(chunkBegin + chunkSize, mesh.mNumFaces)
+					, meshCount, { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+				copyChunks.push_back(chunk);
+			}
+
+			auto& outMesh = outScene.meshes[meshCount - streamBase.meshes];
+
+			outMesh.primitives.first = indexCount;
+			outMesh.primitives.last = indexEnd;
+			outMesh.material = materialIdcs[mesh.mMaterialIndex];
+
+			// Meshes without vertices get no bounds from copy chunks, collapse them onto the origin
+			if (mesh.mNumVertices == 0)
+				for (int c = 0; c < 3; ++c)
+					outMesh.bounds.min.c[c] = outMesh.bounds.max.c[c] = 0.0f;
+
+			++meshCount;
+			vertexCount += mesh.mNumVertices;
+			indexCount = indexEnd;
+		}
+
+		// Copy & convert, chunks write disjoint ranges
+		parallel_for(copyChunks.size(), [&](size_t chunkIdx)
+		{
+			auto& chunk = copyChunks[chunkIdx];
+			auto& mesh = *chunk.mesh;
+
+			auto vertexBase = chunk.vertexOffset + chunk.vertexBegin - streamBase.vertices;
+			auto vertexChunkCount = chunk.vertexEnd - chunk.vertexBegin;
+
+			fastcpyn(outScene.positions.data() + vertexBase, mesh.mVertices + chunk.vertexBegin, vertexChunkCount);
+			simd::minmax_xyz(chunk.boundsMin, chunk.boundsMax, &mesh.mVertices[chunk.vertexBegin].x, vertexChunkCount);
+			
+			if (mesh.HasNormals()) fastcpyn(outScene.normals.data() + vertexBase, mesh.mNormals + chunk.vertexBegin, vertexChunkCount);
+			if (mesh.HasTangentsAndBitangents()) {
+				fastcpyn(outScene.tangents.data() + vertexBase, mesh.mTangents + chunk.vertexBegin, vertexChunkCount);
+				fastcpyn(outScene.bitangents.data() + vertexBase, mesh.mBitangents + chunk.vertexBegin, vertexChunkCount);
+			}
+			
+			if (mesh.HasTextureCoords(0))
+				cnvtcpyn(outScene.texcoords.data() + vertexBase, mesh.mTextureCoords[0] + chunk.vertexBegin, vertexChunkCount, binary_converter());
+
+			if (mesh.HasVertexColors(0))
+				castcpyn(outScene.colors.data() + vertexBase, mesh.mColors[0] + chunk.vertexBegin, vertexChunkCount, color_cast);
+
+			copy_triangles(outScene.indices.data() + (chunk.indexOffset - streamBase.indices) + chunk.faceBegin * 3
+				, mesh.mFaces + chunk.faceBegin, chunk.faceEnd - chunk.faceBegin, chunk.vertexOffset);
+		});
+
+		// Reduce chunk bounds to mesh bounds
+		for (auto& chunk : copyChunks)
+		{
+			if (chunk.vertexBegin == chunk.vertexEnd) continue;
+
+			auto& bounds = outScene.meshes[chunk.outMesh - streamBase.meshes].bounds;
+			bool first = (chunk.faceBegin == 0 && chunk.vertexBegin == 0);
+
+			for (int c = 0; c < 3; ++c)
+			{
+				bounds.min.c[c] = (first || chunk.boundsMin[c] < bounds.min.c[c]) ? chunk.boundsMin[c] : bounds.min.c[c];
+				bounds.max.c[c] = (first || chunk.boundsMax[c] > bounds.max.c[c]) ? chunk.boundsMax[c] : bounds.max.c[c];
+			}
+		}
+
+		cursor.vertices = vertexCount;
+		cursor.indices = indexCount;
+		cursor.meshes = meshCount;
+	}
+	
+	// Instances
+	{
+		ConversionStats::Stage stage(stats, stagePrefix + "instances");
+
+		size_t instanceCount = baseInstanceCount;
+
+		std::function<void (aiNode const&, aiMatrix4x4 const&)> addNodeMeshes = [&](aiNode const& node, aiMatrix4x4 const& transform)
+		{
+			math::mat4x3 instanceTransform;
+			for (int r = 0; r < 4; ++r)
+				for (int c = 0; c < 3; ++c)
+					instanceTransform.cls[r].c[c] = transform[c][r];
+
+			for (unsigned j = 0, je = node.mNumMeshes; j < je; ++j)
+			{
+				auto& instance = outScene.instances[instanceCount++ - streamBase.instances];
+
+				instance.mesh = unsigned(baseMeshCount) + node.mMeshes[j];
+				instance.transform = instanceTransform;
+				instance.bounds = transform_bounds(outScene.meshes[instance.mesh - streamBase.meshes].bounds, instanceTransform);
+			}
+
+			if (node.mChildren)
+				for (unsigned j = 0, je = node.mNumChildren; j < je; ++j)
+				{
+					auto& child = *node.mChildren[j];
+					addNodeMeshes(child, transform * child.mTransformation);
+				}
+		};
+		addNodeMeshes(*inScene.mRootNode, inScene.mRootNode->mTransformation);
+
+		cursor.instances = instanceCount;
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+// Conversion of imported Assimp scenes into one merged scene
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "hash.h"
+
+struct aiScene;
+namespace scene { struct Scene; }
+class ConversionStats;
+
+// Output stream sizes, accumulated over all inputs of a merge
+struct SceneCounts
+{
+	size_t vertices = 0;
+	size_t indices = 0;
+	size_t materials = 0;
+	size_t meshes = 0;
+	size_t instances = 0;
+
+	bool normals = false;
+	bool colors = false;
+	bool texcoords = false;
+	bool tangents = false;
+
+	SceneCounts& operator +=(SceneCounts const& other)
+	{
+		vertices += other.vertices;
+		indices += other.indices;
+		materials += other.materials;
+		meshes += other.meshes;
+		instances += other.instances;
+		normals |= other.normals;
+		colors |= other.colors;
+		texcoords |= other.texcoords;
+		tangents |= other.tangents;
+		return *this;
+	}
+};
+
+// Scene-wide material & texture tables, persistent across all inputs of a merge
+struct MergeTables
+{
+	struct KeyHash
+	{
+		size_t operator ()(std::string const& key) const { return size_t(murmur_hash64(key.data(), key.size(), 0)); }
+	};
+
+	std::unordered_map<std::string, unsigned, KeyHash> textureIdcs;  // normalized path -> offset in texturePaths
+	std::unordered_map<std::string, unsigned, KeyHash> materialIdcs; // reflected fields -> material index, if merging materials
+
+	bool mergeMaterials = false; // reuse identical materials scene-wide
+};
+
+// Counting pass: adds the output requirements of the given input scene.
+void count_meshes(SceneCounts& counts, aiScene const& inScene);
+
+// Sizes every output stream exactly once. Attribute streams cover all vertices if any
+// input mesh provides the attribute, vertices of meshes lacking it are zero-filled.
+void allocate_scene(scene::Scene& outScene, SceneCounts const& counts);
+
+// Fill pass: writes the given input scene into the streams preallocated by allocate_scene,
+// starting at the given cursor. Advances the cursor past the written elements. Textures already
+// in the tables are reused, as are identical materials if merging materials. The material stream
+// is trimmed after the merge.
+// If outScene only holds a window of the merged geometry streams, streamBase gives the merged
+// offsets of the window's first elements; written references stay merged offsets. Materials
+// & texture paths are never windowed.
+void write_meshes(scene::Scene& outScene, aiScene const& inScene, SceneCounts& cursor, MergeTables& tables
+	, ConversionStats& stats, std::string const& stagePrefix, int verbosity, SceneCounts const& streamBase = SceneCounts());
+
+// Moves the geometry streams of chunks written in merge order at consecutive stream bases into
+// outScene, sizing each stream once & releasing chunk streams as they are copied. Attribute
+// streams missing from some chunks are zero-filled. Materials & texture paths stay in outScene.
+void concatenate_chunks(scene::Scene& outScene, std::vector<scene::Scene>& chunks);
@@ -0,0 +1,221 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+
+#include <scenex>
+
+#include "scenefile.h"
+#include "scenepass.h"
+#include "parallel.h"
+
+namespace
+{
+
+using scenefile::Meshlet;
+
+struct MeshMeshlets
+{
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned> vertices;
+	std::vector<std::uint8_t> triangles;
+};
+
+// Bounding sphere & normal cone of the given meshlet.
+void compute_meshlet_bounds(Meshlet& meshlet, MeshMeshlets const& out, scene::Scene const& scene)
+{
+	auto vertices = out.vertices.data() + meshlet.firstVertex;
+	auto triangles = out.triangles.data() + 3 * meshlet.firstTriangle;
+
+	float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (unsigned i = 0; i < meshlet.vertexCount; ++i)
+	{
+		auto& p = scene.positions[vertices[i]];
+		for (int c = 0; c < 3; ++c)
+		{
+			min[c] = std::min(min[c], p.c[c]);
+			max[c] = std::max(max[c], p.c[c]);
+		}
+	}
+
+	float radiusSq = 0.0f;
+	for (int c = 0; c < 3; ++c)
+		meshlet.center[c] = 0.5f * (min[c] + max[c]);
+	for (unsigned i = 0; i < meshlet.vertexCount; ++i)
+	{
+		auto& p = scene.positions[vertices[i]];
+		float dx = p.c[0] - meshlet.center[0], dy = p.c[1] - meshlet.center[1], dz = p.c[2] - meshlet.center[2];
+		radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.radius = std::sqrt(radiusSq);
+
+	// Normal cone
+	std::vector<float> normals(3 * meshlet.triangleCount);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+	for (unsigned i = 0; i < meshlet.triangleCount; ++i)
+	{
+		auto& p0 = scene.positions[vertices[triangles[3 * i + 0]]];
+		auto& p1 = scene.positions[vertices[triangles[3 * i + 1]]];
+		auto& p2 = scene.positions[vertices[triangles[3 * i + 2]]];
+
+		float e1[3], e2[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			e1[c] = p1.c[c] - p0.c[c];
+			e2[c] = p2.c[c] - p0.c[c];
+		}
+		float* n = &normals[3 * i];
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+		float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float scale = (len > 0.0f) ? 1.0f / len : 0.0f;
+		for (int c = 0; c < 3; ++c)
+			axis[c] += n[c] *= scale;
+	}
+
+	float axisLen = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	float minDot = 1.0f;
+	if (axisLen > 0.0f)
+	{
+		for (int c = 0; c < 3; ++c)
+			axis[c] /= axisLen;
+		for (unsigned i = 0; i < meshlet.triangleCount; ++i)
+		{
+			float const* n = &normals[3 * i];
+			if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f) continue; // degenerate
+			minDot = std::min(minDot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+		}
+	}
+
+	if (axisLen > 0.0f && minDot > 0.1f)
+	{
+		for (int c = 0; c < 3; ++c)
+			meshlet.coneAxis[c] = axis[c];
+		meshlet.coneCutoff = std::sqrt(1.0f - minDot * minDot);
+	}
+	else
+	{
+		// Cone too wide, never cull
+		meshlet.coneAxis[0] = meshlet.coneAxis[1] = meshlet.coneAxis[2] = 0.0f;
+		meshlet.coneCutoff = 1.0f;
+	}
+}
+
+// Greedily fills meshlets in primitive order, which keeps the locality of vertex cache optimized meshes.
+void build_mesh_meshlets(MeshMeshlets& out, scene::Scene const& scene, scene::Mesh const& mesh, unsigned maxVertices, unsigned maxTriangles)
+{
+	auto indices = scene.indices.data() + mesh.primitives.first;
+	size_t triangleCount = (mesh.primitives.last - mesh.primitives.first) / 3;
+	if (triangleCount == 0) return;
+
+	unsigned vertexBegin = *std::min_element(indices, indices + 3 * triangleCount);
+	unsigned vertexEnd = *std::max_element(indices, indices + 3 * triangleCount) + 1;
+
+	// Local vertex index per mesh vertex, valid if stamped with the current meshlet
+	std::vector<unsigned> stamps(vertexEnd - vertexBegin, 0);
+	std::vector<std::uint8_t> localIdcs(vertexEnd - vertexBegin);
+
+	Meshlet meshlet = { };
+	auto&& flush = [&]()
+	{
+		if (meshlet.triangleCount == 0) return;
+		compute_meshlet_bounds(meshlet, out, scene);
+		out.meshlets.push_back(meshlet);
+
+		Meshlet next = { };
+		next.firstVertex = unsigned(out.vertices.size());
+		next.firstTriangle = unsigned(out.triangles.size() / 3);
+		meshlet = next;
+	};
+
+	for (size_t i = 0; i < triangleCount; ++i)
+	{
+		auto triangle = indices + 3 * i;
+		unsigned stamp = unsigned(out.meshlets.size()) + 1;
+
+		unsigned newVertices = 0;
+		for (int j = 0; j < 3; ++j)
+			newVertices += (stamps[triangle[j] - vertexBegin] != stamp && (j < 1 || triangle[j] != triangle[0]) && (j < 2 || triangle[j] != triangle[1]));
+
+		if (meshlet.vertexCount + newVertices > maxVertices || meshlet.triangleCount + 1 > maxTriangles)
+		{
+			flush();
+			stamp = unsigned(out.meshlets.size()) + 1;
+		}
+
+		for (int j = 0; j < 3; ++j)
+		{
+			auto v = triangle[j] - vertexBegin;
+			if (stamps[v] != stamp)
+			{
+				stamps[v] = stamp;
+				localIdcs[v] = std::uint8_t(meshlet.vertexCount++);
+				out.vertices.push_back(triangle[j]);
+			}
+			out.triangles.push_back(localIdcs[v]);
+		}
+		++meshlet.triangleCount;
+	}
+
+	flush();
+}
+
+} // namespace
+
+void build_meshlets(scenefile::Extensions& extensions, scene::Scene const& scene, unsigned maxVertices, unsigned maxTriangles)
+{
+	// Local indices are bytes
+	maxVertices = math::clamp(maxVertices, 3U, 256U);
+	maxTriangles = math::clamp(maxTriangles, 1U, 512U);
+
+	size_t meshCount = scene.meshes.size();
+	std::vector<MeshMeshlets> meshMeshlets(meshCount);
+
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		build_mesh_meshlets(meshMeshlets[meshIdx], scene, scene.meshes[meshIdx], maxVertices, maxTriangles);
+	});
+
+	// Concatenate with absolute offsets
+	std::vector<scenefile::MeshletRange> ranges(meshCount);
+	size_t meshletCount = 0, vertexCount = 0, triangleCount = 0;
+	for (size_t i = 0; i < meshCount; ++i)
+	{
+		ranges[i].firstMeshlet = unsigned(meshletCount);
+		ranges[i].meshletCount = unsigned(meshMeshlets[i].meshlets.size());
+		meshletCount += meshMeshlets[i].meshlets.size();
+	}
+
+	std::vector<Meshlet> meshlets;
+	std::vector<unsigned> vertices;
+	std::vector<std::uint8_t> triangles;
+	meshlets.reserve(meshletCount);
+
+	for (auto& mesh : meshMeshlets)
+	{
+		for (auto meshlet : mesh.meshlets)
+		{
+			meshlet.firstVertex += unsigned(vertexCount);
+			meshlet.firstTriangle += unsigned(triangleCount);
+			meshlets.push_back(meshlet);
+		}
+		vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+		triangles.insert(triangles.end(), mesh.triangles.begin(), mesh.triangles.end());
+		vertexCount += mesh.vertices.size();
+		triangleCount += mesh.triangles.size() / 3;
+
+		mesh = MeshMeshlets();
+	}
+
+	extensions.add("MLMS", std::move(ranges));
+	extensions.add("MLTS", std::move(meshlets));
+	extensions.add("MLVX", std::move(vertices));
+	extensions.add("MLTR", std::move(triangles));
+}
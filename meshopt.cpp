@@ -0,0 +1,346 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <cmath>
+#include <iostream>
+
+#include <scenex>
+
+#include "scenepass.h"
+#include "parallel.h"
+
+namespace
+{
+
+// Post-transform FIFO cache simulation
+struct CacheStats
+{
+	size_t misses = 0;
+	size_t triangles = 0;
+	size_t vertices = 0;
+
+	float acmr() const { return triangles ? float(misses) / float(triangles) : 0.0f; }
+	float atvr() const { return vertices ? float(misses) / float(vertices) : 0.0f; }
+};
+
+CacheStats simulate_cache(unsigned const* indices, size_t indexCount, unsigned vertexCount, unsigned cacheSize)
+{
+	CacheStats stats;
+	stats.triangles = indexCount / 3;
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	size_t time = cacheSize + 1;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		auto v = indices[i];
+		if (cacheTime[v] == 0) ++stats.vertices;
+		if (time - cacheTime[v] > cacheSize)
+		{
+			cacheTime[v] = time++;
+			++stats.misses;
+		}
+	}
+
+	return stats;
+}
+
+// Tipsify (Sander et al. 2007). Writes the reordered triangles to dest and returns the triangle
+// offsets at which the fanning had to jump to an unrelated vertex (hard cluster boundaries).
+std::vector<unsigned> tipsify(unsigned* dest, unsigned const* indices, size_t indexCount, unsigned vertexCount, unsigned cacheSize)
+{
+	size_t triangleCount = indexCount / 3;
+
+	// Vertex-triangle adjacency
+	std::vector<unsigned> adjOffsets(vertexCount + 1, 0);
+	for (size_t i = 0; i < indexCount; ++i)
+		++adjOffsets[indices[i] + 1];
+	for (unsigned v = 0; v < vertexCount; ++v)
+		adjOffsets[v + 1] += adjOffsets[v];
+	std::vector<unsigned> adjTriangles(indexCount);
+	{
+		std::vector<unsigned> fill(adjOffsets.begin(), adjOffsets.end() - 1);
+		for (size_t i = 0; i < indexCount; ++i)
+			adjTriangles[fill[indices[i]]++] = unsigned(i / 3);
+	}
+
+	std::vector<unsigned> live(vertexCount);
+	for (unsigned v = 0; v < vertexCount; ++v)
+		live[v] = adjOffsets[v + 1] - adjOffsets[v];
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned> deadEnds;
+	std::vector<unsigned> candidates;
+	std::vector<unsigned> boundaries;
+
+	size_t time = cacheSize + 1;
+	unsigned cursor = 0;
+	size_t emittedCount = 0;
+
+	auto&& skipDeadEnd = [&]() -> unsigned
+	{
+		while (!deadEnds.empty())
+		{
+			auto v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0) return v;
+		}
+		for (; cursor < vertexCount; ++cursor)
+			if (live[cursor] > 0) return cursor;
+		return ~0U;
+	};
+
+	unsigned fanning = skipDeadEnd();
+	while (fanning != ~0U)
+	{
+		candidates.clear();
+
+		for (auto a = adjOffsets[fanning], ae = adjOffsets[fanning + 1]; a < ae; ++a)
+		{
+			auto t = adjTriangles[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+
+			for (int j = 0; j < 3; ++j)
+			{
+				auto v = indices[3 * t + j];
+				dest[3 * emittedCount + j] = v;
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			++emittedCount;
+		}
+
+		// Prefer vertices that stay in cache while fanning their remaining triangles
+		unsigned next = ~0U;
+		size_t bestPriority = 0;
+		for (auto v : candidates)
+		{
+			if (live[v] == 0) continue;
+			size_t priority = 1;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = time - cacheTime[v] + 1;
+			if (next == ~0U || priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+
+		if (next == ~0U)
+		{
+			next = skipDeadEnd();
+			if (next != ~0U && emittedCount < triangleCount)
+				boundaries.push_back(unsigned(emittedCount));
+		}
+
+		fanning = next;
+	}
+
+	return boundaries;
+}
+
+// Splits hard clusters further where the cluster-local ACMR falls below the given threshold of the
+// overall ACMR, then sorts clusters to draw outward-facing, outer clusters first (Sander et al. 2007).
+void optimize_overdraw(unsigned* indices, size_t indexCount, std::vector<unsigned> const& hardBoundaries
+	, scene::Scene const& scene, unsigned vertexBase, unsigned vertexCount, unsigned cacheSize, float threshold)
+{
+	size_t triangleCount = indexCount / 3;
+	float meshAcmr = simulate_cache(indices, indexCount, vertexCount, cacheSize).acmr();
+
+	// Soft boundaries
+	std::vector<unsigned> clusters;
+	{
+		std::vector<size_t> cacheTime(vertexCount, 0);
+		size_t time = cacheSize + 1;
+
+		size_t hard = 0;
+		size_t clusterBegin = 0, clusterMisses = 0;
+		for (size_t t = 0; t < triangleCount; ++t)
+		{
+			if (t == 0 || (hard < hardBoundaries.size() && hardBoundaries[hard] == t))
+			{
+				if (t != 0) ++hard;
+				clusters.push_back(unsigned(t));
+				clusterBegin = t;
+				clusterMisses = 0;
+				time += cacheSize + 1; // flush
+			}
+
+			for (int j = 0; j < 3; ++j)
+			{
+				auto v = indices[3 * t + j];
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time++;
+					++clusterMisses;
+				}
+			}
+
+			size_t clusterTriangles = t + 1 - clusterBegin;
+			bool nextIsHard = (hard < hardBoundaries.size() && hardBoundaries[hard] == t + 1);
+			if (!nextIsHard && t + 1 < triangleCount && float(clusterMisses) <= threshold * meshAcmr * float(clusterTriangles))
+			{
+				clusters.push_back(unsigned(t + 1));
+				clusterBegin = t + 1;
+				clusterMisses = 0;
+				time += cacheSize + 1;
+			}
+		}
+	}
+	clusters.push_back(unsigned(triangleCount));
+
+	// Area-weighted cluster centroids & normals
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<float> clusterData(6 * clusterCount, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f };
+	float meshArea = 0.0f;
+
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		float* centroid = &clusterData[6 * c];
+		float* normal = centroid + 3;
+		float clusterArea = 0.0f;
+
+		for (auto t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			auto& p0 = scene.positions[vertexBase + indices[3 * t + 0]];
+			auto& p1 = scene.positions[vertexBase + indices[3 * t + 1]];
+			auto& p2 = scene.positions[vertexBase + indices[3 * t + 2]];
+
+			float e1[3], e2[3], n[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				e1[k] = p1.c[k] - p0.c[k];
+				e2[k] = p2.c[k] - p0.c[k];
+			}
+			n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+			n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+			n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+			float area = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int k = 0; k < 3; ++k)
+			{
+				float center = (p0.c[k] + p1.c[k] + p2.c[k]) / 3.0f;
+				centroid[k] += center * area;
+				meshCentroid[k] += center * area;
+				normal[k] += n[k];
+			}
+			clusterArea += area;
+		}
+
+		meshArea += clusterArea;
+		for (int k = 0; k < 3; ++k)
+			centroid[k] = (clusterArea > 0.0f) ? centroid[k] / clusterArea : 0.0f;
+	}
+	for (int k = 0; k < 3; ++k)
+		meshCentroid[k] = (meshArea > 0.0f) ? meshCentroid[k] / meshArea : 0.0f;
+
+	std::vector<float> sortKeys(clusterCount);
+	std::vector<unsigned> clusterOrder(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c)
+	{
+		float const* centroid = &clusterData[6 * c];
+		float const* normal = centroid + 3;
+		float normalLen = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+		float key = 0.0f;
+		for (int k = 0; k < 3; ++k)
+			key += (centroid[k] - meshCentroid[k]) * normal[k];
+		sortKeys[c] = (normalLen > 0.0f) ? key / normalLen : 0.0f;
+		clusterOrder[c] = unsigned(c);
+	}
+
+	std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](unsigned a, unsigned b) { return sortKeys[a] > sortKeys[b]; });
+
+	std::vector<unsigned> sorted;
+	sorted.reserve(indexCount);
+	for (auto c : clusterOrder)
+		sorted.insert(sorted.end(), indices + 3 * clusters[c], indices + 3 * clusters[c + 1]);
+	std::copy(sorted.begin(), sorted.end(), indices);
+}
+
+// Renumbers vertices in order of first use. Unreferenced vertices move to the end.
+std::vector<unsigned> optimize_vertex_fetch(unsigned* indices, size_t indexCount, unsigned vertexCount)
+{
+	std::vector<unsigned> remap(vertexCount, ~0U);
+	unsigned next = 0;
+
+	for (size_t i = 0; i < indexCount; ++i)
+	{
+		auto& v = remap[indices[i]];
+		if (v == ~0U) v = next++;
+		indices[i] = v;
+	}
+
+	for (auto& v : remap)
+		if (v == ~0U) v = next++;
+
+	return remap;
+}
+
+} // namespace
+
+void optimize_meshes(scene::Scene& scene, unsigned cacheSize, int verbosity)
+{
+	auto vertexRanges = mesh_vertex_ranges(scene);
+
+	size_t meshCount = scene.meshes.size();
+	std::vector<CacheStats> statsBefore(meshCount), statsAfter(meshCount);
+
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		auto& mesh = scene.meshes[meshIdx];
+		auto& range = vertexRanges[meshIdx];
+		if (mesh.primitives.first == mesh.primitives.last) return;
+
+		auto meshIndices = scene.indices.data() + mesh.primitives.first;
+		size_t indexCount = mesh.primitives.last - mesh.primitives.first;
+		unsigned vertexCount = range.last - range.first;
+
+		// Mesh-local indices
+		std::vector<unsigned> indices(meshIndices, meshIndices + indexCount);
+		for (auto& i : indices)
+			i -= range.first;
+
+		statsBefore[meshIdx] = simulate_cache(indices.data(), indexCount, vertexCount, cacheSize);
+
+		std::vector<unsigned> optimized(indexCount);
+		auto hardBoundaries = tipsify(optimized.data(), indices.data(), indexCount, vertexCount, cacheSize);
+		optimize_overdraw(optimized.data(), indexCount, hardBoundaries, scene, range.first, vertexCount, cacheSize, 1.05f);
+
+		// Vertices shared with other meshes cannot be reordered
+		if (!range.shared)
+			remap_vertices(scene, range.first, optimize_vertex_fetch(optimized.data(), indexCount, vertexCount));
+
+		statsAfter[meshIdx] = simulate_cache(optimized.data(), indexCount, vertexCount, cacheSize);
+
+		for (size_t i = 0; i < indexCount; ++i)
+			meshIndices[i] = optimized[i] + range.first;
+	});
+
+	if (verbosity >= 1)
+	{
+		CacheStats totalBefore, totalAfter;
+
+		for (size_t i = 0; i < meshCount; ++i)
+		{
+			if (verbosity >= 2)
+				std::cout << "Mesh " << i << ": ACMR " << statsBefore[i].acmr() << " -> " << statsAfter[i].acmr()
+					<< ", ATVR " << statsBefore[i].atvr() << " -> " << statsAfter[i].atvr() << '\n';
+
+			totalBefore.misses += statsBefore[i].misses; totalAfter.misses += statsAfter[i].misses;
+			totalBefore.triangles += statsBefore[i].triangles; totalAfter.triangles += statsAfter[i].triangles;
+			totalBefore.vertices += statsBefore[i].vertices; totalAfter.vertices += statsAfter[i].vertices;
+		}
+
+		std::cout << "All meshes: ACMR " << totalBefore.acmr() << " -> " << totalAfter.acmr()
+			<< ", ATVR " << totalBefore.atvr() << " -> " << totalAfter.atvr() << std::endl;
+	}
+}
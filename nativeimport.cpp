@@ -0,0 +1,1464 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+#include <assimp/material.h>
+#include <assimp/postprocess.h>
+#include <assimp/IOSystem.hpp>
+#include <assimp/IOStream.hpp>
+
+#include "nativeimport.h"
+#include "normals.h"
+#include "mapfile.h"
+#include "hash.h"
+#include "parallel.h"
+
+namespace
+{
+
+unsigned const no_index = ~0U;
+
+// Post-processing steps whose results the native importer reproduces, or which leave its results unchanged
+unsigned const native_process_flags = aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_FindDegenerates
+	| aiProcess_JoinIdenticalVertices | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace | aiProcess_RemoveComponent
+	| aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph | aiProcess_PreTransformVertices
+	| aiProcess_GenUVCoords | aiProcess_TransformUVCoords | aiProcess_RemoveRedundantMaterials;
+unsigned const native_required_flags = aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_JoinIdenticalVertices;
+unsigned const native_discard_flags = aiComponent_NORMALS | aiComponent_TANGENTS_AND_BITANGENTS | aiComponent_COLORS | aiComponent_TEXCOORDS;
+
+size_t const parse_chunk_size = 1U << 20U;
+size_t const vertex_block_size = 1U << 16U;
+size_t const ply_face_block_size = 1U << 16U;
+unsigned const join_partition_bits = 6;
+
+// Attribute pool indices of a triangle corner, no_index if absent
+struct Corner
+{
+	unsigned position, texcoord, normal;
+};
+
+// OBJ usemtl, o & g statements
+struct NamedSwitch
+{
+	size_t triangle; // chunk-local index of the first triangle following the statement
+	std::string name;
+};
+
+struct GroupSwitch
+{
+	size_t triangle; // chunk-local index of the first triangle in the group
+	unsigned group;
+};
+
+// Triangles & attributes parsed from one chunk of the input file
+struct ParsedChunk
+{
+	std::vector<Corner> corners; // 3 per triangle
+	std::vector<GroupSwitch> groupSwitches;
+	unsigned firstGroup = 0;
+	std::vector<NamedSwitch> materialSwitches, objectSwitches; // resolved into groups
+
+	// OBJ attribute statements, counted ahead of parsing to resolve relative indices
+	std::vector<aiVector3D> positions, normals, texcoords;
+	std::vector<aiColor4D> colors;
+	std::vector<std::string> materialLibs;
+	size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
+	size_t positionBase = 0, normalBase = 0, texcoordBase = 0;
+
+	char const* unsupported = nullptr;
+};
+
+// Attribute pools & triangle corners grouped by object & material
+struct RawGeometry
+{
+	std::vector<aiVector3D> positions, normals, texcoords;
+	std::vector<aiColor4D> colors; // one per position if any
+	std::vector<Corner> corners;
+	std::vector<size_t> groupOffsets; // corner range per group
+	std::vector<unsigned> groupMaterials;
+	std::vector<unsigned> groupObjects; // empty if all meshes belong to the root node
+	std::vector<std::string> objectNames;
+};
+
+struct NamedMaterial
+{
+	std::string name;
+	std::unique_ptr<aiMaterial> material;
+};
+
+template <class Fun>
+void parallel_blocks(size_t count, size_t blockSize, Fun&& fun)
+{
+	parallel_for((count + blockSize - 1) / blockSize, [&](size_t block)
+	{
+		fun(block * blockSize, std::min(block * blockSize + blockSize, count));
+	});
+}
+
+// Text parsing
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline char const* skip_space(char const* p, char const* end)
+{
+	while (p < end && is_space(*p)) ++p;
+	return p;
+}
+
+inline char const* trim_end(char const* begin, char const* end)
+{
+	while (end > begin && is_space(end[-1])) --end;
+	return end;
+}
+
+template <class Fun>
+void for_each_line(char const* p, char const* end, Fun&& fun)
+{
+	while (p < end)
+	{
+		auto lineEnd = static_cast<char const*>(memchr(p, '\n', size_t(end - p)));
+		if (!lineEnd) lineEnd = end;
+		if (!fun(p, lineEnd)) return;
+		p = (lineEnd < end) ? lineEnd + 1 : end;
+	}
+}
+
+// Splits the given text into about equally sized chunks of whole lines.
+std::vector< std::pair<char const*, char const*> > split_lines(char const* begin, char const* end)
+{
+	size_t size = size_t(end - begin);
+	size_t chunkCount = std::max(size_t(1), std::min(size / parse_chunk_size, size_t(4) * worker_count()));
+
+	std::vector< std::pair<char const*, char const*> > chunks;
+	auto chunkBegin = begin;
+	for (size_t i = 1; i <= chunkCount && chunkBegin < end; ++i)
+	{
+		auto chunkEnd = std::max(chunkBegin, begin + size / chunkCount * i);
+		if (i == chunkCount || chunkEnd >= end)
+			chunkEnd = end;
+		else if (auto lineEnd = static_cast<char const*>(memchr(chunkEnd, '\n', size_t(end - chunkEnd))))
+			chunkEnd = lineEnd + 1;
+		else
+			chunkEnd = end;
+		chunks.push_back(std::make_pair(chunkBegin, chunkEnd));
+		chunkBegin = chunkEnd;
+	}
+	return chunks;
+}
+
+double const powers_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11
+	, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+// Decimal number accurate to float precision, null if malformed.
+char const* parse_float(char const* p, char const* end, float& value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+
+	std::uint64_t mantissa = 0;
+	int significant = 0, exponent = 0;
+	bool digits = false;
+	for (; p < end && unsigned(*p - '0') < 10U; ++p, digits = true)
+	{
+		if (significant < 19)
+		{
+			mantissa = mantissa * 10 + unsigned(*p - '0');
+			significant += (mantissa != 0);
+		}
+		else
+			++exponent;
+	}
+	if (p < end && *p == '.')
+		for (++p; p < end && unsigned(*p - '0') < 10U; ++p, digits = true)
+			if (significant < 19)
+			{
+				mantissa = mantissa * 10 + unsigned(*p - '0');
+				significant += (mantissa != 0);
+				--exponent;
+			}
+	if (!digits) return nullptr;
+
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool negativeExponent = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negativeExponent = (*p++ == '-');
+		if (p == end || unsigned(*p - '0') >= 10U) return nullptr;
+		int e = 0;
+		for (; p < end && unsigned(*p - '0') < 10U; ++p)
+			e = std::min(e * 10 + (*p - '0'), 10000);
+		exponent += negativeExponent ? -e : e;
+	}
+
+	double v = double(mantissa);
+	if (exponent < 0)
+		v = (exponent >= -22) ? v / powers_of_ten[-exponent] : v * std::pow(10.0, double(exponent));
+	else if (exponent > 0)
+		v = (exponent <= 22) ? v * powers_of_ten[exponent] : v * std::pow(10.0, double(exponent));
+	value = float(negative ? -v : v);
+	return p;
+}
+
+// Whitespace-separated floats filling the rest of the line, -1 if malformed or more than maxCount.
+int parse_floats(char const* p, char const* end, float* values, int maxCount)
+{
+	int count = 0;
+	for (p = skip_space(p, end); p < end; p = skip_space(p, end))
+	{
+		if (count == maxCount) return -1;
+		p = parse_float(p, end, values[count++]);
+		if (!p || (p < end && !is_space(*p))) return -1;
+	}
+	return count;
+}
+
+char const* parse_integer(char const* p, char const* end, long long& value)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = (*p++ == '-');
+	if (p == end || unsigned(*p - '0') >= 10U) return nullptr;
+
+	value = 0;
+	for (; p < end && unsigned(*p - '0') < 10U; ++p)
+		value = std::min(value * 10 + (*p - '0'), 1LL << 40);
+	if (negative) value = -value;
+	return p;
+}
+
+// 1-based OBJ index, negative indices count back from the last defined element.
+inline bool resolve_index(long long value, size_t defined, size_t total, unsigned& index)
+{
+	if (value > 0 && size_t(value) <= total)
+		index = unsigned(value - 1);
+	else if (value < 0 && size_t(-value) <= defined)
+		index = unsigned(static_cast<long long>(defined) + value);
+	else
+		return false;
+	return true;
+}
+
+inline bool is_keyword(char const* word, size_t length, char const* keyword)
+{
+	return length == strlen(keyword) && memcmp(word, keyword, length) == 0;
+}
+
+// OBJ
+
+void count_obj_attributes(ParsedChunk& chunk, char const* p, char const* end)
+{
+	for_each_line(p, end, [&](char const* line, char const* lineEnd)
+	{
+		line = skip_space(line, lineEnd);
+		if (lineEnd - line >= 2 && line[0] == 'v')
+		{
+			if (is_space(line[1]))
+				++chunk.positionCount;
+			else if (lineEnd - line >= 3 && is_space(line[2]))
+			{
+				if (line[1] == 'n') ++chunk.normalCount;
+				else if (line[1] == 't') ++chunk.texcoordCount;
+			}
+		}
+		return true;
+	});
+}
+
+void parse_obj_chunk(ParsedChunk& chunk, char const* p, char const* end, size_t positionTotal, size_t normalTotal, size_t texcoordTotal)
+{
+	chunk.positions.reserve(chunk.positionCount);
+	chunk.normals.reserve(chunk.normalCount);
+	chunk.texcoords.reserve(chunk.texcoordCount);
+
+	std::vector<Corner> face;
+	for_each_line(p, end, [&](char const* line, char const* lineEnd) -> bool
+	{
+		line = skip_space(line, lineEnd);
+		lineEnd = trim_end(line, lineEnd);
+		if (line == lineEnd || *line == '#') return true;
+		if (lineEnd[-1] == '\\')
+		{
+			chunk.unsupported = "OBJ line continuation";
+			return false;
+		}
+
+		auto word = line;
+		while (line < lineEnd && !is_space(*line)) ++line;
+		size_t wordLength = size_t(line - word);
+		line = skip_space(line, lineEnd);
+
+		float values[6];
+		if (is_keyword(word, wordLength, "v"))
+		{
+			int count = parse_floats(line, lineEnd, values, 6);
+			if (count != 3 && count != 4 && count != 6) chunk.unsupported = "malformed OBJ vertex";
+			else if (count == 4 && values[3] == 0.0f) chunk.unsupported = "OBJ vertex with zero weight";
+			if (chunk.unsupported) return false;
+
+			if (count == 4)
+				chunk.positions.push_back(aiVector3D(values[0] / values[3], values[1] / values[3], values[2] / values[3]));
+			else
+				chunk.positions.push_back(aiVector3D(values[0], values[1], values[2]));
+
+			if (count == 6 && chunk.colors.empty())
+				chunk.colors.resize(chunk.positions.size() - 1, aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+			if (!chunk.colors.empty())
+				chunk.colors.push_back((count == 6) ? aiColor4D(values[3], values[4], values[5], 1.0f) : aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+		}
+		else if (is_keyword(word, wordLength, "vt"))
+		{
+			int count = parse_floats(line, lineEnd, values, 3);
+			if (count < 1)
+			{
+				chunk.unsupported = "malformed OBJ tex coord";
+				return false;
+			}
+			chunk.texcoords.push_back(aiVector3D(values[0], (count > 1) ? values[1] : 0.0f, 0.0f));
+		}
+		else if (is_keyword(word, wordLength, "vn"))
+		{
+			if (parse_floats(line, lineEnd, values, 3) != 3)
+			{
+				chunk.unsupported = "malformed OBJ normal";
+				return false;
+			}
+			chunk.normals.push_back(aiVector3D(values[0], values[1], values[2]));
+		}
+		else if (is_keyword(word, wordLength, "f"))
+		{
+			size_t definedPositions = chunk.positionBase + chunk.positions.size();
+			size_t definedTexcoords = chunk.texcoordBase + chunk.texcoords.size();
+			size_t definedNormals = chunk.normalBase + chunk.normals.size();
+
+			face.clear();
+			for (; line < lineEnd; line = skip_space(line, lineEnd))
+			{
+				Corner corner = { no_index, no_index, no_index };
+				long long value;
+				bool valid = (line = parse_integer(line, lineEnd, value)) && resolve_index(value, definedPositions, positionTotal, corner.position);
+				if (valid && line < lineEnd && *line == '/')
+				{
+					if (++line < lineEnd && *line != '/')
+						valid = (line = parse_integer(line, lineEnd, value)) && resolve_index(value, definedTexcoords, texcoordTotal, corner.texcoord);
+					if (valid && line < lineEnd && *line == '/')
+						valid = (line = parse_integer(line + 1, lineEnd, value)) && resolve_index(value, definedNormals, normalTotal, corner.normal);
+				}
+				if (!valid || (line < lineEnd && !is_space(*line)))
+				{
+					chunk.unsupported = "malformed OBJ face";
+					return false;
+				}
+				face.push_back(corner);
+			}
+
+			// Fan triangulation, lines & points are removed
+			for (size_t i = 2; i < face.size(); ++i)
+			{
+				chunk.corners.push_back(face[0]);
+				chunk.corners.push_back(face[i - 1]);
+				chunk.corners.push_back(face[i]);
+			}
+		}
+		else if (is_keyword(word, wordLength, "usemtl"))
+		{
+			NamedSwitch materialSwitch = { chunk.corners.size() / 3, std::string(line, lineEnd) };
+			chunk.materialSwitches.push_back(materialSwitch);
+		}
+		else if (is_keyword(word, wordLength, "o") || is_keyword(word, wordLength, "g"))
+		{
+			NamedSwitch objectSwitch = { chunk.corners.size() / 3, std::string(line, lineEnd) };
+			chunk.objectSwitches.push_back(objectSwitch);
+		}
+		else if (is_keyword(word, wordLength, "mtllib"))
+			chunk.materialLibs.push_back(std::string(line, lineEnd));
+		else if (!is_keyword(word, wordLength, "s") && !is_keyword(word, wordLength, "l") && !is_keyword(word, wordLength, "p"))
+		{
+			chunk.unsupported = "OBJ statement other than geometry, groups & materials";
+			return false;
+		}
+		return true;
+	});
+}
+
+std::unique_ptr<aiMaterial> new_obj_material(std::string const& name)
+{
+	std::unique_ptr<aiMaterial> material(new aiMaterial());
+	aiString nameString(name);
+	material->AddProperty(&nameString, AI_MATKEY_NAME);
+
+	// Defaults of Assimp's OBJ importer
+	aiColor3D black(0.0f, 0.0f, 0.0f), gray(0.6f, 0.6f, 0.6f), white(1.0f, 1.0f, 1.0f);
+	float zero = 0.0f, one = 1.0f;
+	material->AddProperty(&black, 1, AI_MATKEY_COLOR_AMBIENT);
+	material->AddProperty(&gray, 1, AI_MATKEY_COLOR_DIFFUSE);
+	material->AddProperty(&black, 1, AI_MATKEY_COLOR_SPECULAR);
+	material->AddProperty(&black, 1, AI_MATKEY_COLOR_EMISSIVE);
+	material->AddProperty(&white, 1, AI_MATKEY_COLOR_TRANSPARENT);
+	material->AddProperty(&zero, 1, AI_MATKEY_SHININESS);
+	material->AddProperty(&one, 1, AI_MATKEY_OPACITY);
+	material->AddProperty(&one, 1, AI_MATKEY_REFRACTI);
+	return material;
+}
+
+// Adds the materials of the given MTL file, missing files are skipped like by Assimp.
+bool load_obj_materials(std::vector<NamedMaterial>& materials, std::map<std::string, unsigned>& materialIdcs
+	, std::string const& path, Assimp::IOSystem& ioSystem, std::string& unsupported)
+{
+	std::vector<char> text;
+	if (auto stream = ioSystem.Open(path.c_str(), "rb"))
+	{
+		text.resize(stream->FileSize());
+		text.resize(stream->Read(text.data(), 1, text.size()));
+		ioSystem.Close(stream);
+	}
+	else
+		return true;
+
+	struct TextureKey { char const* keyword; aiTextureType type; };
+	static TextureKey const textureKeys[] = {
+		{ "map_Kd", aiTextureType_DIFFUSE }, { "map_Ka", aiTextureType_AMBIENT }, { "map_Ks", aiTextureType_SPECULAR }
+		, { "map_Ke", aiTextureType_EMISSIVE }, { "map_d", aiTextureType_OPACITY }, { "map_Ns", aiTextureType_SHININESS }
+		, { "map_ns", aiTextureType_SHININESS }, { "map_bump", aiTextureType_HEIGHT }, { "map_Bump", aiTextureType_HEIGHT }
+		, { "bump", aiTextureType_HEIGHT }, { "norm", aiTextureType_NORMALS }, { "map_Kn", aiTextureType_NORMALS }
+		, { "disp", aiTextureType_DISPLACEMENT }, { "refl", aiTextureType_REFLECTION } };
+
+	aiMaterial* material = nullptr;
+	char const* failure = nullptr;
+	for_each_line(text.data(), text.data() + text.size(), [&](char const* line, char const* lineEnd) -> bool
+	{
+		line = skip_space(line, lineEnd);
+		lineEnd = trim_end(line, lineEnd);
+		if (line == lineEnd || *line == '#') return true;
+
+		auto word = line;
+		while (line < lineEnd && !is_space(*line)) ++line;
+		size_t wordLength = size_t(line - word);
+		line = skip_space(line, lineEnd);
+
+		if (is_keyword(word, wordLength, "newmtl"))
+		{
+			std::string name(line, lineEnd);
+			NamedMaterial named = { name, new_obj_material(name) };
+			material = named.material.get();
+			auto inserted = materialIdcs.insert(std::make_pair(name, unsigned(materials.size())));
+			if (inserted.second)
+				materials.push_back(std::move(named));
+			else
+				materials[inserted.first->second] = std::move(named);
+			return true;
+		}
+		if (!material) return true;
+
+		float values[3];
+		auto&& color = [&](char const* key, unsigned type, unsigned index) -> bool
+		{
+			int count = parse_floats(line, lineEnd, values, 3);
+			if (count != 1 && count != 3) return false;
+			aiColor3D c(values[0], values[count / 3], values[2 * (count / 3)]);
+			material->AddProperty(&c, 1, key, type, index);
+			return true;
+		};
+		auto&& scalar = [&](char const* key, unsigned type, unsigned index, bool invert) -> bool
+		{
+			if (parse_floats(line, lineEnd, values, 1) != 1) return false;
+			float v = invert ? 1.0f - values[0] : values[0];
+			material->AddProperty(&v, 1, key, type, index);
+			return true;
+		};
+
+		bool valid = true;
+		if (is_keyword(word, wordLength, "Ka")) valid = color(AI_MATKEY_COLOR_AMBIENT);
+		else if (is_keyword(word, wordLength, "Kd")) valid = color(AI_MATKEY_COLOR_DIFFUSE);
+		else if (is_keyword(word, wordLength, "Ks")) valid = color(AI_MATKEY_COLOR_SPECULAR);
+		else if (is_keyword(word, wordLength, "Ke")) valid = color(AI_MATKEY_COLOR_EMISSIVE);
+		else if (is_keyword(word, wordLength, "Tf")) valid = color(AI_MATKEY_COLOR_TRANSPARENT);
+		else if (is_keyword(word, wordLength, "Ns")) valid = scalar(AI_MATKEY_SHININESS, false);
+		else if (is_keyword(word, wordLength, "Ni")) valid = scalar(AI_MATKEY_REFRACTI, false);
+		else if (is_keyword(word, wordLength, "d")) valid = scalar(AI_MATKEY_OPACITY, false);
+		else if (is_keyword(word, wordLength, "Tr")) valid = scalar(AI_MATKEY_OPACITY, true);
+		else
+		{
+			for (auto& textureKey : textureKeys)
+				if (is_keyword(word, wordLength, textureKey.keyword))
+				{
+					if (line == lineEnd || *line == '-')
+					{
+						failure = "MTL texture options";
+						return false;
+					}
+					aiString texturePath(std::string(line, lineEnd));
+					material->AddProperty(&texturePath, _AI_MATKEY_TEXTURE_BASE, textureKey.type, 0);
+					break;
+				}
+			// Other statements (illum, sharpness, ...) are ignored like by Assimp
+		}
+
+		if (!valid)
+		{
+			failure = "malformed MTL statement";
+			return false;
+		}
+		return true;
+	});
+
+	if (failure)
+	{
+		unsupported = failure;
+		return false;
+	}
+	return true;
+}
+
+// PLY
+
+enum class PlyType { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+struct PlyProperty
+{
+	std::string name;
+	PlyType type;
+	PlyType countType; // none unless list
+};
+
+struct PlyElement
+{
+	std::string name;
+	size_t count;
+	std::vector<PlyProperty> properties;
+};
+
+PlyType ply_type(std::string const& name)
+{
+	if (name == "char" || name == "int8") return PlyType::int8;
+	if (name == "uchar" || name == "uint8") return PlyType::uint8;
+	if (name == "short" || name == "int16") return PlyType::int16;
+	if (name == "ushort" || name == "uint16") return PlyType::uint16;
+	if (name == "int" || name == "int32") return PlyType::int32;
+	if (name == "uint" || name == "uint32") return PlyType::uint32;
+	if (name == "float" || name == "float32") return PlyType::float32;
+	if (name == "double" || name == "float64") return PlyType::float64;
+	return PlyType::none;
+}
+
+size_t ply_type_size(PlyType type)
+{
+	switch (type)
+	{
+	case PlyType::int8: case PlyType::uint8: return 1;
+	case PlyType::int16: case PlyType::uint16: return 2;
+	case PlyType::int32: case PlyType::uint32: case PlyType::float32: return 4;
+	case PlyType::float64: return 8;
+	default: return 0;
+	}
+}
+
+template <class T>
+inline T read_ply_value(char const* p, bool bigEndian)
+{
+	char bytes[sizeof(T)];
+	memcpy(bytes, p, sizeof(T));
+	if (bigEndian)
+		std::reverse(bytes, bytes + sizeof(T));
+	T value;
+	memcpy(&value, bytes, sizeof(T));
+	return value;
+}
+
+double read_ply_scalar(char const* p, PlyType type, bool bigEndian)
+{
+	switch (type)
+	{
+	case PlyType::int8: return double(std::int8_t(*p));
+	case PlyType::uint8: return double(std::uint8_t(*p));
+	case PlyType::int16: return double(read_ply_value<std::int16_t>(p, bigEndian));
+	case PlyType::uint16: return double(read_ply_value<std::uint16_t>(p, bigEndian));
+	case PlyType::int32: return double(read_ply_value<std::int32_t>(p, bigEndian));
+	case PlyType::uint32: return double(read_ply_value<std::uint32_t>(p, bigEndian));
+	case PlyType::float32: return double(read_ply_value<float>(p, bigEndian));
+	case PlyType::float64: return read_ply_value<double>(p, bigEndian);
+	default: return 0.0;
+	}
+}
+
+// Byte offset & type of a vertex property, type none if missing
+struct PlyAttribute
+{
+	size_t offset = 0;
+	PlyType type = PlyType::none;
+};
+
+bool parse_ply_header(std::vector<PlyElement>& elements, bool& bigEndian, size_t& dataOffset, char const* data, size_t size, char const*& unsupported)
+{
+	auto headerEnd = data;
+	bool ended = false, binary = false;
+	for_each_line(data, data + size, [&](char const* line, char const* lineEnd) -> bool
+	{
+		headerEnd = (lineEnd < data + size) ? lineEnd + 1 : lineEnd;
+
+		std::vector<std::string> tokens;
+		for (line = skip_space(line, lineEnd); line < lineEnd; line = skip_space(line, lineEnd))
+		{
+			auto token = line;
+			while (line < lineEnd && !is_space(*line)) ++line;
+			tokens.push_back(std::string(token, line));
+		}
+		if (tokens.empty() || tokens[0] == "ply" || tokens[0] == "comment" || tokens[0] == "obj_info") return true;
+
+		if (tokens[0] == "end_header")
+			ended = true;
+		else if (tokens[0] == "format" && tokens.size() >= 2)
+		{
+			binary = (tokens[1] == "binary_little_endian" || tokens[1] == "binary_big_endian");
+			bigEndian = (tokens[1] == "binary_big_endian");
+		}
+		else if (tokens[0] == "element" && tokens.size() == 3)
+		{
+			PlyElement element = { tokens[1], size_t(strtoull(tokens[2].c_str(), nullptr, 10)) };
+			elements.push_back(element);
+		}
+		else if (tokens[0] == "property" && !elements.empty())
+		{
+			PlyProperty property = { tokens.back(), PlyType::none, PlyType::none };
+			if (tokens.size() == 5 && tokens[1] == "list")
+			{
+				property.countType = ply_type(tokens[2]);
+				property.type = ply_type(tokens[3]);
+				if (property.countType == PlyType::none || property.countType == PlyType::float32 || property.countType == PlyType::float64)
+					property.type = PlyType::none;
+			}
+			else if (tokens.size() == 3)
+				property.type = ply_type(tokens[1]);
+			if (property.type == PlyType::none) unsupported = "malformed PLY property";
+			elements.back().properties.push_back(property);
+		}
+		else
+			unsupported = "unknown PLY header statement";
+		return !ended && !unsupported;
+	});
+
+	if (!unsupported && !ended) unsupported = "incomplete PLY header";
+	if (!unsupported && !binary) unsupported = "ASCII PLY";
+	dataOffset = size_t(headerEnd - data);
+	return !unsupported;
+}
+
+// Size of one element if all of its properties are scalars, 0 otherwise.
+size_t fixed_element_size(PlyElement const& element)
+{
+	size_t size = 0;
+	for (auto& property : element.properties)
+	{
+		if (property.countType != PlyType::none) return 0;
+		size += ply_type_size(property.type);
+	}
+	return size;
+}
+
+bool import_ply(RawGeometry& geometry, std::vector<ParsedChunk>& chunks, char const* data, size_t size, char const*& unsupported)
+{
+	std::vector<PlyElement> elements;
+	bool bigEndian = false;
+	size_t offset;
+	if (!parse_ply_header(elements, bigEndian, offset, data, size, unsupported))
+		return false;
+
+	// Locate vertices & faces, elements after the faces are ignored
+	PlyElement const* vertexElement = nullptr;
+	PlyElement const* faceElement = nullptr;
+	size_t vertexOffset = 0, vertexStride = 0, faceOffset = 0;
+	for (auto& element : elements)
+	{
+		if (element.name == "face" && vertexElement)
+		{
+			faceElement = &element;
+			faceOffset = offset;
+			break;
+		}
+
+		size_t elementSize = fixed_element_size(element);
+		if (elementSize == 0 && element.count > 0)
+		{
+			unsupported = "PLY lists outside faces";
+			return false;
+		}
+		if (element.name == "vertex")
+		{
+			vertexElement = &element;
+			vertexOffset = offset;
+			vertexStride = elementSize;
+		}
+		if (element.count > (size - offset) / std::max(elementSize, size_t(1)))
+		{
+			unsupported = "truncated PLY data";
+			return false;
+		}
+		offset += element.count * elementSize;
+	}
+	if (!faceElement)
+	{
+		unsupported = "PLY without vertices & faces";
+		return false;
+	}
+	if (vertexElement->count >= no_index)
+	{
+		unsupported = "more than 4G vertices";
+		return false;
+	}
+
+	// Vertex attributes
+	std::map<std::string, PlyAttribute> attributes;
+	{
+		size_t propertyOffset = 0;
+		for (auto& property : vertexElement->properties)
+		{
+			PlyAttribute attribute;
+			attribute.offset = propertyOffset;
+			attribute.type = property.type;
+			attributes[property.name] = attribute;
+			propertyOffset += ply_type_size(property.type);
+		}
+	}
+	auto&& attribute = [&](char const* name, char const* alt1 = nullptr, char const* alt2 = nullptr, char const* alt3 = nullptr) -> PlyAttribute
+	{
+		for (auto n : { name, alt1, alt2, alt3 })
+			if (n && attributes.count(n)) return attributes[n];
+		return PlyAttribute();
+	};
+	PlyAttribute position[3] = { attribute("x"), attribute("y"), attribute("z") };
+	PlyAttribute normal[3] = { attribute("nx"), attribute("ny"), attribute("nz") };
+	PlyAttribute texcoord[2] = { attribute("u", "s", "texture_u", "texture_s"), attribute("v", "t", "texture_v", "texture_t") };
+	PlyAttribute color[4] = { attribute("red"), attribute("green"), attribute("blue"), attribute("alpha") };
+	if (position[0].type == PlyType::none || position[1].type == PlyType::none || position[2].type == PlyType::none)
+	{
+		unsupported = "PLY vertices without positions";
+		return false;
+	}
+
+	bool hasNormals = normal[0].type != PlyType::none && normal[1].type != PlyType::none && normal[2].type != PlyType::none;
+	bool hasTexcoords = texcoord[0].type != PlyType::none && texcoord[1].type != PlyType::none;
+	bool hasColors = color[0].type != PlyType::none && color[1].type != PlyType::none && color[2].type != PlyType::none;
+
+	size_t vertexCount = vertexElement->count;
+	geometry.positions.resize(vertexCount);
+	if (hasNormals) geometry.normals.resize(vertexCount);
+	if (hasTexcoords) geometry.texcoords.resize(vertexCount);
+	if (hasColors) geometry.colors.resize(vertexCount);
+
+	// Integer colors are normalized
+	auto&& colorScale = [](PlyType type) { return (type == PlyType::uint8) ? 1.0f / 255.0f : (type == PlyType::uint16) ? 1.0f / 65535.0f : 1.0f; };
+
+	parallel_blocks(vertexCount, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+		{
+			auto vertex = data + vertexOffset + i * vertexStride;
+			auto&& read = [&](PlyAttribute const& a) { return float(read_ply_scalar(vertex + a.offset, a.type, bigEndian)); };
+
+			geometry.positions[i] = aiVector3D(read(position[0]), read(position[1]), read(position[2]));
+			if (hasNormals) geometry.normals[i] = aiVector3D(read(normal[0]), read(normal[1]), read(normal[2]));
+			if (hasTexcoords) geometry.texcoords[i] = aiVector3D(read(texcoord[0]), read(texcoord[1]), 0.0f);
+			if (hasColors)
+				geometry.colors[i] = aiColor4D(read(color[0]) * colorScale(color[0].type), read(color[1]) * colorScale(color[1].type)
+					, read(color[2]) * colorScale(color[2].type), (color[3].type != PlyType::none) ? read(color[3]) * colorScale(color[3].type) : 1.0f);
+		}
+	});
+
+	// Faces have variable size: find block starts serially, then decode blocks in parallel
+	size_t indexProperty = faceElement->properties.size();
+	for (size_t i = 0; i < faceElement->properties.size(); ++i)
+		if (faceElement->properties[i].countType != PlyType::none
+			&& (faceElement->properties[i].name == "vertex_indices" || faceElement->properties[i].name == "vertex_index"))
+			indexProperty = i;
+	if (indexProperty == faceElement->properties.size())
+	{
+		unsupported = "PLY faces without vertex indices";
+		return false;
+	}
+
+	auto&& skipFace = [&](size_t faceOffset, size_t* listOffset) -> size_t
+	{
+		for (size_t i = 0; i < faceElement->properties.size(); ++i)
+		{
+			auto& property = faceElement->properties[i];
+			if (property.countType == PlyType::none)
+				faceOffset += ply_type_size(property.type);
+			else
+			{
+				auto countSize = ply_type_size(property.countType);
+				if (faceOffset + countSize > size) return size + 1;
+				if (i == indexProperty && listOffset) *listOffset = faceOffset;
+				auto count = read_ply_scalar(data + faceOffset, property.countType, bigEndian);
+				if (count < 0.0) return size + 1;
+				faceOffset += countSize + size_t(count) * ply_type_size(property.type);
+			}
+		}
+		return faceOffset;
+	};
+
+	std::vector<size_t> blockOffsets;
+	for (size_t f = 0; f < faceElement->count; ++f)
+	{
+		if (f % ply_face_block_size == 0)
+			blockOffsets.push_back(faceOffset);
+		faceOffset = skipFace(faceOffset, nullptr);
+		if (faceOffset > size)
+		{
+			unsupported = "truncated PLY data";
+			return false;
+		}
+	}
+
+	auto& indexList = faceElement->properties[indexProperty];
+	auto indexSize = ply_type_size(indexList.type);
+	chunks.resize(blockOffsets.size());
+	parallel_for(chunks.size(), [&](size_t block)
+	{
+		auto& chunk = chunks[block];
+		size_t offset = blockOffsets[block];
+		for (size_t f = block * ply_face_block_size, fe = std::min(f + ply_face_block_size, faceElement->count); f < fe; ++f)
+		{
+			size_t listOffset = 0;
+			size_t nextOffset = skipFace(offset, &listOffset);
+
+			size_t count = size_t(read_ply_scalar(data + listOffset, indexList.countType, bigEndian));
+			auto indices = data + listOffset + ply_type_size(indexList.countType);
+			auto&& corner = [&](size_t i) -> Corner
+			{
+				double index = read_ply_scalar(indices + i * indexSize, indexList.type, bigEndian);
+				unsigned v = (index >= 0.0 && index < double(vertexCount)) ? unsigned(index) : no_index;
+				Corner c = { v, hasTexcoords ? v : no_index, hasNormals ? v : no_index };
+				return c;
+			};
+
+			// Fan triangulation, lines & points are removed
+			for (size_t i = 2; i < count; ++i)
+			{
+				Corner triangle[3] = { corner(0), corner(i - 1), corner(i) };
+				if (triangle[0].position == no_index || triangle[1].position == no_index || triangle[2].position == no_index)
+				{
+					chunk.unsupported = "PLY vertex index out of range";
+					return;
+				}
+				chunk.corners.insert(chunk.corners.end(), triangle, triangle + 3);
+			}
+			offset = nextOffset;
+		}
+	});
+	return true;
+}
+
+// Mesh building
+
+inline bool same_position(aiVector3D const& a, aiVector3D const& b)
+{
+	return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+// Walks the triangles of a chunk with their groups, dropping degenerate triangles like
+// aiProcess_FindDegenerates followed by the removal of the resulting lines & points.
+template <class Fun>
+void for_each_triangle(ParsedChunk const& chunk, std::vector<aiVector3D> const& positions, Fun&& fun)
+{
+	unsigned group = chunk.firstGroup;
+	size_t nextSwitch = 0;
+	for (size_t t = 0, te = chunk.corners.size() / 3; t < te; ++t)
+	{
+		while (nextSwitch < chunk.groupSwitches.size() && chunk.groupSwitches[nextSwitch].triangle <= t)
+			group = chunk.groupSwitches[nextSwitch++].group;
+
+		auto corners = &chunk.corners[3 * t];
+		auto& p0 = positions[corners[0].position];
+		auto& p1 = positions[corners[1].position];
+		auto& p2 = positions[corners[2].position];
+		if (same_position(p0, p1) || same_position(p1, p2) || same_position(p2, p0)) continue;
+
+		fun(corners, group);
+	}
+}
+
+// Groups the triangles of all chunks by geometry.groupMaterials, keeping file order within each group.
+void group_triangles(RawGeometry& geometry, std::vector<ParsedChunk> const& chunks)
+{
+	size_t groupCount = geometry.groupMaterials.size();
+	std::vector<size_t> offsets(chunks.size() * groupCount, 0);
+	parallel_for(chunks.size(), [&](size_t i)
+	{
+		for_each_triangle(chunks[i], geometry.positions, [&](Corner const*, unsigned group) { ++offsets[i * groupCount + group]; });
+	});
+
+	geometry.groupOffsets.assign(groupCount + 1, 0);
+	size_t cornerCount = 0;
+	for (size_t g = 0; g < groupCount; ++g)
+	{
+		geometry.groupOffsets[g] = cornerCount;
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			auto triangleCount = offsets[i * groupCount + g];
+			offsets[i * groupCount + g] = cornerCount;
+			cornerCount += 3 * triangleCount;
+		}
+	}
+	geometry.groupOffsets[groupCount] = cornerCount;
+
+	geometry.corners.resize(cornerCount);
+	parallel_for(chunks.size(), [&](size_t i)
+	{
+		for_each_triangle(chunks[i], geometry.positions, [&](Corner const* corners, unsigned group)
+		{
+			auto& offset = offsets[i * groupCount + group];
+			std::copy(corners, corners + 3, geometry.corners.begin() + offset);
+			offset += 3;
+		});
+	});
+}
+
+struct VertexKey
+{
+	unsigned c[5];
+};
+
+inline bool operator ==(VertexKey const& a, VertexKey const& b)
+{
+	return memcmp(a.c, b.c, sizeof(a.c)) == 0;
+}
+
+// Hashed join of identical keys, numbering unique keys in order of first occurrence like
+// aiProcess_JoinIdenticalVertices. Keys are partitioned by hash, partitions are joined in parallel.
+void join_keys(std::vector<unsigned>& vertexIdcs, std::vector<unsigned>& firstKeys, std::vector<VertexKey> const& keys)
+{
+	size_t const partitionCount = size_t(1) << join_partition_bits;
+	size_t keyCount = keys.size();
+	size_t blockCount = (keyCount + vertex_block_size - 1) / vertex_block_size;
+
+	std::vector<std::uint64_t> hashes(keyCount);
+	std::vector<size_t> blockOffsets(blockCount * partitionCount, 0);
+	auto&& partition = [&](size_t key) { return size_t(hashes[key] >> (64U - join_partition_bits)); };
+
+	parallel_blocks(keyCount, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		auto counts = &blockOffsets[begin / vertex_block_size * partitionCount];
+		for (auto i = begin; i < end; ++i)
+		{
+			hashes[i] = murmur_hash64(&keys[i], sizeof(keys[i]), 0);
+			++counts[partition(i)];
+		}
+	});
+
+	// Partition-major order, ascending key index within each partition
+	std::vector<size_t> partitionOffsets(partitionCount + 1, 0);
+	{
+		size_t offset = 0;
+		for (size_t p = 0; p < partitionCount; ++p)
+		{
+			partitionOffsets[p] = offset;
+			for (size_t b = 0; b < blockCount; ++b)
+			{
+				auto count = blockOffsets[b * partitionCount + p];
+				blockOffsets[b * partitionCount + p] = offset;
+				offset += count;
+			}
+		}
+		partitionOffsets[partitionCount] = offset;
+	}
+
+	std::vector<unsigned> order(keyCount);
+	parallel_blocks(keyCount, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		auto offsets = &blockOffsets[begin / vertex_block_size * partitionCount];
+		for (auto i = begin; i < end; ++i)
+			order[offsets[partition(i)]++] = unsigned(i);
+	});
+
+	// Open addressing per partition, local ids in order of first occurrence
+	std::vector<unsigned> localIdcs(keyCount);
+	std::vector< std::vector<unsigned> > partitionFirsts(partitionCount);
+	parallel_for(partitionCount, [&](size_t p)
+	{
+		size_t begin = partitionOffsets[p], end = partitionOffsets[p + 1];
+		size_t tableSize = 16;
+		while (tableSize < 2 * (end - begin)) tableSize *= 2;
+		std::vector<unsigned> table(tableSize, no_index);
+		auto& firsts = partitionFirsts[p];
+
+		for (auto i = begin; i < end; ++i)
+		{
+			auto key = order[i];
+			auto slot = size_t(hashes[key]) & (tableSize - 1);
+			while (table[slot] != no_index && !(keys[firsts[table[slot]]] == keys[key]))
+				slot = (slot + 1) & (tableSize - 1);
+			if (table[slot] == no_index)
+			{
+				table[slot] = unsigned(firsts.size());
+				firsts.push_back(key);
+			}
+			localIdcs[key] = table[slot];
+		}
+	});
+
+	// Global numbering by first occurrence
+	firstKeys.clear();
+	for (auto& firsts : partitionFirsts)
+		firstKeys.insert(firstKeys.end(), firsts.begin(), firsts.end());
+	std::sort(firstKeys.begin(), firstKeys.end());
+
+	std::vector< std::vector<unsigned> > globalIdcs(partitionCount);
+	for (size_t p = 0; p < partitionCount; ++p)
+		globalIdcs[p].resize(partitionFirsts[p].size());
+	parallel_blocks(firstKeys.size(), vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto v = begin; v < end; ++v)
+			globalIdcs[partition(firstKeys[v])][localIdcs[firstKeys[v]]] = unsigned(v);
+	});
+
+	vertexIdcs.resize(keyCount);
+	parallel_blocks(keyCount, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto i = begin; i < end; ++i)
+			vertexIdcs[i] = globalIdcs[partition(i)][localIdcs[i]];
+	});
+}
+
+struct MeshStreams
+{
+	bool normals, texcoords, colors;
+};
+
+aiMesh* new_mesh(size_t vertexCount, size_t triangleCount, MeshStreams const& streams)
+{
+	auto mesh = new aiMesh();
+	mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+	mesh->mNumVertices = unsigned(vertexCount);
+	mesh->mVertices = new aiVector3D[vertexCount];
+	if (streams.normals) mesh->mNormals = new aiVector3D[vertexCount];
+	if (streams.texcoords)
+	{
+		mesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+		mesh->mNumUVComponents[0] = 2;
+	}
+	if (streams.colors) mesh->mColors[0] = new aiColor4D[vertexCount];
+
+	mesh->mNumFaces = unsigned(triangleCount);
+	mesh->mFaces = new aiFace[triangleCount];
+	parallel_blocks(triangleCount, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+		{
+			mesh->mFaces[t].mNumIndices = 3;
+			mesh->mFaces[t].mIndices = new unsigned[3];
+		}
+	});
+	return mesh;
+}
+
+// Copies the pool attributes of the given corners to the mesh vertices.
+void fill_vertices(aiMesh& mesh, RawGeometry const& geometry, Corner const* corners, unsigned const* cornerIdcs)
+{
+	parallel_blocks(mesh.mNumVertices, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto v = begin; v < end; ++v)
+		{
+			auto& corner = corners[cornerIdcs ? cornerIdcs[v] : v];
+			mesh.mVertices[v] = geometry.positions[corner.position];
+			if (mesh.mNormals)
+				mesh.mNormals[v] = (corner.normal != no_index) ? geometry.normals[corner.normal] : aiVector3D();
+			if (mesh.mTextureCoords[0])
+				mesh.mTextureCoords[0][v] = (corner.texcoord != no_index) ? geometry.texcoords[corner.texcoord] : aiVector3D();
+			if (mesh.mColors[0])
+				mesh.mColors[0][v] = geometry.colors[corner.position];
+		}
+	});
+}
+
+void set_face_indices(aiMesh& mesh, unsigned const* vertexIdcs)
+{
+	parallel_blocks(mesh.mNumFaces, vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto t = begin; t < end; ++t)
+			for (unsigned k = 0; k < 3; ++k)
+				mesh.mFaces[t].mIndices[k] = vertexIdcs ? vertexIdcs[3 * t + k] : unsigned(3 * t + k);
+	});
+}
+
+template <class T>
+void compact_stream(T*& stream, std::vector<unsigned> const& firstKeys)
+{
+	if (!stream) return;
+	auto compacted = new T[firstKeys.size()];
+	parallel_blocks(firstKeys.size(), vertex_block_size, [&](size_t begin, size_t end)
+	{
+		for (auto v = begin; v < end; ++v)
+			compacted[v] = stream[firstKeys[v]];
+	});
+	delete[] stream;
+	stream = compacted;
+}
+
+// One mesh per non-empty group, vertices joined by attribute indices. Normals are generated before
+// joining, corners with different generated normals stay separate vertices.
+std::unique_ptr<aiScene> build_scene(RawGeometry const& geometry, std::vector<NamedMaterial>& materials, std::string const& name
+	, NativeImportSettings const& settings, std::string& unsupported)
+{
+	unsigned discardFlags = (settings.processFlags & aiProcess_RemoveComponent) ? settings.discardFlags : 0;
+	bool generateNormals = (settings.processFlags & aiProcess_GenSmoothNormals) != 0 && !(discardFlags & aiComponent_NORMALS);
+
+	std::vector<unsigned> groups;
+	for (unsigned g = 0; g < geometry.groupMaterials.size(); ++g)
+		if (geometry.groupOffsets[g + 1] > geometry.groupOffsets[g])
+			groups.push_back(g);
+	if (groups.empty())
+	{
+		unsupported = "no triangles";
+		return nullptr;
+	}
+	if (geometry.corners.size() >= no_index)
+	{
+		unsupported = "more than 4G triangle corners";
+		return nullptr;
+	}
+
+	// Unreferenced materials are dropped like by aiProcess_RemoveRedundantMaterials
+	std::vector<unsigned> materialIdcs(materials.size());
+	std::vector<NamedMaterial*> sceneMaterials;
+	for (unsigned m = 0; m < materials.size(); ++m)
+	{
+		bool used = std::any_of(groups.begin(), groups.end(), [&](unsigned g) { return geometry.groupMaterials[g] == m; });
+		if (!used && (settings.processFlags & aiProcess_RemoveRedundantMaterials)) continue;
+		materialIdcs[m] = unsigned(sceneMaterials.size());
+		sceneMaterials.push_back(&materials[m]);
+	}
+
+	std::unique_ptr<aiScene> scene(new aiScene());
+	scene->mNumMeshes = unsigned(groups.size());
+	scene->mMeshes = new aiMesh*[groups.size()]();
+
+	std::vector<unsigned> vertexIdcs, firstKeys;
+	std::vector<VertexKey> keys;
+	std::vector<bool> unjoined(groups.size(), false);
+
+	for (size_t g = 0; g < groups.size(); ++g)
+	{
+		auto m = geometry.groupMaterials[groups[g]];
+		auto corners = geometry.corners.data() + geometry.groupOffsets[groups[g]];
+		size_t cornerCount = geometry.groupOffsets[groups[g] + 1] - geometry.groupOffsets[groups[g]];
+
+		MeshStreams streams = {
+			  !(discardFlags & aiComponent_NORMALS) && std::any_of(corners, corners + cornerCount, [](Corner const& c) { return c.normal != no_index; })
+			, !(discardFlags & aiComponent_TEXCOORDS) && std::any_of(corners, corners + cornerCount, [](Corner const& c) { return c.texcoord != no_index; })
+			, !(discardFlags & aiComponent_COLORS) && !geometry.colors.empty()
+		};
+
+		aiMesh* mesh;
+		if (!streams.normals && generateNormals)
+		{
+			// Joined below, after generating normals
+			mesh = new_mesh(cornerCount, cornerCount / 3, streams);
+			fill_vertices(*mesh, geometry, corners, nullptr);
+			set_face_indices(*mesh, nullptr);
+			unjoined[g] = true;
+		}
+		else
+		{
+			keys.resize(cornerCount);
+			parallel_blocks(cornerCount, vertex_block_size, [&](size_t begin, size_t end)
+			{
+				for (auto i = begin; i < end; ++i)
+				{
+					VertexKey key = { { corners[i].position, streams.texcoords ? corners[i].texcoord : 0, streams.normals ? corners[i].normal : 0, 0, 0 } };
+					keys[i] = key;
+				}
+			});
+			join_keys(vertexIdcs, firstKeys, keys);
+
+			mesh = new_mesh(firstKeys.size(), cornerCount / 3, streams);
+			fill_vertices(*mesh, geometry, corners, firstKeys.data());
+			set_face_indices(*mesh, vertexIdcs.data());
+		}
+
+		mesh->mMaterialIndex = materialIdcs[m];
+		mesh->mName.Set(geometry.groupObjects.empty() ? materials[m].name : geometry.objectNames[geometry.groupObjects[groups[g]]]);
+		scene->mMeshes[g] = mesh;
+	}
+
+	if (generateNormals && std::find(unjoined.begin(), unjoined.end(), true) != unjoined.end())
+	{
+		generate_smooth_normals(*scene, settings.smoothingAngle);
+
+		for (size_t g = 0; g < groups.size(); ++g)
+		{
+			if (!unjoined[g]) continue;
+			auto& mesh = *scene->mMeshes[g];
+			auto corners = geometry.corners.data() + geometry.groupOffsets[groups[g]];
+
+			keys.resize(mesh.mNumVertices);
+			parallel_blocks(mesh.mNumVertices, vertex_block_size, [&](size_t begin, size_t end)
+			{
+				for (auto i = begin; i < end; ++i)
+				{
+					VertexKey key = { { corners[i].position, mesh.mTextureCoords[0] ? corners[i].texcoord : 0, 0, 0, 0 } };
+					memcpy(key.c + 2, &mesh.mNormals[i], sizeof(aiVector3D));
+					keys[i] = key;
+				}
+			});
+			join_keys(vertexIdcs, firstKeys, keys);
+
+			compact_stream(mesh.mVertices, firstKeys);
+			compact_stream(mesh.mNormals, firstKeys);
+			compact_stream(mesh.mTextureCoords[0], firstKeys);
+			compact_stream(mesh.mColors[0], firstKeys);
+			mesh.mNumVertices = unsigned(firstKeys.size());
+			set_face_indices(mesh, vertexIdcs.data());
+		}
+	}
+
+	if (settings.processFlags & aiProcess_CalcTangentSpace)
+		generate_tangents(*scene);
+
+	scene->mNumMaterials = unsigned(sceneMaterials.size());
+	scene->mMaterials = new aiMaterial*[sceneMaterials.size()];
+	for (size_t i = 0; i < sceneMaterials.size(); ++i)
+		scene->mMaterials[i] = sceneMaterials[i]->material.release();
+
+	scene->mRootNode = new aiNode();
+	scene->mRootNode->mName.Set(name);
+	if (geometry.groupObjects.empty())
+	{
+		scene->mRootNode->mNumMeshes = scene->mNumMeshes;
+		scene->mRootNode->mMeshes = new unsigned[scene->mNumMeshes];
+		for (unsigned i = 0; i < scene->mNumMeshes; ++i)
+			scene->mRootNode->mMeshes[i] = i;
+	}
+	else
+	{
+		// One child node per object like Assimp, groups are ordered by object
+		std::vector<aiNode*> children;
+		for (unsigned g = 0; g < groups.size(); ++g)
+		{
+			auto object = geometry.groupObjects[groups[g]];
+			unsigned end = g + 1;
+			while (end < groups.size() && geometry.groupObjects[groups[end]] == object) ++end;
+
+			auto node = new aiNode();
+			node->mName.Set(geometry.objectNames[object]);
+			node->mParent = scene->mRootNode;
+			node->mNumMeshes = end - g;
+			node->mMeshes = new unsigned[end - g];
+			for (unsigned i = g; i < end; ++i)
+				node->mMeshes[i - g] = i;
+			children.push_back(node);
+			g = end - 1;
+		}
+		scene->mRootNode->mNumChildren = unsigned(children.size());
+		scene->mRootNode->mChildren = new aiNode*[children.size()];
+		std::copy(children.begin(), children.end(), scene->mRootNode->mChildren);
+	}
+
+	return scene;
+}
+
+std::unique_ptr<aiScene> import_obj(char const* path, char const* data, size_t size, Assimp::IOSystem& ioSystem
+	, NativeImportSettings const& settings, std::string& unsupported)
+{
+	auto ranges = split_lines(data, data + size);
+	std::vector<ParsedChunk> chunks(ranges.size());
+
+	parallel_for(chunks.size(), [&](size_t i) { count_obj_attributes(chunks[i], ranges[i].first, ranges[i].second); });
+
+	size_t positionCount = 0, normalCount = 0, texcoordCount = 0;
+	for (auto& chunk : chunks)
+	{
+		chunk.positionBase = positionCount;
+		chunk.normalBase = normalCount;
+		chunk.texcoordBase = texcoordCount;
+		positionCount += chunk.positionCount;
+		normalCount += chunk.normalCount;
+		texcoordCount += chunk.texcoordCount;
+	}
+	if (positionCount >= no_index || normalCount >= no_index || texcoordCount >= no_index)
+	{
+		unsupported = "more than 4G vertices";
+		return nullptr;
+	}
+
+	parallel_for(chunks.size(), [&](size_t i) { parse_obj_chunk(chunks[i], ranges[i].first, ranges[i].second, positionCount, normalCount, texcoordCount); });
+	for (auto& chunk : chunks)
+		if (chunk.unsupported)
+		{
+			unsupported = chunk.unsupported;
+			return nullptr;
+		}
+
+	// Concatenate attribute pools
+	RawGeometry geometry;
+	geometry.positions.resize(positionCount);
+	geometry.normals.resize(normalCount);
+	geometry.texcoords.resize(texcoordCount);
+	bool hasColors = std::any_of(chunks.begin(), chunks.end(), [](ParsedChunk const& chunk) { return !chunk.colors.empty(); });
+	if (hasColors) geometry.colors.resize(positionCount, aiColor4D(1.0f, 1.0f, 1.0f, 1.0f));
+	parallel_for(chunks.size(), [&](size_t i)
+	{
+		auto& chunk = chunks[i];
+		std::copy(chunk.positions.begin(), chunk.positions.end(), geometry.positions.begin() + chunk.positionBase);
+		std::copy(chunk.normals.begin(), chunk.normals.end(), geometry.normals.begin() + chunk.normalBase);
+		std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), geometry.texcoords.begin() + chunk.texcoordBase);
+		std::copy(chunk.colors.begin(), chunk.colors.end(), geometry.colors.begin() + chunk.positionBase);
+		decltype(chunk.positions)().swap(chunk.positions);
+		decltype(chunk.normals)().swap(chunk.normals);
+		decltype(chunk.texcoords)().swap(chunk.texcoords);
+		decltype(chunk.colors)().swap(chunk.colors);
+	});
+
+	// Materials, the default material is used for faces without (known) material
+	std::vector<NamedMaterial> materials;
+	std::map<std::string, unsigned> materialIdcs;
+	{
+		NamedMaterial defaultMaterial = { AI_DEFAULT_MATERIAL_NAME, new_obj_material(AI_DEFAULT_MATERIAL_NAME) };
+		materials.push_back(std::move(defaultMaterial));
+	}
+
+	std::string directory(path);
+	directory.erase(directory.find_last_of("/\\") + 1);
+	std::vector<std::string> loadedLibs;
+	for (auto& chunk : chunks)
+		for (auto& lib : chunk.materialLibs)
+			if (std::find(loadedLibs.begin(), loadedLibs.end(), lib) == loadedLibs.end())
+			{
+				loadedLibs.push_back(lib);
+				if (!load_obj_materials(materials, materialIdcs, directory + lib, ioSystem, unsupported))
+					return nullptr;
+			}
+
+	// Triangles are grouped by object & material like by Assimp, objects are only joined where
+	// Assimp's post-processing would join their meshes by material
+	bool joinObjects = (settings.processFlags & aiProcess_PreTransformVertices)
+		|| (settings.processFlags & (aiProcess_OptimizeGraph | aiProcess_OptimizeMeshes)) == (aiProcess_OptimizeGraph | aiProcess_OptimizeMeshes);
+	std::map<std::string, unsigned> objectIdcs;
+	std::map<std::pair<unsigned, unsigned>, unsigned> groupIdcs; // (object, material) -> group in order of first use
+	geometry.objectNames.push_back("defaultobject");
+
+	unsigned material = 0, object = 0;
+	auto&& currentGroup = [&]() -> unsigned
+	{
+		auto key = std::make_pair(joinObjects ? 0U : object, settings.geometryOnly ? 0U : material);
+		return groupIdcs.insert(std::make_pair(key, unsigned(groupIdcs.size()))).first->second;
+	};
+	for (auto& chunk : chunks)
+	{
+		chunk.firstGroup = currentGroup();
+		for (size_t mi = 0, oi = 0; mi < chunk.materialSwitches.size() || oi < chunk.objectSwitches.size(); )
+		{
+			GroupSwitch groupSwitch;
+			if (oi == chunk.objectSwitches.size() || (mi < chunk.materialSwitches.size() && chunk.materialSwitches[mi].triangle <= chunk.objectSwitches[oi].triangle))
+			{
+				auto it = materialIdcs.find(chunk.materialSwitches[mi].name);
+				material = (it != materialIdcs.end()) ? it->second : 0;
+				groupSwitch.triangle = chunk.materialSwitches[mi++].triangle;
+			}
+			else
+			{
+				auto& name = chunk.objectSwitches[oi].name;
+				object = objectIdcs.insert(std::make_pair(name, unsigned(geometry.objectNames.size()))).first->second;
+				if (object == geometry.objectNames.size())
+					geometry.objectNames.push_back(name);
+				groupSwitch.triangle = chunk.objectSwitches[oi++].triangle;
+			}
+			groupSwitch.group = currentGroup();
+			chunk.groupSwitches.push_back(groupSwitch);
+		}
+	}
+
+	// Meshes ordered by object, then material
+	std::vector<unsigned> groupOrder(groupIdcs.size());
+	for (auto& group : groupIdcs)
+	{
+		groupOrder[group.second] = unsigned(geometry.groupMaterials.size());
+		geometry.groupMaterials.push_back(group.first.second);
+		if (!joinObjects)
+			geometry.groupObjects.push_back(group.first.first);
+	}
+	for (auto& chunk : chunks)
+	{
+		chunk.firstGroup = groupOrder[chunk.firstGroup];
+		for (auto& groupSwitch : chunk.groupSwitches)
+			groupSwitch.group = groupOrder[groupSwitch.group];
+	}
+
+	group_triangles(geometry, chunks);
+	std::vector<ParsedChunk>().swap(chunks);
+
+	return build_scene(geometry, materials, stdx::basename(path), settings, unsupported);
+}
+
+} // namespace
+
+bool native_import_supports(char const* path)
+{
+	size_t length = strlen(path);
+	return length > 4 && (stdx::strieq(path + length - 4, ".obj") || stdx::strieq(path + length - 4, ".ply"));
+}
+
+std::unique_ptr<aiScene> import_native(char const* path, Assimp::IOSystem& ioSystem, NativeImportSettings const& settings, std::string& unsupported)
+{
+	MappedFile file(path);
+	return import_native(path, file.data(), file.size(), ioSystem, settings, unsupported);
+}
+
+std::unique_ptr<aiScene> import_native(char const* path, char const* data, size_t size, Assimp::IOSystem& ioSystem
+	, NativeImportSettings const& settings, std::string& unsupported)
+{
+	if ((settings.processFlags & ~native_process_flags) != 0 || (settings.processFlags & native_required_flags) != native_required_flags)
+	{
+		unsupported = "post-processing steps";
+		return nullptr;
+	}
+	if ((settings.processFlags & aiProcess_RemoveComponent) && (settings.discardFlags & ~native_discard_flags) != 0)
+	{
+		unsupported = "removed components";
+		return nullptr;
+	}
+
+	size_t length = strlen(path);
+	if (stdx::strieq(path + length - 4, ".obj"))
+		return import_obj(path, data, size, ioSystem, settings, unsupported);
+
+	RawGeometry geometry;
+	std::vector<ParsedChunk> chunks;
+	char const* failure = nullptr;
+	if (!import_ply(geometry, chunks, data, size, failure))
+	{
+		unsupported = failure;
+		return nullptr;
+	}
+	for (auto& chunk : chunks)
+		if (chunk.unsupported)
+		{
+			unsupported = chunk.unsupported;
+			return nullptr;
+		}
+
+	std::vector<NamedMaterial> materials;
+	{
+		NamedMaterial defaultMaterial = { AI_DEFAULT_MATERIAL_NAME, std::unique_ptr<aiMaterial>(new aiMaterial()) };
+		aiString name(defaultMaterial.name);
+		defaultMaterial.material->AddProperty(&name, AI_MATKEY_NAME);
+		materials.push_back(std::move(defaultMaterial));
+	}
+
+	geometry.groupMaterials.push_back(0);
+	group_triangles(geometry, chunks);
+	std::vector<ParsedChunk>().swap(chunks);
+
+	return build_scene(geometry, materials, "<PLYRoot>", settings, unsupported);
+}
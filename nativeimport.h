@@ -0,0 +1,31 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+struct aiScene;
+namespace Assimp { class IOSystem; }
+
+// Subset of the import settings the native importer honors.
+struct NativeImportSettings
+{
+	unsigned processFlags = 0;     // aiProcess_* steps the result must reflect
+	unsigned discardFlags = 0;     // aiComponent_* removed by aiProcess_RemoveComponent
+	float smoothingAngle = 45.0f;  // for aiProcess_GenSmoothNormals
+	bool geometryOnly = false;     // all triangles use material 0
+};
+
+// True for file types the native importer may handle (OBJ & binary PLY).
+bool native_import_supports(char const* path);
+
+// Parses OBJ (with MTL material libraries) & binary PLY files in parallel chunks from a memory
+// mapping, returning a scene equivalent to Assimp's import post-processed by the given steps:
+// triangles grouped into one mesh per OBJ object & material, one child node per object, unless
+// the given steps join the objects' meshes by material; vertices joined by their attribute indices.
+// Material libraries are opened through the given IO system. Returns null & the reason if the
+// file or the requested processing uses features not supported natively, which are left to Assimp.
+std::unique_ptr<aiScene> import_native(char const* path, Assimp::IOSystem& ioSystem, NativeImportSettings const& settings, std::string& unsupported);
+
+// As above, parsing the given contents of the file at path, e.g. bytes that were read ahead.
+std::unique_ptr<aiScene> import_native(char const* path, char const* data, size_t size, Assimp::IOSystem& ioSystem
+	, NativeImportSettings const& settings, std::string& unsupported);
@@ -0,0 +1,412 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include <assimp/scene.h>
+#include <assimp/mesh.h>
+
+#include "normals.h"
+#include "hash.h"
+#include "parallel.h"
+
+namespace
+{
+
+// Work items of large meshes are split into chunks of this many faces or vertices
+unsigned const normals_chunk_size = 1U << 14U;
+
+// Assimp's position epsilon relative to the bounding box diagonal
+float const position_epsilon = 1.0e-4f;
+
+inline aiVector3D sub(aiVector3D const& a, aiVector3D const& b) { return aiVector3D(a.x - b.x, a.y - b.y, a.z - b.z); }
+inline aiVector3D cross(aiVector3D const& a, aiVector3D const& b) { return aiVector3D(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+inline float dot(aiVector3D const& a, aiVector3D const& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+
+inline void add_scaled(aiVector3D& sum, aiVector3D const& v, float s)
+{
+	sum.x += v.x * s;
+	sum.y += v.y * s;
+	sum.z += v.z * s;
+}
+
+// Unit vector, or zero for (near) zero vectors
+inline aiVector3D normalized(aiVector3D const& v)
+{
+	float len = std::sqrt(dot(v, v));
+	return (len > 1.0e-20f) ? aiVector3D(v.x / len, v.y / len, v.z / len) : aiVector3D();
+}
+
+inline bool is_zero(aiVector3D const& v) { return v.x == 0.0f && v.y == 0.0f && v.z == 0.0f; }
+
+struct MeshWork
+{
+	aiMesh* mesh;
+
+	// Per face & face corner
+	std::vector<aiVector3D> faceNormals;
+	std::vector<aiVector3D> faceTangents, faceBitangents;
+	std::vector<float> cornerAngles;
+
+	// Vertex -> corners (face * 3 + corner)
+	std::vector<unsigned> cornerOffsets;
+	std::vector<unsigned> corners;
+
+	// Vertex lookup, vertices sorted by key
+	std::vector<std::uint64_t> keys;
+	std::vector<unsigned> keyVertices;
+	std::vector<unsigned> keyRanks; // vertex -> position in keyVertices
+
+	float epsilon = 0.0f;
+};
+
+struct WorkChunk
+{
+	MeshWork* work;
+	unsigned begin, end;
+};
+
+template <class Count>
+std::vector<WorkChunk> make_chunks(std::vector<MeshWork>& works, Count&& count)
+{
+	std::vector<WorkChunk> chunks;
+	for (auto& work : works)
+		for (unsigned begin = 0, end = count(*work.mesh); begin < end; begin += normals_chunk_size)
+		{
+			WorkChunk chunk = { &work, begin, std::min(begin + normals_chunk_size, end) };
+			chunks.push_back(chunk);
+		}
+	return chunks;
+}
+
+// Unit face normals & corner angles of the given faces, zero for degenerate & non-triangle faces.
+void compute_face_geometry(MeshWork& work, unsigned faceBegin, unsigned faceEnd)
+{
+	auto& mesh = *work.mesh;
+	for (auto f = faceBegin; f < faceEnd; ++f)
+	{
+		auto& face = mesh.mFaces[f];
+		work.faceNormals[f] = aiVector3D();
+		work.cornerAngles[3 * f] = work.cornerAngles[3 * f + 1] = work.cornerAngles[3 * f + 2] = 0.0f;
+		if (face.mNumIndices != 3) continue;
+
+		aiVector3D const* p[3] = { &mesh.mVertices[face.mIndices[0]], &mesh.mVertices[face.mIndices[1]], &mesh.mVertices[face.mIndices[2]] };
+		work.faceNormals[f] = normalized(cross(sub(*p[1], *p[0]), sub(*p[2], *p[0])));
+		if (is_zero(work.faceNormals[f])) continue;
+
+		for (int c = 0; c < 3; ++c)
+		{
+			auto e1 = normalized(sub(*p[(c + 1) % 3], *p[c]));
+			auto e2 = normalized(sub(*p[(c + 2) % 3], *p[c]));
+			work.cornerAngles[3 * f + c] = std::acos(std::max(-1.0f, std::min(1.0f, dot(e1, e2))));
+		}
+	}
+}
+
+// MikkTSpace-style face tangent frame: unit directions of increasing u & v, zero for degenerate mappings.
+void compute_face_tangents(MeshWork& work, unsigned faceBegin, unsigned faceEnd)
+{
+	auto& mesh = *work.mesh;
+	auto uvs = mesh.mTextureCoords[0];
+	for (auto f = faceBegin; f < faceEnd; ++f)
+	{
+		auto& face = mesh.mFaces[f];
+		work.faceTangents[f] = work.faceBitangents[f] = aiVector3D();
+		if (face.mNumIndices != 3) continue;
+
+		auto i0 = face.mIndices[0], i1 = face.mIndices[1], i2 = face.mIndices[2];
+		auto e1 = sub(mesh.mVertices[i1], mesh.mVertices[i0]), e2 = sub(mesh.mVertices[i2], mesh.mVertices[i0]);
+		float du1 = uvs[i1].x - uvs[i0].x, dv1 = uvs[i1].y - uvs[i0].y;
+		float du2 = uvs[i2].x - uvs[i0].x, dv2 = uvs[i2].y - uvs[i0].y;
+
+		float area = du1 * dv2 - du2 * dv1;
+		if (area == 0.0f) continue;
+		float orientation = (area > 0.0f) ? 1.0f : -1.0f;
+
+		aiVector3D t, b;
+		add_scaled(t, e1, dv2 * orientation);
+		add_scaled(t, e2, -dv1 * orientation);
+		add_scaled(b, e2, du1 * orientation);
+		add_scaled(b, e1, -du2 * orientation);
+		work.faceTangents[f] = normalized(t);
+		work.faceBitangents[f] = normalized(b);
+	}
+}
+
+// Counting sort of all face corners by vertex.
+void build_corner_adjacency(MeshWork& work)
+{
+	auto& mesh = *work.mesh;
+	work.cornerOffsets.assign(mesh.mNumVertices + 1, 0);
+	for (unsigned f = 0; f < mesh.mNumFaces; ++f)
+		if (mesh.mFaces[f].mNumIndices == 3)
+			for (int c = 0; c < 3; ++c)
+				++work.cornerOffsets[mesh.mFaces[f].mIndices[c] + 1];
+	for (unsigned v = 0; v < mesh.mNumVertices; ++v)
+		work.cornerOffsets[v + 1] += work.cornerOffsets[v];
+
+	work.corners.resize(work.cornerOffsets.back());
+	std::vector<unsigned> cursor(work.cornerOffsets.begin(), work.cornerOffsets.end() - 1);
+	for (unsigned f = 0; f < mesh.mNumFaces; ++f)
+		if (mesh.mFaces[f].mNumIndices == 3)
+			for (unsigned c = 0; c < 3; ++c)
+				work.corners[cursor[mesh.mFaces[f].mIndices[c]]++] = 3 * f + c;
+}
+
+inline std::uint64_t cell_key(std::int64_t x, std::int64_t y, std::int64_t z)
+{
+	return std::uint64_t(x) * 0x9E3779B97F4A7C15ULL ^ std::uint64_t(y) * 0xC2B2AE3D27D4EB4FULL ^ std::uint64_t(z) * 0x165667B19E3779F9ULL;
+}
+
+inline std::int64_t cell_coord(float x, float cellSize)
+{
+	return std::int64_t(std::floor(x / cellSize));
+}
+
+void sort_by_keys(MeshWork& work)
+{
+	auto vertexCount = work.mesh->mNumVertices;
+	work.keyVertices.resize(vertexCount);
+	for (unsigned v = 0; v < vertexCount; ++v)
+		work.keyVertices[v] = v;
+	std::sort(work.keyVertices.begin(), work.keyVertices.end(), [&](unsigned a, unsigned b) { return work.keys[a] < work.keys[b] || (work.keys[a] == work.keys[b] && a < b); });
+
+	std::vector<std::uint64_t> sortedKeys(vertexCount);
+	work.keyRanks.resize(vertexCount);
+	for (unsigned i = 0; i < vertexCount; ++i)
+	{
+		sortedKeys[i] = work.keys[work.keyVertices[i]];
+		work.keyRanks[work.keyVertices[i]] = i;
+	}
+	work.keys.swap(sortedKeys);
+}
+
+// Spatial hash of vertex positions with cells no smaller than the position epsilon.
+void build_position_lookup(MeshWork& work)
+{
+	auto& mesh = *work.mesh;
+
+	aiVector3D min = mesh.mVertices[0], max = mesh.mVertices[0];
+	for (unsigned v = 1; v < mesh.mNumVertices; ++v)
+	{
+		auto& p = mesh.mVertices[v];
+		min = aiVector3D(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+		max = aiVector3D(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+	}
+	work.epsilon = std::max(std::sqrt(dot(sub(max, min), sub(max, min))) * position_epsilon, 1.0e-30f);
+
+	work.keys.resize(mesh.mNumVertices);
+	for (unsigned v = 0; v < mesh.mNumVertices; ++v)
+	{
+		auto& p = mesh.mVertices[v];
+		work.keys[v] = cell_key(cell_coord(p.x, work.epsilon), cell_coord(p.y, work.epsilon), cell_coord(p.z, work.epsilon));
+	}
+	sort_by_keys(work);
+}
+
+// Exact lookup of vertices with identical position, normal & tex coords.
+void build_identity_lookup(MeshWork& work)
+{
+	auto& mesh = *work.mesh;
+	work.keys.resize(mesh.mNumVertices);
+	for (unsigned v = 0; v < mesh.mNumVertices; ++v)
+	{
+		Hasher hasher;
+		hasher.add_value(mesh.mVertices[v]);
+		hasher.add_value(mesh.mNormals[v]);
+		hasher.add_value(mesh.mTextureCoords[0][v]);
+		work.keys[v] = hasher.result();
+	}
+	sort_by_keys(work);
+}
+
+void smooth_normals(MeshWork& work, unsigned vertexBegin, unsigned vertexEnd, float cosLimit, bool limitAngle)
+{
+	auto& mesh = *work.mesh;
+	float epsilonSq = work.epsilon * work.epsilon;
+
+	for (auto v = vertexBegin; v < vertexEnd; ++v)
+	{
+		// Own faces
+		aiVector3D reference;
+		for (auto c = work.cornerOffsets[v]; c < work.cornerOffsets[v + 1]; ++c)
+			add_scaled(reference, work.faceNormals[work.corners[c] / 3], work.cornerAngles[work.corners[c]]);
+		reference = normalized(reference);
+
+		aiVector3D sum;
+		if (!is_zero(reference))
+		{
+			auto& p = mesh.mVertices[v];
+			auto cx = cell_coord(p.x, work.epsilon), cy = cell_coord(p.y, work.epsilon), cz = cell_coord(p.z, work.epsilon);
+
+			std::uint64_t visited[27];
+			unsigned visitedCount = 0;
+			for (int dz = -1; dz <= 1; ++dz)
+				for (int dy = -1; dy <= 1; ++dy)
+					for (int dx = -1; dx <= 1; ++dx)
+					{
+						auto key = cell_key(cx + dx, cy + dy, cz + dz);
+						if (std::find(visited, visited + visitedCount, key) != visited + visitedCount) continue; // hash collision
+						visited[visitedCount++] = key;
+
+						auto range = std::equal_range(work.keys.begin(), work.keys.end(), key);
+						for (auto it = range.first; it != range.second; ++it)
+						{
+							auto u = work.keyVertices[it - work.keys.begin()];
+							auto d = sub(mesh.mVertices[u], p);
+							if (dot(d, d) > epsilonSq) continue;
+
+							for (auto c = work.cornerOffsets[u]; c < work.cornerOffsets[u + 1]; ++c)
+							{
+								auto& faceNormal = work.faceNormals[work.corners[c] / 3];
+								if (!limitAngle || dot(faceNormal, reference) >= cosLimit)
+									add_scaled(sum, faceNormal, work.cornerAngles[work.corners[c]]);
+							}
+						}
+					}
+		}
+
+		auto normal = normalized(sum);
+		mesh.mNormals[v] = is_zero(normal) ? reference : normal;
+	}
+}
+
+void accumulate_tangents(MeshWork& work, unsigned vertexBegin, unsigned vertexEnd)
+{
+	auto& mesh = *work.mesh;
+
+	for (auto v = vertexBegin; v < vertexEnd; ++v)
+	{
+		auto n = normalized(mesh.mNormals[v]);
+		aiVector3D sumT, sumB;
+
+		// All identical vertices, adjacent in key order
+		auto rank = work.keyRanks[v];
+		auto first = rank, last = rank + 1;
+		while (first > 0 && work.keys[first - 1] == work.keys[rank]) --first;
+		while (last < work.keys.size() && work.keys[last] == work.keys[rank]) ++last;
+
+		for (auto i = first; i < last; ++i)
+		{
+			auto u = work.keyVertices[i];
+			if (u != v && (memcmp(&mesh.mVertices[u], &mesh.mVertices[v], sizeof(aiVector3D)) != 0
+				|| memcmp(&mesh.mNormals[u], &mesh.mNormals[v], sizeof(aiVector3D)) != 0
+				|| memcmp(&mesh.mTextureCoords[0][u], &mesh.mTextureCoords[0][v], sizeof(aiVector3D)) != 0))
+				continue;
+
+			for (auto c = work.cornerOffsets[u]; c < work.cornerOffsets[u + 1]; ++c)
+			{
+				auto f = work.corners[c] / 3;
+				if (is_zero(work.faceTangents[f])) continue;
+
+				auto t = work.faceTangents[f];
+				add_scaled(t, n, -dot(n, t));
+				add_scaled(sumT, normalized(t), work.cornerAngles[work.corners[c]]);
+				add_scaled(sumB, work.faceBitangents[f], work.cornerAngles[work.corners[c]]);
+			}
+		}
+
+		auto tangent = sumT;
+		add_scaled(tangent, n, -dot(n, tangent));
+		tangent = normalized(tangent);
+		if (is_zero(tangent))
+		{
+			// Degenerate mapping, any direction orthogonal to the normal
+			tangent = normalized(std::abs(n.x) < 0.9f ? cross(n, aiVector3D(1.0f, 0.0f, 0.0f)) : cross(n, aiVector3D(0.0f, 1.0f, 0.0f)));
+		}
+
+		auto bitangent = cross(n, tangent);
+		if (dot(bitangent, sumB) < 0.0f)
+			bitangent = aiVector3D(-bitangent.x, -bitangent.y, -bitangent.z);
+
+		mesh.mTangents[v] = tangent;
+		mesh.mBitangents[v] = bitangent;
+	}
+}
+
+} // namespace
+
+void generate_smooth_normals(aiScene& scene, float maxSmoothingAngle)
+{
+	std::vector<MeshWork> works;
+	for (unsigned i = 0; i < scene.mNumMeshes; ++i)
+	{
+		auto& mesh = *scene.mMeshes[i];
+		if (mesh.mNormals || !mesh.HasPositions() || !mesh.HasFaces()) continue;
+
+		works.emplace_back();
+		auto& work = works.back();
+		work.mesh = &mesh;
+		work.faceNormals.resize(mesh.mNumFaces);
+		work.cornerAngles.resize(3 * size_t(mesh.mNumFaces));
+	}
+	if (works.empty()) return;
+
+	auto faceChunks = make_chunks(works, [](aiMesh const& mesh) { return mesh.mNumFaces; });
+	parallel_for(faceChunks.size(), [&](size_t i)
+	{
+		compute_face_geometry(*faceChunks[i].work, faceChunks[i].begin, faceChunks[i].end);
+	});
+
+	parallel_for(works.size(), [&](size_t i)
+	{
+		build_corner_adjacency(works[i]);
+		build_position_lookup(works[i]);
+		works[i].mesh->mNormals = new aiVector3D[works[i].mesh->mNumVertices];
+	});
+
+	// Assimp also skips the angle test for limits close to 180 degrees
+	bool limitAngle = (maxSmoothingAngle < 175.0f);
+	float cosLimit = std::cos(maxSmoothingAngle * 3.14159265358979f / 180.0f);
+
+	auto vertexChunks = make_chunks(works, [](aiMesh const& mesh) { return mesh.mNumVertices; });
+	parallel_for(vertexChunks.size(), [&](size_t i)
+	{
+		smooth_normals(*vertexChunks[i].work, vertexChunks[i].begin, vertexChunks[i].end, cosLimit, limitAngle);
+	});
+}
+
+void generate_tangents(aiScene& scene)
+{
+	std::vector<MeshWork> works;
+	for (unsigned i = 0; i < scene.mNumMeshes; ++i)
+	{
+		auto& mesh = *scene.mMeshes[i];
+		if (mesh.mTangents || !mesh.mNormals || !mesh.HasTextureCoords(0) || !mesh.HasPositions() || !mesh.HasFaces()) continue;
+
+		works.emplace_back();
+		auto& work = works.back();
+		work.mesh = &mesh;
+		work.faceNormals.resize(mesh.mNumFaces);
+		work.faceTangents.resize(mesh.mNumFaces);
+		work.faceBitangents.resize(mesh.mNumFaces);
+		work.cornerAngles.resize(3 * size_t(mesh.mNumFaces));
+	}
+	if (works.empty()) return;
+
+	auto faceChunks = make_chunks(works, [](aiMesh const& mesh) { return mesh.mNumFaces; });
+	parallel_for(faceChunks.size(), [&](size_t i)
+	{
+		compute_face_geometry(*faceChunks[i].work, faceChunks[i].begin, faceChunks[i].end);
+		compute_face_tangents(*faceChunks[i].work, faceChunks[i].begin, faceChunks[i].end);
+	});
+
+	parallel_for(works.size(), [&](size_t i)
+	{
+		build_corner_adjacency(works[i]);
+		build_identity_lookup(works[i]);
+		works[i].mesh->mTangents = new aiVector3D[works[i].mesh->mNumVertices];
+		works[i].mesh->mBitangents = new aiVector3D[works[i].mesh->mNumVertices];
+	});
+
+	auto vertexChunks = make_chunks(works, [](aiMesh const& mesh) { return mesh.mNumVertices; });
+	parallel_for(vertexChunks.size(), [&](size_t i)
+	{
+		accumulate_tangents(*vertexChunks[i].work, vertexChunks[i].begin, vertexChunks[i].end);
+	});
+}
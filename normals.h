@@ -0,0 +1,17 @@
+#pragma once
+
+// Native, parallel replacements of Assimp's normal & tangent post-processing steps. Both run on
+// post-processed triangle meshes before aiProcess_JoinIdenticalVertices, as Assimp's steps do.
+
+struct aiScene;
+
+// Generates normals for meshes lacking them, like aiProcess_GenSmoothNormals: face normals are
+// averaged over all vertices within a small distance whose faces lie within maxSmoothingAngle
+// degrees of the vertex's own faces, weighted by the face angle at the vertex.
+void generate_smooth_normals(aiScene& scene, float maxSmoothingAngle);
+
+// Generates tangents & bitangents for meshes with normals & tex coords but no tangents, like
+// aiProcess_CalcTangentSpace. Following MikkTSpace, face tangents are projected onto the vertex
+// normal and accumulated weighted by face angle over all vertices with identical position,
+// normal & tex coords, so that identical vertices receive identical tangent frames.
+void generate_tangents(aiScene& scene);
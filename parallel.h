@@ -0,0 +1,134 @@
+#pragma once
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <exception>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+// Process-wide upper bound on worker_count, 0 if unbounded.
+inline std::atomic<unsigned>& worker_limit()
+{
+	static std::atomic<unsigned> limit(0);
+	return limit;
+}
+
+// Bounds worker_count for its lifetime, e.g. while several conversions share the machine.
+class ScopedWorkerLimit
+{
+public:
+	explicit ScopedWorkerLimit(unsigned limit) : previous(worker_limit().exchange(limit)) { }
+	~ScopedWorkerLimit() { worker_limit() = previous; }
+
+	ScopedWorkerLimit(ScopedWorkerLimit const&) = delete;
+	ScopedWorkerLimit& operator =(ScopedWorkerLimit const&) = delete;
+
+private:
+	unsigned previous;
+};
+
+// Number of worker threads available for parallel stages, limited to the given amount of work.
+inline unsigned worker_count(size_t workItems = size_t(-1))
+{
+	size_t workers = std::thread::hardware_concurrency();
+	if (workers == 0) workers = 1;
+	unsigned limit = worker_limit();
+	if (limit != 0 && workers > limit) workers = limit;
+	if (workers > workItems) workers = workItems;
+	return unsigned(workers ? workers : 1);
+}
+
+// Runs fun(i) for all i in [0, count) on up to workerCount threads. Items are handed out
+// dynamically, the first exception thrown by any item is rethrown on the calling thread.
+template <class Fun>
+void parallel_for(size_t count, Fun&& fun, unsigned workerCount = 0)
+{
+	if (workerCount == 0) workerCount = worker_count(count);
+	if (workerCount > count) workerCount = unsigned(count);
+
+	if (workerCount <= 1)
+	{
+		for (size_t i = 0; i < count; ++i)
+			fun(i);
+		return;
+	}
+
+	std::atomic<size_t> nextItem(0);
+	std::exception_ptr error;
+	std::mutex errorMutex;
+
+	auto&& work = [&]()
+	{
+		for (size_t i; (i = nextItem++) < count; )
+		{
+			try
+			{
+				fun(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!error) error = std::current_exception();
+				nextItem = count;
+			}
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve(workerCount - 1);
+	for (unsigned i = 1; i < workerCount; ++i)
+		workers.emplace_back(work);
+	work();
+
+	for (auto& worker : workers)
+		worker.join();
+
+	if (error)
+		std::rethrow_exception(error);
+}
+
+// Blocking FIFO of bounded capacity connecting pipeline stages. Closing wakes all waiting
+// threads: pushes fail from then on, pops drain the remaining items.
+template <class T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity) : capacity(capacity ? capacity : 1) { }
+
+	bool push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&]() { return closed || items.size() < capacity; });
+		if (closed) return false;
+		items.push_back(std::move(item));
+		changed.notify_all();
+		return true;
+	}
+
+	bool pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [&]() { return closed || !items.empty(); });
+		if (items.empty()) return false;
+		item = std::move(items.front());
+		items.pop_front();
+		changed.notify_all();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		changed.notify_all();
+	}
+
+private:
+	size_t capacity;
+	bool closed = false;
+	std::deque<T> items;
+	std::mutex mutex;
+	std::condition_variable changed;
+};
@@ -18,3 +18,5 @@
 #endif
 
 void record_command(const char *tool, const char *file, const char *const *args, size_t argCount);
+// Commands replayed from recorded command files only touch these files, per thread.
+void set_command_replay(bool replay);
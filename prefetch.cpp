@@ -0,0 +1,131 @@
+#include "pch.h"
+
+#include "prefetch.h"
+
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+
+namespace
+{
+
+std::shared_ptr<std::vector<char> const> read_file(char const* path)
+{
+	std::ifstream file(path, std::ios_base::binary | std::ios_base::ate);
+	if (!file) return nullptr;
+
+	auto bytes = std::make_shared< std::vector<char> >(size_t(file.tellg()));
+	file.seekg(0);
+	if (!file.read(bytes->data(), std::streamsize(bytes->size())))
+		return nullptr;
+	return bytes;
+}
+
+// Read-only stream over prefetched bytes, sharing ownership with the IO system.
+class PrefetchedStream : public Assimp::IOStream
+{
+public:
+	explicit PrefetchedStream(std::shared_ptr<std::vector<char> const> bytes) : bytes(std::move(bytes)) { }
+
+	size_t Read(void* buffer, size_t size, size_t count) override
+	{
+		if (size == 0) return 0;
+		count = std::min(count, (bytes->size() - position) / size);
+		memcpy(buffer, bytes->data() + position, size * count);
+		position += size * count;
+		return count;
+	}
+
+	size_t Write(void const*, size_t, size_t) override { return 0; }
+
+	aiReturn Seek(size_t offset, aiOrigin origin) override
+	{
+		size_t base = (origin == aiOrigin_CUR) ? position : (origin == aiOrigin_END) ? bytes->size() : 0;
+		if (offset > bytes->size() - base) return AI_FAILURE;
+		position = base + offset;
+		return AI_SUCCESS;
+	}
+
+	size_t Tell() const override { return position; }
+	size_t FileSize() const override { return bytes->size(); }
+	void Flush() override { }
+
+private:
+	std::shared_ptr<std::vector<char> const> bytes;
+	size_t position = 0;
+};
+
+} // namespace
+
+InputPrefetcher::InputPrefetcher(std::vector<std::string> paths, size_t depth)
+	: queue(depth)
+{
+	reader = std::thread([this](std::vector<std::string> paths)
+	{
+		for (auto& path : paths)
+		{
+			PrefetchedFile file = { path, read_file(path.c_str()) };
+			if (!queue.push(std::move(file))) break;
+		}
+		queue.close();
+	}, std::move(paths));
+}
+
+InputPrefetcher::~InputPrefetcher()
+{
+	queue.close();
+	reader.join();
+}
+
+bool InputPrefetcher::next(PrefetchedFile& file)
+{
+	return queue.pop(file);
+}
+
+PrefetchIOSystem::PrefetchIOSystem(Assimp::IOSystem* inner)
+	: inner(inner ? inner : new Assimp::DefaultIOSystem())
+{
+}
+
+PrefetchIOSystem::~PrefetchIOSystem()
+{
+}
+
+void PrefetchIOSystem::provide(PrefetchedFile file)
+{
+	provided = std::move(file);
+}
+
+std::shared_ptr<std::vector<char> const> PrefetchIOSystem::prefetched(char const* path) const
+{
+	return (provided.path == path) ? provided.bytes : nullptr;
+}
+
+bool PrefetchIOSystem::Exists(char const* path) const
+{
+	return (provided.bytes && provided.path == path) || inner->Exists(path);
+}
+
+char PrefetchIOSystem::getOsSeparator() const
+{
+	return inner->getOsSeparator();
+}
+
+Assimp::IOStream* PrefetchIOSystem::Open(char const* path, char const* mode)
+{
+	// Importers may open their input several times, e.g. to check headers
+	if (provided.bytes && provided.path == path && !strchr(mode, 'w'))
+		return new PrefetchedStream(provided.bytes);
+	return inner->Open(path, mode);
+}
+
+void PrefetchIOSystem::Close(Assimp::IOStream* stream)
+{
+	if (dynamic_cast<PrefetchedStream*>(stream))
+		delete stream;
+	else
+		inner->Close(stream);
+}
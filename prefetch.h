@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include <assimp/IOSystem.hpp>
+
+#include "parallel.h"
+
+// Raw bytes of an input file read ahead of its import, null if reading failed.
+struct PrefetchedFile
+{
+	std::string path;
+	std::shared_ptr<std::vector<char> const> bytes;
+};
+
+// Reads the given files in order on a background thread, keeping up to depth files ahead of
+// their consumers. Stops reading ahead on destruction.
+class InputPrefetcher
+{
+public:
+	InputPrefetcher(std::vector<std::string> paths, size_t depth);
+	~InputPrefetcher();
+
+	InputPrefetcher(InputPrefetcher const&) = delete;
+	InputPrefetcher& operator =(InputPrefetcher const&) = delete;
+
+	// Blocks until the next file in order has been read.
+	bool next(PrefetchedFile& file);
+
+private:
+	BoundedQueue<PrefetchedFile> queue;
+	std::thread reader;
+};
+
+// IO system serving the most recently provided prefetched file from memory, all other files
+// (e.g. material libraries & external buffers) are opened through the wrapped IO system, so
+// that file-relative lookups keep working. Ownership passes to the importer.
+class PrefetchIOSystem : public Assimp::IOSystem
+{
+public:
+	// Takes ownership of the given IO system, defaults to Assimp's if null.
+	explicit PrefetchIOSystem(Assimp::IOSystem* inner = nullptr);
+	~PrefetchIOSystem();
+
+	void provide(PrefetchedFile file);
+	// Bytes of the provided file if it is the given one, null otherwise.
+	std::shared_ptr<std::vector<char> const> prefetched(char const* path) const;
+
+	bool Exists(char const* path) const override;
+	char getOsSeparator() const override;
+	Assimp::IOStream* Open(char const* path, char const* mode = "rb") override;
+	void Close(Assimp::IOStream* stream) override;
+
+private:
+	std::unique_ptr<Assimp::IOSystem> inner;
+	PrefetchedFile provided;
+};
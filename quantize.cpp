@@ -0,0 +1,226 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+
+#include <scenex>
+
+#include "scenefile.h"
+#include "scenepass.h"
+#include "parallel.h"
+#include "simd.h"
+
+namespace
+{
+
+using scenefile::QuantizationSegment;
+
+// Round-to-nearest-even float to half conversion
+std::uint16_t float_to_half(float f)
+{
+	std::uint32_t x;
+	memcpy(&x, &f, sizeof(x));
+
+	std::uint32_t sign = (x >> 16U) & 0x8000U;
+	std::uint32_t absx = x & 0x7FFFFFFFU;
+
+	if (absx >= 0x7F800000U) // inf & nan
+		return std::uint16_t(sign | 0x7C00U | ((absx > 0x7F800000U) ? 0x200U : 0U));
+	if (absx >= 0x477FF000U) // rounds to inf
+		return std::uint16_t(sign | 0x7C00U);
+
+	if (absx < 0x38800000U) // half subnormals
+	{
+		if (absx < 0x33000000U) return std::uint16_t(sign);
+
+		std::uint32_t shift = 126U - (absx >> 23U);
+		std::uint32_t mantissa = (absx & 0x7FFFFFU) | 0x800000U;
+		std::uint32_t h = mantissa >> shift;
+		std::uint32_t rem = mantissa & ((1U << shift) - 1U), halfway = 1U << (shift - 1U);
+		if (rem > halfway || (rem == halfway && (h & 1U))) ++h;
+		return std::uint16_t(sign | h);
+	}
+
+	std::uint32_t h = (absx - 0x38000000U) >> 13U;
+	std::uint32_t rem = absx & 0x1FFFU;
+	if (rem > 0x1000U || (rem == 0x1000U && (h & 1U))) ++h;
+	return std::uint16_t(sign | h);
+}
+
+inline std::int16_t to_snorm16(float v)
+{
+	v = math::clamp(v, -1.0f, 1.0f);
+	return std::int16_t(std::floor(v * 32767.0f + 0.5f));
+}
+
+inline std::uint16_t to_unorm16(float v, float min, float extent)
+{
+	float t = (extent > 0.0f) ? (v - min) / extent : 0.0f;
+	t = math::clamp(t, 0.0f, 1.0f);
+	return std::uint16_t(std::floor(t * 65535.0f + 0.5f));
+}
+
+// Octahedral unit vector encoding (Cigolle et al. 2014)
+inline void encode_octahedral(std::int16_t* out, float const* n)
+{
+	float l1 = std::abs(n[0]) + std::abs(n[1]) + std::abs(n[2]);
+	float u = (l1 > 0.0f) ? n[0] / l1 : 0.0f;
+	float v = (l1 > 0.0f) ? n[1] / l1 : 0.0f;
+
+	if (n[2] < 0.0f)
+	{
+		float fu = (1.0f - std::abs(v)) * ((u >= 0.0f) ? 1.0f : -1.0f);
+		float fv = (1.0f - std::abs(u)) * ((v >= 0.0f) ? 1.0f : -1.0f);
+		u = fu;
+		v = fv;
+	}
+
+	out[0] = to_snorm16(u);
+	out[1] = to_snorm16(v);
+}
+
+// Partitions the vertex array into segments covering mesh vertex ranges, merging overlapping ranges.
+std::vector<QuantizationSegment> build_segments(scene::Scene const& scene)
+{
+	auto ranges = mesh_vertex_ranges(scene);
+	std::sort(ranges.begin(), ranges.end(), [](VertexRange const& a, VertexRange const& b) { return a.first < b.first; });
+
+	std::vector<QuantizationSegment> segments;
+	auto&& addSegment = [&](unsigned first, unsigned last)
+	{
+		QuantizationSegment segment = { first, last - first };
+		segments.push_back(segment);
+	};
+
+	unsigned covered = 0;
+	for (auto& range : ranges)
+	{
+		if (range.first == range.last) continue;
+
+		if (range.first >= covered)
+		{
+			if (range.first > covered)
+				addSegment(covered, range.first); // unreferenced vertices
+			addSegment(range.first, range.last);
+		}
+		else if (range.last > covered)
+			segments.back().vertexCount = range.last - segments.back().firstVertex;
+
+		covered = std::max(covered, range.last);
+	}
+
+	if (covered < scene.positions.size())
+		addSegment(covered, unsigned(scene.positions.size()));
+
+	return segments;
+}
+
+} // namespace
+
+void quantize_vertices(scenefile::Extensions& extensions, scene::Scene& scene, bool unormTexcoords, bool keepFloats)
+{
+	auto segments = build_segments(scene);
+	size_t vertexCount = scene.positions.size();
+
+	std::vector<std::uint16_t> positions(4 * vertexCount);
+	std::vector<std::int16_t> normals(2 * scene.normals.size());
+	std::vector<std::int16_t> tangents(2 * scene.tangents.size());
+	std::vector<std::int16_t> bitangents(2 * scene.bitangents.size());
+	std::vector<std::uint16_t> texcoords(2 * scene.texcoords.size());
+
+	parallel_for(segments.size(), [&](size_t segmentIdx)
+	{
+		auto& segment = segments[segmentIdx];
+		auto first = segment.firstVertex, last = segment.firstVertex + segment.vertexCount;
+
+		// Segment bounds
+		float min[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		simd::minmax_xyz(min, max, scene.positions[first].c, segment.vertexCount);
+		for (int c = 0; c < 3; ++c)
+		{
+			segment.positionMin[c] = min[c];
+			segment.positionExtent[c] = max[c] - min[c];
+		}
+
+		float uvMin[2] = { 0.0f, 0.0f }, uvExtent[2] = { 0.0f, 0.0f };
+		if (unormTexcoords && !scene.texcoords.empty())
+		{
+			float uvMax[2] = { -FLT_MAX, -FLT_MAX };
+			uvMin[0] = uvMin[1] = FLT_MAX;
+			for (auto i = first; i < last; ++i)
+				for (int c = 0; c < 2; ++c)
+				{
+					uvMin[c] = std::min(uvMin[c], scene.texcoords[i].c[c]);
+					uvMax[c] = std::max(uvMax[c], scene.texcoords[i].c[c]);
+				}
+			for (int c = 0; c < 2; ++c)
+				uvExtent[c] = uvMax[c] - uvMin[c];
+		}
+		for (int c = 0; c < 2; ++c)
+		{
+			segment.texcoordMin[c] = uvMin[c];
+			segment.texcoordExtent[c] = uvExtent[c];
+		}
+
+		// Encode
+		for (auto i = first; i < last; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+				positions[4 * i + c] = to_unorm16(scene.positions[i].c[c], segment.positionMin[c], segment.positionExtent[c]);
+			positions[4 * i + 3] = 0;
+
+			if (!scene.normals.empty()) encode_octahedral(&normals[2 * i], scene.normals[i].c);
+			if (!scene.tangents.empty()) encode_octahedral(&tangents[2 * i], scene.tangents[i].c);
+			if (!scene.bitangents.empty()) encode_octahedral(&bitangents[2 * i], scene.bitangents[i].c);
+
+			if (!scene.texcoords.empty())
+				for (int c = 0; c < 2; ++c)
+					texcoords[2 * i + c] = unormTexcoords
+						? to_unorm16(scene.texcoords[i].c[c], uvMin[c], uvExtent[c])
+						: float_to_half(scene.texcoords[i].c[c]);
+		}
+	});
+
+	extensions.add("QSEG", std::move(segments));
+
+	extensions.add("QPOS", std::move(positions));
+	extensions.flags |= scenefile::ext_quantized_positions;
+
+	if (!scene.normals.empty())
+	{
+		extensions.add("QNRM", std::move(normals));
+		extensions.flags |= scenefile::ext_octahedral_normals;
+	}
+
+	if (!scene.tangents.empty())
+	{
+		extensions.add("QTAN", std::move(tangents));
+		extensions.add("QBTN", std::move(bitangents));
+		extensions.flags |= scenefile::ext_octahedral_tangents;
+	}
+
+	if (!scene.texcoords.empty())
+	{
+		extensions.add("QTEX", std::move(texcoords));
+		extensions.flags |= unormTexcoords ? scenefile::ext_unorm16_texcoords : scenefile::ext_half_texcoords;
+	}
+
+	if (keepFloats)
+	{
+		extensions.flags |= scenefile::ext_float_streams;
+		return;
+	}
+
+	// Replaced by the encodings
+	decltype(scene.positions)().swap(scene.positions);
+	decltype(scene.normals)().swap(scene.normals);
+	decltype(scene.tangents)().swap(scene.tangents);
+	decltype(scene.bitangents)().swap(scene.bitangents);
+	decltype(scene.texcoords)().swap(scene.texcoords);
+}
@@ -6,6 +6,13 @@
 #include <string>
 #include <vector>
 #include <functional>
+#include <memory>
+#include <cfloat>
+#include <unordered_map>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <iterator>
 
 #include "mathx"
 
@@ -22,9 +29,23 @@
 #include <scenex>
 #include <filex>
 
+#include "parallel.h"
+#include "simd.h"
+#include "scenefile.h"
+#include "scenepass.h"
+#include "merge.h"
+#include "cache.h"
+#include "hash.h"
+#include "stats.h"
+#include "spill.h"
+#include "importpool.h"
+#include "prefetch.h"
+#include "normals.h"
+#include "nativeimport.h"
+
 void scene_help()
 {
-	std::cout << " Syntax: scenecvt mesh [/VDn] [/Vc] [/VDt] [/Vtan] [/Vbtan] [/Vsn] [/Vsna] [/Von] [/Tsf] [/Iw] [/O] [/S]  [/Ms] <input> <output>"  << std::endl << std::endl;
+	std::cout << " Syntax: scenecvt mesh [/VDn] [/Vc] [/VDt] [/Vtan] [/Vbtan] [/Vsn] [/Vsna] [/Vng] [/Von] [/Tsf] [/Iw] [/In] [/Ia] [/O] [/S]  [/Ms] [/Vw] <input> <output>"  << std::endl << std::endl;
 
 	std::cout << " Arguments:"  << std::endl;
 	std::cout << "  /VDn           Don't include vertex normals"  << std::endl;
@@ -34,14 +55,41 @@ void scene_help()
 	std::cout << "  /Vtan          Include vertex tangents"  << std::endl;
 	std::cout << "  /Vsn           Re-generate smoothed normals"  << std::endl;
 	std::cout << "  /Vsna <float>  Set maximum smoothing angle to <float> degrees (default 30)"  << std::endl;
-	std::cout << "  /Mo            Optimize meshes"  << std::endl;
-//	std::cout << "  /Ms            Sort meshes"  << std::endl;
+	std::cout << "  /Vng           Generate smoothed normals & tangents in parallel instead of by Assimp"  << std::endl;
+	std::cout << "  /Md            Turn duplicate meshes (up to rigid transforms) into instances"  << std::endl;
+	std::cout << "  /Mo            Optimize meshes (vertex cache, overdraw & vertex fetch)"  << std::endl;
+	std::cout << "  /Mocs <int>    Set vertex cache size for /Mo to <int> (default 64)"  << std::endl;
+	std::cout << "  /Lod <n> <f>   Build <n> simplified LOD levels per mesh into <output>.ext, each <f> times the triangles of the previous,"  << std::endl;
+	std::cout << "                 0 < <f> < 1 (default 0.5), levels end once they no longer reduce the triangles"  << std::endl;
+	std::cout << "  /Cm            Build meshlets into <output>.ext"  << std::endl;
+	std::cout << "  /Cmv <int>     Set maximum meshlet vertex count to <int> (default 64)"  << std::endl;
+	std::cout << "  /Cmt <int>     Set maximum meshlet triangle count to <int> (default 124)"  << std::endl;
+	std::cout << "  /Ms            Sort meshes & instances spatially, grouped by material"  << std::endl;
+	std::cout << "  /Vw <float>    Weld vertices closer than <float> within meshes, sealing seams across meshes & inputs"  << std::endl;
+	std::cout << "  /Vwn <float>   Set maximum normal & tangent difference for /Vw to <float> (default 0.01)"  << std::endl;
+	std::cout << "  /Vwt <float>   Set maximum tex coord difference for /Vw to <float> (default 0.0001)"  << std::endl;
+	std::cout << "  /Q             Store quantized vertex streams in <output>.ext instead of floats"  << std::endl;
+	std::cout << "  /Qf            Keep the float vertex streams next to the quantized streams of /Q"  << std::endl;
+	std::cout << "  /Qtu           Quantize tex coords to 16-bit normalized (default half float)"  << std::endl;
 	std::cout << "  /Sg            Geometry only, single material"  << std::endl;
 	std::cout << "  /Sm            Identify and merge redundant materials"  << std::endl;
 	std::cout << "  /Sp            Pretransform and merge all nodes and instances"  << std::endl;
 	std::cout << "  /Ssf <float>   Set scale factor to <float> (default 1.0)"  << std::endl;
+	std::cout << "  /Sbvh          Build instance & mesh BVHs into <output>.ext"  << std::endl;
+	std::cout << "  /Stats <file>  Writes stage timings, peak memory & element counts to JSON <file>"  << std::endl;
+	std::cout << "  /Log <int>     Set console verbosity to <int> (0 errors, 1 summaries (default), 2 materials)"  << std::endl;
 	std::cout << "  /E <fmt>       Exports to 3rd-party format"  << std::endl;
 	std::cout << "  /S+ <inputs>   Merges many input meshes into one output mesh"  << std::endl;
+	std::cout << "  /Sj            Imports multiple inputs in parallel"  << std::endl;
+	std::cout << "  /In            Imports OBJ & binary PLY inputs natively, failing on unsupported features"  << std::endl;
+	std::cout << "  /Ia            Imports all inputs through Assimp (default native OBJ & binary PLY import,"  << std::endl;
+	std::cout << "                 falling back to Assimp for unsupported features)"  << std::endl;
+	std::cout << "  /Spf <int>     Reads up to <int> inputs ahead of serial imports (default 2, 0 with /So)"  << std::endl;
+	std::cout << "  /Spm <int>     Queues up to <int> imported inputs for merging on a separate thread"  << std::endl;
+	std::cout << "                 (default 1, 0 with /So, importing & merging in turn on one thread)"  << std::endl;
+	std::cout << "  /Sc <dir>      Reuses unchanged conversion results from cache <dir>"  << std::endl;
+	std::cout << "  /So            Streams inputs out-of-core through temporary files next to <output>,"  << std::endl;
+	std::cout << "                 keeping inputs in memory only until merged (ignores /Md /Mo /Ms /Vw /Lod /Cm /Sbvh /Q /Sj)"  << std::endl;
 	std::cout << "  <input>        Input mesh file path"  << std::endl;
 	std::cout << "  <output>       Output mesh file path"  << std::endl;
 }
@@ -49,293 +97,233 @@ void scene_help()
 namespace
 {
 
-template <class D, class S>
-void fastcpyn(D* dest, S const* src, size_t N)
-{
-	static_assert(sizeof(*dest) == sizeof(*src), "Incompatible types");
-	memcpy(dest, src, sizeof(*dest) * N);
-}
-
-template <class D, class S, class C>
-void castcpyn(D* dest, S const* src, size_t N, C&& cast)
-{
-	for (auto destEnd = dest + N; dest < destEnd; ++dest, ++src)
-		*dest = cast(*src);
-}
-
-template <class D, class S, class C>
-void cnvtcpyn(D* dest, S const* src, size_t N, C&& convert)
-{
-	for (auto destEnd = dest + N; dest < destEnd; ++dest, ++src)
-		convert(*dest, *src);
-}
+// Bump on any change to the conversion output, invalidates conversion caches
+unsigned const converter_version = 5;
 
-struct binary_converter
+// Adds the element counts of the given input scene to the given stats group.
+void add_input_counts(ConversionStats& stats, char const* group, aiScene const& inScene)
 {
-	template <class Dest, class Src>
-	void operator ()(Dest& dest, Src const& src) const
+	std::uint64_t vertices = 0, indices = 0, instances = 0;
+	for (unsigned i = 0, ie = inScene.mNumMeshes; i < ie; ++i)
 	{
-		static_assert(sizeof(dest) <= sizeof(src), "Too few bytes");
-		dest = reinterpret_cast<Dest const&>(src);
+		auto& mesh = *inScene.mMeshes[i];
+		vertices += mesh.mNumVertices;
+		for (unsigned j = 0, je = mesh.mNumFaces; j < je; ++j)
+			indices += mesh.mFaces[j].mNumIndices;
 	}
-};
 
-struct binary_duplicator
-{
-	template <class Dest, class Src>
-	void operator ()(Dest& dest, Src const& src) const
+	std::function<void (aiNode const&)> addNodeMeshes = [&](aiNode const& node)
 	{
-		static_assert(sizeof(dest) % sizeof(src) == 0, "Dest has to be a multiple of source");
-		typedef Src dest_array[sizeof(dest) / sizeof(src)];
-		for (auto& v : reinterpret_cast<dest_array&>(dest))
-			v = src;
-	}
-};
+		instances += node.mNumMeshes;
 
-inline unsigned color_cast(aiColor4t<float> const& c)
-{
-	unsigned a = math::clamp(unsigned(c.a * 256.0f), 0U, 255U);
-	unsigned r = math::clamp(unsigned(c.r * 256.0f), 0U, 255U);
-	unsigned g = math::clamp(unsigned(c.g * 256.0f), 0U, 255U);
-	unsigned b = math::clamp(unsigned(c.b * 256.0f), 0U, 255U);
-	return (a << 24U) | (r << 16U) | (g << 8U) | (b);
-}
+		if (node.mChildren)
+			for (unsigned i = 0, ie = node.mNumChildren; i < ie; ++i)
+				addNodeMeshes(*node.mChildren[i]);
+	};
+	if (inScene.mRootNode) addNodeMeshes(*inScene.mRootNode);
 
-template <class Type, class Fun, class A, class B, class C>
-void get_material_property(aiMaterial const& mat, A&& a, B&& b, C&& c, Fun&& fun)
-{
-	Type t;
-	if (AI_SUCCESS == mat.Get(a, b, c, t))
-		fun(t);
+	stats.add_count(group, "vertices", vertices);
+	stats.add_count(group, "indices", indices);
+	stats.add_count(group, "meshes", inScene.mNumMeshes);
+	stats.add_count(group, "materials", inScene.mNumMaterials);
+	stats.add_count(group, "instances", instances);
 }
 
-template <class Type, class Dest, class Converter, class A, class B, class C>
-void get_material_property(aiMaterial const& mat, A&& a, B&& b, C&& c, Dest& dest, Converter&& convert)
+// Adds the element counts of the given converted scene to the given stats group.
+void add_scene_counts(ConversionStats& stats, char const* group, scene::Scene const& scene)
 {
-	Type t;
-	if (AI_SUCCESS == mat.Get(a, b, c, t))
-		convert(dest, t);
+	stats.add_count(group, "vertices", scene.positions.size());
+	stats.add_count(group, "indices", scene.indices.size());
+	stats.add_count(group, "meshes", scene.meshes.size());
+	stats.add_count(group, "materials", scene.materials.size());
+	stats.add_count(group, "instances", scene.instances.size());
 }
 
-namespace {
-	struct PrintReflected {
-		template <class T>
-		void operator ()(T const& v, char const* t) const {
-			std::cout << t << ": " << v << std::endl;
-		}
-	};
+// Adds the element counts of the given spilled scene to the given stats group.
+void add_scene_counts(ConversionStats& stats, char const* group, SpilledScene const& spilledScene, scene::Scene const& resident)
+{
+	stats.add_count(group, "vertices", spilledScene.vertex_count());
+	stats.add_count(group, "indices", spilledScene.index_count());
+	stats.add_count(group, "meshes", spilledScene.mesh_count());
+	stats.add_count(group, "materials", resident.materials.size());
+	stats.add_count(group, "instances", spilledScene.instance_count());
 }
 
-void write_meshes(scene::Scene& outScene, aiScene const& inScene)
+struct ImportSettings
 {
-	// Allow for append usage
-	size_t baseVertexCount = outScene.positions.size();
-	size_t baseIndexCount = outScene.indices.size();
-	size_t baseMaterialCount = outScene.materials.size();
-	size_t baseMeshCount = outScene.meshes.size();
-	size_t baseTextureCount = outScene.textures.size();
-	size_t baseInstanceCount = outScene.instances.size();
-
-	// Set up texture table
-	std::map<std::string, unsigned> textureIdcs;
-	size_t textureChars = baseTextureCount;
-	auto&& lookupTexture = [&](aiString const& path) -> unsigned
-	{
-		auto ins = textureIdcs.insert( std::make_pair(std::string(path.C_Str()), unsigned(textureChars)) );
-		if (ins.second) textureChars += ins.first->first.size() + 1; // // include null-termination
-		return ins.first->second;
-	};
-	auto&& textureConvert = [&](unsigned& dest, aiString const& path) { dest = lookupTexture(path); };
-
-	// null dummy (textureIdx == 0)
-	if (textureChars == 0)
-		lookupTexture(aiString("no:tex"));
+	// Discard colors & tangents by default
+	unsigned inputDiscardFlags = aiComponent_COLORS | aiComponent_TANGENTS_AND_BITANGENTS;
+	unsigned processFlags = 0;
 
-	// Count & check
-	{
-		size_t vertexCount = 0;
-		size_t normalCount = 0;
-		size_t colorCount = 0;
-		size_t texcoordCount = 0;
-		size_t tangentCount = 0;
-		size_t indexCount = 0;
-		size_t meshCount = 0;
+	float smoothingAngle = 45.0f;
+	// Replace Assimp's normal & tangent generation by the parallel native passes
+	bool nativeNormals = false;
 
-		for (unsigned i = 0, ie = inScene.mNumMeshes; i < ie; ++i)
-		{
-			auto& mesh = *inScene.mMeshes[i];
-			if (!mesh.HasPositions()) continue;
+	// Keep materials by default
+	bool geometryOnly = false;
 
-			++meshCount;
-			vertexCount += mesh.mNumVertices;
-			indexCount += mesh.mNumFaces * 3;
+	float scaleFactor = 1.0f;
+	bool forceUV = false;
 
-			if (mesh.HasNormals()) normalCount = vertexCount;
-			if (mesh.HasVertexColors(0)) colorCount = vertexCount;
-			if (mesh.HasTextureCoords(0)) texcoordCount = vertexCount;
-			if (mesh.HasTangentsAndBitangents()) tangentCount = vertexCount;
-		}
+	// Native OBJ & PLY import falls back to Assimp for unsupported features unless forced
+	bool forceNativeImport = false;
+	bool forceAssimpImport = false;
+};
 
-		outScene.positions.resize(baseVertexCount + vertexCount);
-		outScene.normals.resize(baseVertexCount + normalCount);
-		outScene.colors.resize(baseVertexCount + colorCount);
-		outScene.texcoords.resize(baseVertexCount + texcoordCount);
-		outScene.tangents.resize(baseVertexCount + tangentCount);
-		outScene.bitangents.resize(baseVertexCount + tangentCount);
-		outScene.indices.resize(baseIndexCount + indexCount);
+void configure_importer(Assimp::Importer& importer, ImportSettings const& settings)
+{
+	// Polygons only
+	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, settings.smoothingAngle);
+	// Remove unwanted mesh components
+	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, settings.inputDiscardFlags);
+}
 
-		outScene.materials.resize(baseMaterialCount + inScene.mNumMaterials);
-		outScene.meshes.resize(baseMeshCount + meshCount);
+void apply_scale_factor(aiScene const& scene, float scaleFactor)
+{
+	aiMatrix4x4 scaling;
+	aiMatrix4x4::Scaling(aiVector3D(scaleFactor), scaling);
+	const_cast<aiMatrix4x4&>(scene.mRootNode->mTransformation) = scaling * scene.mRootNode->mTransformation;
+}
 
-		size_t instanceCount = 0;
+aiScene const* import_scene(Assimp::Importer& importer, char const* input, ImportSettings const& settings
+	, ConversionStats& stats, std::string const& stagePrefix)
+{
+	aiScene const* scene;
+	{
+		ConversionStats::Stage stage(stats, stagePrefix + "ReadFile");
+		scene = importer.ReadFile(input, 0);
+	}
+	if (!scene)
+	{
+		std::cout << "Error loading " << input << std::endl;
+		throwx( std::runtime_error("Assimp Loading") );
+	}
+	add_input_counts(stats, "input", *scene);
 
-		std::function<void (aiNode const&)> addNodeMeshes = [&](aiNode const& node)
-		{
-			instanceCount += node.mNumMeshes;
+	if (settings.scaleFactor != 1.0f)
+		apply_scale_factor(*scene, settings.scaleFactor);
 
-			if (node.mChildren)
-				for (unsigned i = 0, ie = node.mNumChildren; i < ie; ++i)
-					addNodeMeshes(*node.mChildren[i]);
-		};
-		addNodeMeshes(*inScene.mRootNode);
-		
-		outScene.instances.resize(baseInstanceCount + instanceCount);
+	if (settings.geometryOnly)
+	{
+		for (unsigned i = 0, ie = scene->mNumMeshes; i < ie; ++i)
+			scene->mMeshes[i]->mMaterialIndex = 0;
 	}
 
-	// Geometry & meshes
+	if (settings.forceUV)
 	{
-		
-		unsigned vertexCount = unsigned(baseVertexCount);
-		unsigned indexCount = unsigned(baseIndexCount);
-		unsigned meshCount = unsigned(baseMeshCount);
-
-		for (unsigned i = 0, ie = inScene.mNumMeshes; i < ie; ++i)
+		for (unsigned i = 0, ie = scene->mNumMaterials; i < ie; ++i)
 		{
-			auto& mesh = *inScene.mMeshes[i];
-			if (!mesh.HasPositions()) continue;
-
-			fastcpyn(outScene.positions.data() + vertexCount, mesh.mVertices, mesh.mNumVertices);
-			
-			if (mesh.HasNormals()) fastcpyn(outScene.normals.data() + vertexCount, mesh.mNormals, mesh.mNumVertices);
-			if (mesh.HasTangentsAndBitangents()) {
-				fastcpyn(outScene.tangents.data() + vertexCount, mesh.mTangents, mesh.mNumVertices);
-				fastcpyn(outScene.bitangents.data() + vertexCount, mesh.mBitangents, mesh.mNumVertices);
+			auto& material = *scene->mMaterials[i];
+			// Ensure that each material has some kind of texture mapping that results in UV coords being generated
+			int mapping = aiTextureMapping_BOX;
+			if (AI_SUCCESS != material.Get(_AI_MATKEY_MAPPING_BASE, UINT_MAX, UINT_MAX, mapping))
+			{
+				scene->mMaterials[i]->Get(AI_MATKEY_MAPPING_DIFFUSE(0), mapping);
+				scene->mMaterials[i]->AddProperty(&mapping, 1, AI_MATKEY_MAPPING_DIFFUSE(0));
 			}
-			
-			if (mesh.HasTextureCoords(0))
-				cnvtcpyn(outScene.texcoords.data() + vertexCount, mesh.mTextureCoords[0], mesh.mNumVertices, binary_converter());
-
-			if (mesh.HasVertexColors(0))
-				castcpyn(outScene.colors.data() + vertexCount, mesh.mColors[0], mesh.mNumVertices, color_cast);
-
-			auto indexEnd = indexCount;
-
-			for (unsigned i = 0, ie = mesh.mNumFaces; i < ie; ++i)
-				for (int j = 0; j < 3; ++j)
-					outScene.indices.data()[indexEnd++] = vertexCount + mesh.mFaces[i].mIndices[j];
-
-			auto& outMesh = outScene.meshes[meshCount];
+		}
+	}
 
-			outMesh.primitives.first = indexCount;
-			outMesh.primitives.last = indexEnd;
-			// todo: outMesh.bounds;
-			outMesh.material = unsigned(baseMaterialCount) + mesh.mMaterialIndex;
+	unsigned nativeSteps = settings.nativeNormals ? settings.processFlags & (aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace) : 0;
+	unsigned lateSteps = nativeSteps ? settings.processFlags & aiProcess_JoinIdenticalVertices : 0;
 
-			++meshCount;
-			vertexCount += mesh.mNumVertices;
-			indexCount = indexEnd;
-		}
+	{
+		ConversionStats::Stage stage(stats, stagePrefix + "PostProcess");
+		importer.SetProgressHandler(stats.track_progress(stagePrefix + "PostProcess step "));
+		scene = importer.ApplyPostProcessing(settings.processFlags & ~nativeSteps & ~lateSteps);
 	}
-	
-	// Materials
+	if (scene && nativeSteps)
 	{
-		for (unsigned i = 0, ie = inScene.mNumMaterials; i < ie; ++i)
+		// Assimp runs these steps right before joining vertices, so do the same
+		if (nativeSteps & aiProcess_GenSmoothNormals)
 		{
-			auto& mat = *inScene.mMaterials[i];
-			auto& outMat = outScene.materials[baseMaterialCount + i];
-
-			outMat.reset_default();
-			
-			// Properties
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_AMBIENT, outMat.diffuse, binary_converter());
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_DIFFUSE, outMat.diffuse, binary_converter());
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_EMISSIVE, outMat.emissive, binary_converter());
-			
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_SPECULAR, outMat.specular, binary_converter());
-			outMat.reflectivity = outMat.specular;
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_REFLECTIVE, outMat.reflectivity, binary_converter());
-			get_material_property<float>(mat, AI_MATKEY_SHININESS_STRENGTH, [&](float pow) { for (auto& c : outMat.specular.c) c *= pow; });
-			get_material_property<float>(mat, AI_MATKEY_SHININESS, outMat.shininess, binary_duplicator());
-			
-			get_material_property<aiColor3D>(mat, AI_MATKEY_COLOR_TRANSPARENT, outMat.filter, binary_converter());
-			get_material_property<float>(mat, AI_MATKEY_OPACITY, [&](float opac) { 
-				bool color_opaque = [&]() { for (auto& c : outMat.filter.c) if (c != 0.0f) return false; return true; }();
-				for (auto& c : outMat.filter.c) if (color_opaque) c = 1.0f - opac; else c *= 1.0f - opac;
-			});
-			get_material_property<float>(mat, AI_MATKEY_REFRACTI, outMat.refract, binary_duplicator());
-
-			// Textures
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_AMBIENT(0), outMat.tex.diffuse, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_DIFFUSE(0), outMat.tex.diffuse, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_EMISSIVE(0), outMat.tex.emissive, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_SPECULAR(0), outMat.tex.specular, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_SHININESS(0), outMat.tex.shininess, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_REFLECTION(0), outMat.tex.reflectivity, textureConvert);
-
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_OPACITY(0), outMat.tex.filter, textureConvert);
-
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_NORMALS(0), outMat.tex.normal, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_DISPLACEMENT(0), outMat.tex.bump, textureConvert);
-			get_material_property<aiString>(mat, AI_MATKEY_TEXTURE_HEIGHT(0), outMat.tex.bump, textureConvert);
-			get_material_property<float>(mat, AI_MATKEY_BUMPSCALING, outMat.tex.bumpScale, binary_duplicator());
-
-			std::cout << "Material: " << std::endl;
-			outMat.reflect(outMat, PrintReflected());
+			ConversionStats::Stage stage(stats, stagePrefix + "GenSmoothNormals");
+			generate_smooth_normals(const_cast<aiScene&>(*scene), settings.smoothingAngle);
+		}
+		if (nativeSteps & aiProcess_CalcTangentSpace)
+		{
+			ConversionStats::Stage stage(stats, stagePrefix + "CalcTangentSpace");
+			generate_tangents(const_cast<aiScene&>(*scene));
+		}
+		if (lateSteps)
+		{
+			ConversionStats::Stage stage(stats, stagePrefix + "JoinIdenticalVertices");
+			scene = importer.ApplyPostProcessing(lateSteps);
 		}
 	}
-
-	// Textures
+	if (!scene)
 	{
-		outScene.texturePaths.resize(textureChars);
-		auto textureData = outScene.texturePaths.data();
-
-		for (auto&& texture : textureIdcs)
-			strcpy(textureData + texture.second, texture.first.c_str());
+		std::cout << "Error processing " << input << std::endl;
+		throwx( std::runtime_error("Assimp Post-processing") );
 	}
 
-	// Instances
-	{
-		size_t instanceCount = baseInstanceCount;
+	return scene;
+}
 
-		std::function<void (aiNode const&, aiMatrix4x4 const&)> addNodeMeshes = [&](aiNode const& node, aiMatrix4x4 const& transform)
+// Imports OBJ & binary PLY files natively where possible, all other files through Assimp.
+std::unique_ptr<aiScene> import_input(Assimp::Importer& importer, char const* input, ImportSettings const& settings
+	, ConversionStats& stats, std::string const& stagePrefix)
+{
+	if (!settings.forceAssimpImport && native_import_supports(input))
+	{
+		NativeImportSettings nativeSettings;
+		nativeSettings.processFlags = settings.processFlags;
+		nativeSettings.discardFlags = settings.inputDiscardFlags;
+		nativeSettings.smoothingAngle = settings.smoothingAngle;
+		nativeSettings.geometryOnly = settings.geometryOnly;
+
+		std::unique_ptr<aiScene> scene;
+		std::string unsupported = "enforced tex coords";
+		if (!settings.forceUV)
 		{
-			math::mat4x3 instanceTransform;
-			for (int r = 0; r < 4; ++r)
-				for (int c = 0; c < 3; ++c)
-					instanceTransform.cls[r].c[c] = transform[c][r];
-
-			for (unsigned j = 0, je = node.mNumMeshes; j < je; ++j)
-			{
-				auto& instance = outScene.instances[instanceCount++];
+			ConversionStats::Stage stage(stats, stagePrefix + "NativeImport");
+			auto ioSystem = importer.GetIOHandler();
+			auto prefetchIOSystem = dynamic_cast<PrefetchIOSystem*>(ioSystem);
+			auto prefetched = prefetchIOSystem ? prefetchIOSystem->prefetched(input) : nullptr;
+			if (prefetched)
+				scene = import_native(input, prefetched->data(), prefetched->size(), *ioSystem, nativeSettings, unsupported);
+			else
+				scene = import_native(input, *ioSystem, nativeSettings, unsupported);
+		}
 
-				instance.mesh = unsigned(baseMeshCount) + node.mMeshes[j];
-				instance.transform = instanceTransform;
-				// todo: bounds?
-			}
+		if (scene)
+		{
+			add_input_counts(stats, "input", *scene);
+			if (settings.scaleFactor != 1.0f)
+				apply_scale_factor(*scene, settings.scaleFactor);
+			return scene;
+		}
 
-			if (node.mChildren)
-				for (unsigned j = 0, je = node.mNumChildren; j < je; ++j)
-				{
-					auto& child = *node.mChildren[j];
-					addNodeMeshes(child, transform * child.mTransformation);
-				}
-		};
-		addNodeMeshes(*inScene.mRootNode, inScene.mRootNode->mTransformation);
+		if (settings.forceNativeImport)
+		{
+			std::cout << "Error importing " << input << " natively, unsupported: " << unsupported << std::endl;
+			throwx( std::runtime_error("Native import") );
+		}
+		std::cout << "Importing " << input << " through Assimp, natively unsupported: " << unsupported << std::endl;
 	}
+	else if (settings.forceNativeImport)
+	{
+		std::cout << "Error importing " << input << " natively, only OBJ & binary PLY files are supported" << std::endl;
+		throwx( std::runtime_error("Native import") );
+	}
+
+	import_scene(importer, input, settings, stats, stagePrefix);
+	return std::unique_ptr<aiScene>(importer.GetOrphanedScene());
 }
 
 } // namespace
 
+// Once per process, shared by batch-run jobs & serve requests. The first call selects the console stream.
+void create_assimp_logger(bool toStderr)
+{
+	static std::once_flag loggerCreated;
+	std::call_once(loggerCreated, [toStderr]()
+	{
+		Assimp::DefaultLogger::create("assimp.log", Assimp::Logger::NORMAL, toStderr ? aiDefaultLogStream_STDERR : aiDefaultLogStream_STDOUT);
+	});
+}
+
 int scene_tool(char const* tool, char const* const* args, char const* const* args_end)
 {
 	if (args_end - args < 2 || stdx::strieq(*args, "help"))
@@ -350,88 +338,219 @@ int scene_tool(char const* tool, char const* const* args, char const* const* arg
 	auto allInputsBegin = args_end;
 	auto allInputsEnd = allInputsBegin + 1;
 
-	Assimp::DefaultLogger::create("assimp.log", Assimp::Logger::NORMAL, aiDefaultLogStream_STDOUT);
-	Assimp::Importer importer;
+	create_assimp_logger(false);
 
-	// Discard colors & tangents by default
-	unsigned inputDiscardFlags = aiComponent_COLORS | aiComponent_TANGENTS_AND_BITANGENTS;
+	ImportSettings settings;
 	unsigned inputKeepFlags = 0;
-	
-	// Keep materials by default
-	bool geometryOnly = false;
-
-	float scaleFactor = 1.0f;
-	bool forceUV = false;
 
-	unsigned processFlags = 0;
 	unsigned processMask = 0;
+	bool parallelImport = false;
+	bool streamInputs = false;
+	unsigned prefetchDepth = 2;
+	unsigned mergeQueueDepth = 1;
+	bool prefetchDepthSet = false;
+	bool mergeQueueDepthSet = false;
+	bool buildBvh = false;
+	bool mergeMaterials = false;
+
+	bool deduplicateMeshes = false;
+	bool optimizeMeshes = false;
+	bool sortMeshes = false;
+	unsigned cacheSize = 64;
+
+	bool weldVertices = false;
+	float weldPositionEpsilon = 0.0f;
+	float weldNormalEpsilon = 0.01f;
+	float weldTexcoordEpsilon = 0.0001f;
+
+	bool quantizeVertices = false;
+	bool unormTexcoords = false;
+	bool keepFloatStreams = false;
+
+	unsigned lodLevels = 0;
+	float lodRatio = 0.5f;
+
+	bool buildMeshlets = false;
+	unsigned meshletVertices = 64;
+	unsigned meshletTriangles = 124;
 
 	std::string exportFormat; // if s.th. else than binary scene
+	std::string cacheDir;
+	std::string statsPath;
+	int verbosity = 1;
 	
 	// Polygons only
-	processFlags |= aiProcess_FindDegenerates | aiProcess_SortByPType;
-	importer.SetPropertyInteger(AI_CONFIG_PP_SBP_REMOVE, aiPrimitiveType_POINT | aiPrimitiveType_LINE);
+	settings.processFlags |= aiProcess_FindDegenerates | aiProcess_SortByPType;
 
 	// Indexed triangles only
-	processFlags |= aiProcess_JoinIdenticalVertices;
-	processFlags |= aiProcess_Triangulate;
+	settings.processFlags |= aiProcess_JoinIdenticalVertices;
+	settings.processFlags |= aiProcess_Triangulate;
 
 	// Re-generate missing normals
-	processFlags |= aiProcess_GenSmoothNormals;
-	importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, 45.0f);
+	settings.processFlags |= aiProcess_GenSmoothNormals;
 
 	// UVs only
-	processFlags |= aiProcess_GenUVCoords | aiProcess_TransformUVCoords;
+	settings.processFlags |= aiProcess_GenUVCoords | aiProcess_TransformUVCoords;
 
 	// Reduce mesh & material count, flatten hierarchy
-	processFlags |= aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph;
+	settings.processFlags |= aiProcess_OptimizeMeshes | aiProcess_OptimizeGraph;
 
 	for (auto arg = args; arg < args_end; ++arg)
 	{
 		if (stdx::check_flag(*arg, "VDt")) {
-			inputDiscardFlags |= aiComponent_TEXCOORDS;
+			settings.inputDiscardFlags |= aiComponent_TEXCOORDS;
 		} else if (stdx::check_flag(*arg, "VFt")) {
-			forceUV = true;
+			settings.forceUV = true;
 		}
 		else if (stdx::check_flag(*arg, "Vc")) {
 			inputKeepFlags |= aiComponent_COLORS;
 		}
 		else if (stdx::check_flag(*arg, "VDn")) {
-			inputDiscardFlags |= aiComponent_NORMALS;
+			settings.inputDiscardFlags |= aiComponent_NORMALS;
 			processMask |= aiProcess_GenSmoothNormals;
 		} else if (stdx::check_flag(*arg, "Vsn")) {
-			inputDiscardFlags |= aiComponent_NORMALS | aiComponent_TANGENTS_AND_BITANGENTS;
+			settings.inputDiscardFlags |= aiComponent_NORMALS | aiComponent_TANGENTS_AND_BITANGENTS;
 		} else if (stdx::check_flag(*arg, "Vsna")) {
 			float smoothingAngle;
 			if (arg + 1 < args_end && sscanf(arg[1], "%f", &smoothingAngle) == 1) {
-				importer.SetPropertyFloat(AI_CONFIG_PP_GSN_MAX_SMOOTHING_ANGLE, smoothingAngle);
+				settings.smoothingAngle = smoothingAngle;
 				++arg;
 			} else
 				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
 		}
+		else if (stdx::check_flag(*arg, "In")) {
+			settings.forceNativeImport = true;
+			settings.forceAssimpImport = false;
+		} else if (stdx::check_flag(*arg, "Ia")) {
+			settings.forceAssimpImport = true;
+			settings.forceNativeImport = false;
+		}
+		else if (stdx::check_flag(*arg, "Vng")) {
+			settings.nativeNormals = true;
+		}
 		else if (stdx::check_flag(*arg, "Vtan")) {
-			processFlags |= aiProcess_CalcTangentSpace;
+			settings.processFlags |= aiProcess_CalcTangentSpace;
+		}
+		else if (stdx::check_flag(*arg, "Md")) {
+			deduplicateMeshes = true;
+		}
+		else if (stdx::check_flag(*arg, "Ms")) {
+			sortMeshes = true;
+		}
+		else if (stdx::check_flag(*arg, "Vw")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%f", &weldPositionEpsilon) == 1) {
+				weldVertices = true;
+				++arg;
+			} else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Vwn")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%f", &weldNormalEpsilon) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Vwt")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%f", &weldTexcoordEpsilon) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
 		}
 		else if (stdx::check_flag(*arg, "Mo")) {
-			processFlags |= aiProcess_ImproveCacheLocality;
-			importer.SetPropertyInteger(AI_CONFIG_PP_ICL_PTCACHE_SIZE, 64);
-			std::cout << "Mesh optimization enabled, this might take a while." << std::endl;
+			optimizeMeshes = true;
+		} else if (stdx::check_flag(*arg, "Mocs")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &cacheSize) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		}
+		else if (stdx::check_flag(*arg, "Lod")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &lodLevels) == 1) {
+				++arg;
+				float ratio;
+				if (arg + 1 < args_end && sscanf(arg[1], "%f", &ratio) == 1) {
+					if (ratio > 0.0f && ratio < 1.0f)
+						lodRatio = ratio;
+					else
+						std::cout << "Ratio must lie between 0 and 1 exclusively, consult 'mesh help' for help: " << arg[1] << std::endl;
+					++arg;
+				}
+			} else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		}
+		else if (stdx::check_flag(*arg, "Cm")) {
+			buildMeshlets = true;
+		} else if (stdx::check_flag(*arg, "Cmv")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &meshletVertices) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Cmt")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &meshletTriangles) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		}
+		else if (stdx::check_flag(*arg, "Q")) {
+			quantizeVertices = true;
+		} else if (stdx::check_flag(*arg, "Qtu")) {
+			quantizeVertices = true;
+			unormTexcoords = true;
+		} else if (stdx::check_flag(*arg, "Qf")) {
+			quantizeVertices = true;
+			keepFloatStreams = true;
 		}
 		else if (stdx::check_flag(*arg, "Sg")) {
-			geometryOnly = true;
+			settings.geometryOnly = true;
 		} 
 		else if (stdx::check_flag(*arg, "Sm")) {
-			processFlags |= aiProcess_RemoveRedundantMaterials;
+			settings.processFlags |= aiProcess_RemoveRedundantMaterials;
+			mergeMaterials = true;
 		} else if (stdx::check_flag(*arg, "Sp")) {
-			processFlags |= aiProcess_PreTransformVertices;
+			settings.processFlags |= aiProcess_PreTransformVertices;
 			processMask |= aiProcess_OptimizeGraph; // incompatible
 		} else if (stdx::check_flag(*arg, "Ssf")) {
-			if (arg + 1 < args_end && sscanf(arg[1], "%f", &scaleFactor) == 1)
-				(void) scaleFactor;
+			if (arg + 1 < args_end && sscanf(arg[1], "%f", &settings.scaleFactor) == 1)
+				(void) settings.scaleFactor;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Sbvh")) {
+			buildBvh = true;
+		} else if (stdx::check_flag(*arg, "Sj")) {
+			parallelImport = true;
+		} else if (stdx::check_flag(*arg, "So")) {
+			streamInputs = true;
+		} else if (stdx::check_flag(*arg, "Spf")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &prefetchDepth) == 1) {
+				prefetchDepthSet = true;
+				++arg;
+			}
 			else
 				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Spm")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &mergeQueueDepth) == 1) {
+				mergeQueueDepthSet = true;
+				++arg;
+			}
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Sc")) {
+			if (arg + 1 < args_end) {
+				cacheDir = *(arg + 1);
+				++arg;
+			} else
+				std::cout << "Argument requires directory, consult 'mesh help' for help: " << *arg << std::endl;
 		} else if (stdx::check_flag(*arg, "S+")) {
 			allInputsBegin = args_end = arg + 1;
+		} else if (stdx::check_flag(*arg, "Stats")) {
+			if (arg + 1 < args_end) {
+				statsPath = *(arg + 1);
+				++arg;
+			} else
+				std::cout << "Argument requires file, consult 'mesh help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Log")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%d", &verbosity) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'mesh help' for help: " << *arg << std::endl;
 		} else if (stdx::check_flag(*arg, "E")) {
 			if (arg + 1 < args_end) {
 				exportFormat = *(arg + 1);
@@ -443,104 +562,404 @@ int scene_tool(char const* tool, char const* const* args, char const* const* arg
 			std::cout << "Unrecognized argument, consult 'mesh help' for help: " << *arg << std::endl;
 	}
 
-	processFlags &= ~processMask;
-	inputDiscardFlags &= ~inputKeepFlags;
+	settings.processFlags &= ~processMask;
+	settings.inputDiscardFlags &= ~inputKeepFlags;
 
 	// Remove unwanted mesh components
-	importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, inputDiscardFlags);
-	if (inputDiscardFlags != 0)
-		processFlags |= aiProcess_RemoveComponent;
+	if (settings.inputDiscardFlags != 0)
+		settings.processFlags |= aiProcess_RemoveComponent;
 
-	scene::Scene outScene;
+	// Whole-scene passes need all geometry in memory
+	streamInputs &= exportFormat.empty();
+	if (streamInputs && (deduplicateMeshes || optimizeMeshes || sortMeshes || weldVertices || lodLevels > 0 || buildMeshlets || buildBvh || quantizeVertices))
+	{
+		std::cout << "Whole-scene passes unavailable when streaming out-of-core (/So), ignored" << std::endl;
+		deduplicateMeshes = optimizeMeshes = sortMeshes = weldVertices = buildMeshlets = buildBvh = quantizeVertices = false;
+		lodLevels = 0;
+	}
+	// Streaming keeps one input in memory at a time, unless asked to overlap more
+	if (streamInputs)
+	{
+		if (!prefetchDepthSet) prefetchDepth = 0;
+		if (!mergeQueueDepthSet) mergeQueueDepth = 0;
+	}
 
-	for (auto addInput = allInputsEnd; addInput-- > allInputsBegin; )
+	auto&& recordReplay = [&]()
 	{
-		auto scene = importer.ReadFile(*addInput, 0);
-		if (!scene)
+		std::vector<char const*> replayArgs(args_end - args + (allInputsEnd - allInputsBegin) + 1);
+		auto cmdIt = std::copy(args, args_end, replayArgs.data());
+		
+		std::vector<std::string> replayInPaths(allInputsEnd - allInputsBegin);
+
+		for (auto addInput = allInputsBegin; addInput < allInputsEnd; ++addInput)
+		{
+			auto& replayInPath = replayInPaths[addInput - allInputsBegin];
+			replayInPath = stdx::basename(*addInput);
+			replayInPath.insert(replayInPath.begin(), '@');
+
+			*cmdIt++ = replayInPath.data();
+		}
+		
+		*cmdIt++ = output;
+
+		record_command(tool, input, replayArgs.data(), replayArgs.size());
+	};
+
+	size_t inputCount = allInputsEnd - allInputsBegin;
+	ConversionStats stats;
+
+	auto&& writeStats = [&]()
+	{
+		if (!statsPath.empty())
+			stats.write_json(statsPath.c_str(), output, converter_version);
+	};
+
+	// Key on converter version, flags, input paths & contents
+	std::unique_ptr<ConversionCache> cache;
+	if (!cacheDir.empty() && exportFormat.empty())
+	{
+		Hasher key;
+		key.add_value(converter_version);
+		for (auto arg = args; arg < args_end; ++arg)
+			key.add(*arg);
+		for (size_t i = 0; i < inputCount; ++i)
+		{
+			key.add(allInputsBegin[i]);
+			key.add_value(hash_file(allInputsBegin[i]));
+		}
+
+		cache.reset(new ConversionCache(cacheDir.c_str(), key.result()));
+		bool restored;
+		{
+			ConversionStats::Stage stage(stats, "cache restore");
+			restored = cache->restore(output);
+		}
+		if (restored)
 		{
-			std::cout << "Error loading " << *addInput << std::endl;
-			throwx( std::runtime_error("Assimp Loading") );
+			std::cout << "Up to date (cached): " << output << std::endl;
+			writeStats();
+			recordReplay();
+			return 0;
 		}
+	}
+
+	// Post-processed inputs, owned until merged, counted right after import
+	std::vector< std::unique_ptr<aiScene> > scenes(inputCount);
+	std::vector<SceneCounts> inputCounts(inputCount);
+
+	auto&& importInput = [&](Assimp::Importer& importer, size_t i)
+	{
+		scenes[i] = import_input(importer, allInputsBegin[i], settings, stats, "import[" + std::to_string(i) + "].");
+		count_meshes(inputCounts[i], *scenes[i]);
+	};
+
+	// Serial imports in merge order, passing each imported scene on until consume returns false.
+	// Inputs are read ahead on a background thread, overlapping reads with post-processing.
+	auto&& importInputs = [&](std::function<bool (size_t, std::unique_ptr<aiScene>)> const& consume)
+	{
+		auto lease = ImporterPool::shared().acquire();
+		auto& importer = *lease;
+		configure_importer(importer, settings);
+
+		auto ioSystem = new PrefetchIOSystem(cache ? cache->track_dependencies() : nullptr);
+		importer.SetIOHandler(ioSystem);
+
+		std::unique_ptr<InputPrefetcher> prefetcher;
+		if (prefetchDepth > 0)
+			prefetcher.reset(new InputPrefetcher(std::vector<std::string>(std::reverse_iterator<char const* const*>(allInputsEnd)
+				, std::reverse_iterator<char const* const*>(allInputsBegin)), prefetchDepth));
 
-		if (scaleFactor != 1.0f)
+		for (size_t i = inputCount; i-- > 0; )
 		{
-			aiMatrix4x4 scaling;
-			aiMatrix4x4::Scaling(aiVector3D(scaleFactor), scaling);
-			const_cast<aiMatrix4x4&>(scene->mRootNode->mTransformation) = scaling * scene->mRootNode->mTransformation;
+			if (prefetcher)
+			{
+				ConversionStats::Stage stage(stats, "import[" + std::to_string(i) + "].prefetch wait");
+				PrefetchedFile file;
+				if (prefetcher->next(file))
+					ioSystem->provide(std::move(file));
+			}
+
+			auto scene = import_input(importer, allInputsBegin[i], settings, stats, "import[" + std::to_string(i) + "].");
+			ioSystem->provide(PrefetchedFile()); // release the raw bytes before merging
+			if (!consume(i, std::move(scene)))
+				break;
 		}
+	};
+
+	scene::Scene outScene;
+	std::unique_ptr<SpilledScene> spilledScene;
+	std::vector<scene::Scene> chunks;
+
+	// Merges the given input into a chunk sized for it alone, at the running cursor, releasing
+	// the input right away. outScene keeps the materials & texture paths of all chunks.
+	SceneCounts cursor;
+	MergeTables tables;
+	tables.mergeMaterials = mergeMaterials;
+	auto&& mergeChunk = [&](size_t i, std::unique_ptr<aiScene> scene) -> scene::Scene
+	{
+		auto& inScene = *scene;
+
+		scene::Scene chunk;
+		SceneCounts chunkCounts;
+		count_meshes(chunkCounts, inScene);
+		allocate_scene(chunk, chunkCounts);
+
+		chunk.materials.swap(outScene.materials);
+		chunk.materials.resize(cursor.materials + inScene.mNumMaterials);
+		chunk.texturePaths.swap(outScene.texturePaths);
 
-		if (geometryOnly)
+		SceneCounts streamBase = cursor;
+		write_meshes(chunk, inScene, cursor, tables, stats, "merge[" + std::to_string(i) + "].", verbosity, streamBase);
+		scene.reset();
+
+		chunk.materials.resize(cursor.materials);
+		chunk.materials.swap(outScene.materials);
+		chunk.texturePaths.swap(outScene.texturePaths);
+		return chunk;
+	};
+
+	// Serial imports passed on to mergeInput in merge order. With a merge queue, inputs are imported
+	// on a worker thread & merged on this one, overlapping merges with the next imports.
+	auto&& importAndMerge = [&](std::function<void (size_t, std::unique_ptr<aiScene>)> const& mergeInput)
+	{
+		if (mergeQueueDepth == 0)
 		{
-			for (unsigned i = 0, ie = scene->mNumMeshes; i < ie; ++i)
-				scene->mMeshes[i]->mMaterialIndex = 0;
+			// Import & merge in turn
+			importInputs([&](size_t i, std::unique_ptr<aiScene> scene)
+			{
+				mergeInput(i, std::move(scene));
+				return true;
+			});
+			return;
 		}
 
-		if (forceUV)
+		struct ImportedInput
+		{
+			size_t index;
+			std::unique_ptr<aiScene> scene;
+		};
+		BoundedQueue<ImportedInput> imported(mergeQueueDepth);
+
+		std::exception_ptr importError;
+		std::thread importThread([&]()
 		{
-			for (unsigned i = 0, ie = scene->mNumMaterials; i < ie; ++i)
+			try
 			{
-				auto& material = *scene->mMaterials[i];
-				// Ensure that each material has some kind of texture mapping that results in UV coords being generated
-				int mapping = aiTextureMapping_BOX;
-				if (AI_SUCCESS != material.Get(_AI_MATKEY_MAPPING_BASE, UINT_MAX, UINT_MAX, mapping))
+				importInputs([&](size_t i, std::unique_ptr<aiScene> scene)
 				{
-					scene->mMaterials[i]->Get(AI_MATKEY_MAPPING_DIFFUSE(0), mapping);
-					scene->mMaterials[i]->AddProperty(&mapping, 1, AI_MATKEY_MAPPING_DIFFUSE(0));
-				}
+					ImportedInput input = { i, std::move(scene) };
+					return imported.push(std::move(input));
+				});
 			}
-		}
+			catch (...)
+			{
+				importError = std::current_exception();
+			}
+			imported.close();
+		});
 
-		scene = importer.ApplyPostProcessing(processFlags);
-		if (!scene)
+		try
 		{
-			std::cout << "Error processing " << *addInput << std::endl;
-			throwx( std::runtime_error("Assimp Post-processing") );
+			for (ImportedInput input; imported.pop(input); )
+				mergeInput(input.index, std::move(input.scene));
 		}
+		catch (...)
+		{
+			imported.close();
+			importThread.join();
+			throw;
+		}
+
+		importThread.join();
+		if (importError)
+			std::rethrow_exception(importError);
+	};
+
+	if (streamInputs)
+	{
+		// Inputs resident until merged
+		spilledScene.reset(new SpilledScene(std::string(output) + ".spill"));
+
+		importAndMerge([&](size_t i, std::unique_ptr<aiScene> scene)
+		{
+			auto chunk = mergeChunk(i, std::move(scene));
 
-		if (!exportFormat.empty()) {
+			ConversionStats::Stage stage(stats, "spill[" + std::to_string(i) + "]");
+			spilledScene->spill(chunk);
+		});
+	}
+	else if (parallelImport && inputCount > 1)
+	{
+		// One importer per input
+		parallel_for(inputCount, [&](size_t i)
+		{
+			auto lease = ImporterPool::shared().acquire();
+			auto& importer = *lease;
+			configure_importer(importer, settings);
+			if (cache) importer.SetIOHandler(cache->track_dependencies());
+			importInput(importer, i);
+		});
+	}
+	else if (!exportFormat.empty())
+	{
+		importInputs([&](size_t i, std::unique_ptr<aiScene> scene)
+		{
+			scenes[i] = std::move(scene);
+			return true;
+		});
+	}
+	else
+	{
+		// Merge each input into a compact chunk right after import, no aiScene outlives its merge
+		importAndMerge([&](size_t i, std::unique_ptr<aiScene> scene)
+		{
+			chunks.push_back(mergeChunk(i, std::move(scene)));
+		});
+	}
+
+	if (!exportFormat.empty())
+	{
+		for (size_t i = inputCount; i-- > 0; )
+		{
 			std::string outputFile = output;
-			if (allInputsEnd - allInputsBegin > 1) {
-				outputFile = *addInput;
+			if (inputCount > 1) {
+				outputFile = allInputsBegin[i];
 				outputFile += '.';
 				outputFile += exportFormat;
 			}
-			auto r = Assimp::Exporter().Export(scene, exportFormat.c_str(), output, 0);
+			auto r = Assimp::Exporter().Export(scenes[i].get(), exportFormat.c_str(), output, 0);
 			if (r != AI_SUCCESS)
 				throwx( std::runtime_error("Assimp Export") );
 		}
-		else
-			write_meshes(outScene, *scene);
-	}
 
-	// done exporting
-	if (!exportFormat.empty())
+		// done exporting
 		return 0;
+	}
 
+	// Merge in fixed (serial) order, sizing all output streams once
+	if (!chunks.empty())
 	{
-		auto bytes = scene::dump_scene(outScene);
-		auto file = stdx::write_binary_file(output, std::ios_base::trunc);
-		file.write(bytes.data(), bytes.size());
+		ConversionStats::Stage stage(stats, "concatenate");
+		concatenate_chunks(outScene, chunks);
+		chunks.clear();
 	}
-
+	else if (!spilledScene)
 	{
-		std::vector<char const*> replayArgs(args_end - args + (allInputsEnd - allInputsBegin) + 1);
-		auto cmdIt = std::copy(args, args_end, replayArgs.data());
-		
-		std::vector<std::string> replayInPaths(allInputsEnd - allInputsBegin);
+		SceneCounts counts;
+		for (auto& added : inputCounts)
+			counts += added;
+		{
+			ConversionStats::Stage stage(stats, "allocate");
+			allocate_scene(outScene, counts);
+		}
 
-		for (auto addInput = allInputsBegin; addInput < allInputsEnd; ++addInput)
+		for (size_t i = inputCount; i-- > 0; )
 		{
-			auto& replayInPath = replayInPaths[addInput - allInputsBegin];
-			replayInPath = stdx::basename(*addInput);
-			replayInPath.insert(replayInPath.begin(), '@');
+			write_meshes(outScene, *scenes[i], cursor, tables, stats, "merge[" + std::to_string(i) + "].", verbosity);
+			scenes[i].reset();
+		}
+		outScene.materials.resize(cursor.materials);
+	}
+	if (spilledScene)
+		add_scene_counts(stats, "merged", *spilledScene, outScene);
+	else
+		add_scene_counts(stats, "merged", outScene);
 
-			*cmdIt++ = replayInPath.data();
+	// Referenced textures, resolved relative to inputs
+	if (cache)
+	{
+		for (auto path = outScene.texturePaths.data(), pathsEnd = path + outScene.texturePaths.size(); path < pathsEnd; path += strlen(path) + 1)
+		{
+			if (!*path) continue;
+
+			for (size_t i = 0; i < inputCount; ++i)
+			{
+				std::string texturePath = allInputsBegin[i];
+				texturePath.erase(texturePath.find_last_of("/\\") + 1);
+				texturePath += path;
+				if (std::ifstream(texturePath.c_str()).is_open())
+					cache->add_dependency(texturePath);
+			}
 		}
-		
-		*cmdIt++ = output;
+	}
 
-		record_command(tool, input, replayArgs.data(), replayArgs.size());
+	bool report = (verbosity >= 1);
+
+	if (deduplicateMeshes)
+	{
+		ConversionStats::Stage stage(stats, "deduplicate");
+		deduplicate_meshes(outScene, report);
+	}
+	if (weldVertices)
+	{
+		ConversionStats::Stage stage(stats, "weld");
+		weld_vertices(outScene, weldPositionEpsilon, weldNormalEpsilon, weldTexcoordEpsilon, report);
+	}
+	if (optimizeMeshes)
+	{
+		ConversionStats::Stage stage(stats, "optimize");
+		optimize_meshes(outScene, cacheSize, verbosity);
+	}
+	if (sortMeshes)
+	{
+		ConversionStats::Stage stage(stats, "sort");
+		sort_meshes(outScene);
+	}
+
+	scenefile::Extensions extensions;
+
+	if (lodLevels > 0)
+	{
+		ConversionStats::Stage stage(stats, "lod");
+		build_lods(extensions, outScene, lodLevels, lodRatio);
 	}
+	if (buildMeshlets)
+	{
+		ConversionStats::Stage stage(stats, "meshlets");
+		build_meshlets(extensions, outScene, meshletVertices, meshletTriangles);
+	}
+	if (buildBvh)
+	{
+		ConversionStats::Stage stage(stats, "bvh");
+		build_bvhs(extensions, outScene);
+	}
+
+	// Counts before float streams are replaced
+	if (spilledScene)
+		add_scene_counts(stats, "output", *spilledScene, outScene);
+	else
+		add_scene_counts(stats, "output", outScene);
+
+	// Last, replaces float streams
+	if (quantizeVertices)
+	{
+		ConversionStats::Stage stage(stats, "quantize");
+		quantize_vertices(extensions, outScene, unormTexcoords, keepFloatStreams);
+	}
+
+	{
+		ConversionStats::Stage stage(stats, "write_scene");
+		if (spilledScene)
+			spilledScene->write_scene(output, outScene);
+		else
+			scenefile::write_scene(output, outScene);
+	}
+	if (!extensions.empty())
+	{
+		ConversionStats::Stage stage(stats, "write_extensions");
+		scenefile::write_extensions(scenefile::extension_path(output).c_str(), extensions);
+	}
+	else
+		remove(scenefile::extension_path(output).c_str()); // stale from an earlier conversion
+
+	if (cache)
+	{
+		ConversionStats::Stage stage(stats, "cache store");
+		cache->store(output, !extensions.empty());
+	}
+
+	writeStats();
+	recordReplay();
 
 	return 0;
 }
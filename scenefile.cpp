@@ -0,0 +1,73 @@
+#include "pch.h"
+
+#include "scenefile.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <scenex>
+#include <filex>
+
+#include <fstream>
+
+namespace scenefile
+{
+
+void write_section(std::ostream& file, void const* data, size_t elementSize, size_t count)
+{
+	count_t fileCount = count;
+	file.write(reinterpret_cast<char const*>(&fileCount), sizeof(fileCount));
+	file.write(static_cast<char const*>(data), elementSize * count);
+}
+
+void write_scene(char const* path, scene::Scene const& scene)
+{
+	auto file = stdx::write_binary_file(path, std::ios_base::trunc);
+
+	for_each_section(scene, [&](auto const& section, char const*)
+	{
+		write_section(file, section.data(), sizeof(section[0]), section.size());
+	});
+
+	if (!file)
+		throwx( std::runtime_error("Scene file write") );
+}
+
+std::string extension_path(char const* scenePath)
+{
+	std::string path = scenePath;
+	path += ".ext";
+	return path;
+}
+
+void write_extensions(char const* path, Extensions const& extensions)
+{
+	auto file = stdx::write_binary_file(path, std::ios_base::trunc);
+
+	auto&& align = [](std::uint64_t offset) { return (offset + 15U) & ~std::uint64_t(15U); };
+
+	ExtHeader header = { fourcc("SCXT"), ext_version, extensions.flags, std::uint32_t(extensions.chunks.size()) };
+	file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+	std::uint64_t offset = align(sizeof(header) + sizeof(ExtChunk) * extensions.chunks.size());
+	for (auto& chunk : extensions.chunks)
+	{
+		ExtChunk entry = { chunk.tag, chunk.elementSize, offset, chunk.size };
+		file.write(reinterpret_cast<char const*>(&entry), sizeof(entry));
+		offset = align(offset + chunk.size);
+	}
+
+	char const padding[16] = { };
+	std::uint64_t written = sizeof(header) + sizeof(ExtChunk) * extensions.chunks.size();
+	for (auto& chunk : extensions.chunks)
+	{
+		file.write(padding, align(written) - written);
+		file.write(static_cast<char const*>(chunk.data), chunk.size);
+		written = align(written) + chunk.size;
+	}
+
+	if (!file)
+		throwx( std::runtime_error("Scene extension file write") );
+}
+
+} // namespace
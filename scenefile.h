@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+#include <memory>
+#include <string>
+
+namespace scene { struct Scene; }
+
+namespace scenefile
+{
+
+// On-disk element count preceding each section
+typedef std::uint64_t count_t;
+
+// Visits all sections of a scene in file order, matching the layout of scene::dump_scene:
+// each section is stored as its element count followed by the raw elements.
+template <class Scene, class Visitor>
+void for_each_section(Scene& scene, Visitor&& visit)
+{
+	visit(scene.positions, "positions");
+	visit(scene.normals, "normals");
+	visit(scene.colors, "colors");
+	visit(scene.texcoords, "texcoords");
+	visit(scene.tangents, "tangents");
+	visit(scene.bitangents, "bitangents");
+	visit(scene.indices, "indices");
+	visit(scene.materials, "materials");
+	visit(scene.meshes, "meshes");
+	visit(scene.textures, "textures");
+	visit(scene.texturePaths, "texturePaths");
+	visit(scene.instances, "instances");
+}
+
+// Writes a section header & elements to the given stream.
+void write_section(std::ostream& file, void const* data, size_t elementSize, size_t count);
+
+// Writes the given scene section by section, without building an intermediate buffer.
+// The output is byte-compatible with scene::dump_scene, as checked by scenecvt_scenefile_test.
+void write_scene(char const* path, scene::Scene const& scene);
+
+// Extension sidecar (<output>.ext) for optional data that the scene format has no room for.
+// Layout: ExtHeader, ExtChunk[chunkCount], 16-byte aligned chunk payloads. Offsets are
+// relative to the start of the file, so a mapped file can be used without pointer fixup.
+
+inline std::uint32_t fourcc(char const (&tag)[5])
+{
+	return std::uint32_t((unsigned char) tag[0]) | (std::uint32_t((unsigned char) tag[1]) << 8U)
+		| (std::uint32_t((unsigned char) tag[2]) << 16U) | (std::uint32_t((unsigned char) tag[3]) << 24U);
+}
+
+struct ExtHeader
+{
+	std::uint32_t magic; // fourcc("SCXT")
+	std::uint32_t version;
+	std::uint32_t flags;
+	std::uint32_t chunkCount;
+};
+
+struct ExtChunk
+{
+	std::uint32_t tag;
+	std::uint32_t elementSize;
+	std::uint64_t offset;
+	std::uint64_t size;
+};
+
+std::uint32_t const ext_version = 3; // 2: quantized streams always accompanied the float streams
+
+// Collects extension chunks, taking ownership of the element arrays.
+struct Extensions
+{
+	struct Chunk
+	{
+		std::uint32_t tag;
+		std::uint32_t elementSize;
+		void const* data;
+		size_t size;
+		std::shared_ptr<void const> owner;
+	};
+	std::vector<Chunk> chunks;
+	std::uint32_t flags = 0;
+
+	template <class T>
+	void add(char const (&tag)[5], std::vector<T>&& elements)
+	{
+		auto owned = std::make_shared< std::vector<T> >(std::move(elements));
+		Chunk chunk = { fourcc(tag), std::uint32_t(sizeof(T)), owned->data(), owned->size() * sizeof(T), owned };
+		chunks.push_back(chunk);
+	}
+
+	bool empty() const { return chunks.empty() && flags == 0; }
+};
+
+// BVH chunks: "TLNO"/"TLPR" hold nodes & instance indices of the top-level BVH over instances,
+// "BLNO"/"BLPR" the concatenated nodes & triangle indices of all mesh BVHs, "BLMS" one BvhMesh per mesh.
+// Sibling nodes are stored adjacently, all node & primitive indices are absolute within their chunk.
+
+struct BvhNode
+{
+	float min[3];
+	std::uint32_t first; // first child (inner node) or first primitive (leaf)
+	float max[3];
+	std::uint32_t count; // 0 for inner nodes, primitive count for leaves
+};
+
+struct BvhMesh
+{
+	std::uint32_t firstNode, nodeCount;
+	std::uint32_t firstPrimitive, primitiveCount; // triangle indices relative to the mesh's primitives
+};
+
+// Meshlet chunks: "MLMS" one MeshletRange per mesh, "MLTS" the concatenated Meshlet table,
+// "MLVX" meshlet vertices as scene vertex indices, "MLTR" meshlet triangles as 3 byte-sized
+// indices into the meshlet's vertices. A meshlet is back-facing for all views from camera
+// position p if dot(center - p, coneAxis) >= coneCutoff * length(center - p) + radius.
+
+struct MeshletRange
+{
+	std::uint32_t firstMeshlet, meshletCount;
+};
+
+struct Meshlet
+{
+	std::uint32_t firstVertex, vertexCount;
+	std::uint32_t firstTriangle, triangleCount;
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff; // 1 if the cone is too wide for culling
+};
+
+// Quantized vertex streams replace the corresponding float streams of the scene file, which are
+// then empty, unless ext_float_streams indicates that complete float streams were kept alongside.
+// ExtHeader::flags indicates the encodings present. Vertices are grouped into segments ("QSEG")
+// that cover each mesh's vertex range, segments partition the vertex array.
+
+enum ExtFlags : std::uint32_t
+{
+	ext_quantized_positions = 0x1, // "QPOS": 4 x unorm16 per vertex (xyz, padding) in segment bounds
+	ext_octahedral_normals = 0x2,  // "QNRM": 2 x snorm16 octahedral unit vector per vertex
+	ext_octahedral_tangents = 0x4, // "QTAN", "QBTN": 2 x snorm16 octahedral unit vectors per vertex
+	ext_half_texcoords = 0x8,      // "QTEX": 2 x half float per vertex
+	ext_unorm16_texcoords = 0x10,  // "QTEX": 2 x unorm16 per vertex in segment texcoord bounds
+	ext_float_streams = 0x20       // float streams of the scene file kept next to the encodings
+};
+
+struct QuantizationSegment
+{
+	std::uint32_t firstVertex, vertexCount;
+	float positionMin[3], positionExtent[3]; // p = min + q / 65535 * extent
+	float texcoordMin[2], texcoordExtent[2];
+};
+
+// LOD chunks: "LDMS" one LodRange per mesh, "LDLV" the concatenated LodLevel table. Level index
+// buffers are appended to the scene's index stream behind all mesh primitives. The mesh primitives
+// themselves are the full-detail level and not listed, levels start with the first simplified one.
+
+struct LodRange
+{
+	std::uint32_t firstLevel, levelCount;
+};
+
+struct LodLevel
+{
+	std::uint32_t first, last; // primitive range into the scene indices
+	float error;               // approximate object-space deviation from the full-detail mesh
+};
+
+std::string extension_path(char const* scenePath);
+void write_extensions(char const* path, Extensions const& extensions);
+
+} // namespace
@@ -0,0 +1,163 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <vector>
+#include <string>
+#include <utility>
+#include <random>
+#include <cstdio>
+#include <cstring>
+
+#include <scenex>
+
+#include "scenefile.h"
+#include "sceneview.h"
+#include "spill.h"
+
+bool const stdx::is_debugger_present = IsDebuggerPresent() != FALSE;
+
+namespace
+{
+
+// Resizes the given section & fills all its bytes, padding included, with random values.
+template <class T>
+void fill_section(std::vector<T>& section, size_t count, std::mt19937& rng)
+{
+	section.resize(count);
+	std::vector<unsigned char> bytes(count * sizeof(T));
+	for (auto& b : bytes)
+		b = (unsigned char) rng();
+	if (count) memcpy(section.data(), bytes.data(), bytes.size());
+}
+
+// All sections non-empty with odd element counts, so that later sections are misaligned.
+scene::Scene random_scene(size_t vertexCount, std::mt19937& rng)
+{
+	scene::Scene scene;
+	fill_section(scene.positions, vertexCount, rng);
+	fill_section(scene.normals, vertexCount, rng);
+	fill_section(scene.colors, vertexCount, rng);
+	fill_section(scene.texcoords, vertexCount, rng);
+	fill_section(scene.tangents, vertexCount, rng);
+	fill_section(scene.bitangents, vertexCount, rng);
+	fill_section(scene.indices, 3 * vertexCount + 3, rng);
+	fill_section(scene.materials, 3, rng);
+	fill_section(scene.meshes, 5, rng);
+	fill_section(scene.textures, 7, rng);
+	fill_section(scene.texturePaths, 13, rng);
+	fill_section(scene.instances, 9, rng);
+	return scene;
+}
+
+std::vector<char> read_file(char const* path)
+{
+	std::ifstream file(path, std::ios_base::binary);
+	return std::vector<char>((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+}
+
+struct Checker
+{
+	unsigned failures = 0;
+
+	void check(bool passed, std::string const& what)
+	{
+		if (!passed)
+		{
+			std::cout << "FAILED: " << what << std::endl;
+			++failures;
+		}
+	}
+};
+
+// write_scene is byte-compatible with scene::dump_scene
+void test_write_scene(Checker& checker, scene::Scene const& scene, char const* path)
+{
+	scenefile::write_scene(path, scene);
+	checker.check(read_file(path) == scene::dump_scene(scene), "write_scene differs from dump_scene");
+}
+
+// MappedScene views the sections of written files in place
+void test_mapped_scene(Checker& checker, scene::Scene const& scene, char const* path)
+{
+	scenefile::MappedScene mapped(path);
+	checker.check(mapped.trailing_bytes() == 0, "MappedScene trailing bytes");
+
+	std::vector<std::pair<void const*, size_t>> expected;
+	scenefile::for_each_section(scene, [&](auto const& section, char const*)
+	{
+		expected.push_back(std::make_pair(static_cast<void const*>(section.data()), sizeof(section[0]) * section.size()));
+	});
+
+	size_t sectionIdx = 0;
+	scenefile::for_each_section(mapped, [&](auto const& view, char const* name)
+	{
+		auto& section = expected[sectionIdx++];
+		checker.check(view.size() * sizeof(view[0]) == section.second
+			&& (section.second == 0 || memcmp(view.data(), section.first, section.second) == 0), std::string("MappedScene section ") + name);
+	});
+}
+
+// SpilledScene writes the same file as write_scene on the concatenated chunks, zero-filling
+// vertex attributes of chunks that lack them
+void test_spilled_scene(Checker& checker, std::mt19937& rng, char const* path)
+{
+	auto first = random_scene(17, rng), second = random_scene(10, rng);
+	second.colors.clear();
+	second.tangents.clear();
+	second.bitangents.clear();
+
+	auto&& append = [](auto& section, auto const& appended) { section.insert(section.end(), appended.begin(), appended.end()); };
+	scene::Scene merged = first, resident;
+	append(merged.positions, second.positions);
+	append(merged.normals, second.normals);
+	append(merged.texcoords, second.texcoords);
+	append(merged.indices, second.indices);
+	append(merged.materials, second.materials);
+	append(merged.meshes, second.meshes);
+	append(merged.textures, second.textures);
+	append(merged.texturePaths, second.texturePaths);
+	append(merged.instances, second.instances);
+	merged.colors.resize(merged.positions.size());
+	merged.tangents.resize(merged.positions.size());
+	merged.bitangents.resize(merged.positions.size());
+
+	// Materials, textures & texture paths stay resident
+	resident.materials = merged.materials;
+	resident.textures = merged.textures;
+	resident.texturePaths = merged.texturePaths;
+
+	{
+		SpilledScene spilled(std::string(path) + ".spill");
+		spilled.spill(first);
+		spilled.spill(second);
+		spilled.write_scene(path, resident);
+	}
+	checker.check(read_file(path) == scene::dump_scene(merged), "SpilledScene::write_scene differs from dump_scene of the merged scene");
+}
+
+} // namespace
+
+// Pins the scene file layout written & read by scenefile against the scene library's serializer.
+int main()
+{
+	char const* path = "scenecvt_scenefile_test.scene";
+	std::mt19937 rng(1);
+	Checker checker;
+
+	for (size_t vertexCount : { size_t(0), size_t(1), size_t(33) })
+	{
+		auto scene = random_scene(vertexCount, rng);
+		test_write_scene(checker, scene, path);
+		test_mapped_scene(checker, scene, path);
+	}
+	test_spilled_scene(checker, rng, path);
+
+	remove(path);
+
+	std::cout << "Scene file layout: " << (checker.failures ? "FAILED" : "OK") << std::endl;
+	return checker.failures ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <algorithm>
+
+#include <scenex>
+
+#include "scenepass.h"
+#include "parallel.h"
+
+std::vector<VertexRange> mesh_vertex_ranges(scene::Scene const& scene)
+{
+	size_t meshCount = scene.meshes.size();
+	std::vector<VertexRange> ranges(meshCount);
+
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		auto& mesh = scene.meshes[meshIdx];
+		auto& range = ranges[meshIdx];
+		range.first = range.last = 0;
+		range.shared = false;
+
+		if (mesh.primitives.first < mesh.primitives.last)
+		{
+			auto minmax = std::minmax_element(scene.indices.data() + mesh.primitives.first, scene.indices.data() + mesh.primitives.last);
+			range.first = *minmax.first;
+			range.last = *minmax.second + 1;
+		}
+	});
+
+	// Flag overlapping ranges
+	std::vector<unsigned> order(meshCount);
+	for (size_t i = 0; i < meshCount; ++i)
+		order[i] = unsigned(i);
+	std::sort(order.begin(), order.end(), [&](unsigned a, unsigned b) { return ranges[a].first < ranges[b].first; });
+
+	unsigned reachingMesh = ~0U; // mesh whose range reaches furthest so far
+	for (auto meshIdx : order)
+	{
+		auto& range = ranges[meshIdx];
+		if (range.first == range.last) continue;
+
+		if (reachingMesh != ~0U && ranges[reachingMesh].last > range.first)
+		{
+			range.shared = true;
+			ranges[reachingMesh].shared = true;
+			if (range.last > ranges[reachingMesh].last)
+				reachingMesh = meshIdx;
+		}
+		else
+			reachingMesh = meshIdx;
+	}
+
+	return ranges;
+}
+
+namespace
+{
+
+template <class T>
+void remap_stream(std::vector<T>& stream, unsigned first, std::vector<unsigned> const& remap)
+{
+	if (stream.empty()) return;
+
+	std::vector<T> old(stream.begin() + first, stream.begin() + first + remap.size());
+	for (size_t i = 0; i < remap.size(); ++i)
+		stream[first + remap[i]] = old[i];
+}
+
+} // namespace
+
+void remap_vertices(scene::Scene& scene, unsigned first, std::vector<unsigned> const& remap)
+{
+	remap_stream(scene.positions, first, remap);
+	remap_stream(scene.normals, first, remap);
+	remap_stream(scene.colors, first, remap);
+	remap_stream(scene.texcoords, first, remap);
+	remap_stream(scene.tangents, first, remap);
+	remap_stream(scene.bitangents, first, remap);
+}
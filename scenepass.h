@@ -0,0 +1,72 @@
+#pragma once
+
+// Passes & helpers operating on converted scenes
+
+#include "mathx"
+
+#include <vector>
+
+namespace scene { struct Scene; }
+namespace scenefile { struct Extensions; }
+
+// Collapses meshes that equal another mesh up to a rigid transform into instances of that mesh.
+void deduplicate_meshes(scene::Scene& scene, bool report);
+
+// Reorders the triangles & vertices of each mesh for vertex cache, overdraw and vertex fetch efficiency.
+// Reports totals at verbosity 1, per-mesh statistics from verbosity 2 on.
+void optimize_meshes(scene::Scene& scene, unsigned cacheSize, int verbosity);
+
+// Builds SAH BVHs over instance bounds and over the triangles of each mesh.
+void build_bvhs(scenefile::Extensions& extensions, scene::Scene const& scene);
+
+// Splits the primitives of each mesh into meshlets of bounded vertex & triangle counts.
+void build_meshlets(scenefile::Extensions& extensions, scene::Scene const& scene, unsigned maxVertices, unsigned maxTriangles);
+
+// Orders meshes & instances by material, then along a Morton curve of their world bounds.
+// Index & vertex streams are rewritten to follow the new mesh order.
+void sort_meshes(scene::Scene& scene);
+
+// Merges vertices within the given position, normal & texcoord distances inside each mesh's vertex range,
+// rewriting indices & dropping collapsed triangles. Matches across meshes & inputs are snapped to identical
+// attributes instead, which seals seams while mesh vertex ranges stay disjoint.
+void weld_vertices(scene::Scene& scene, float positionEpsilon, float normalEpsilon, float texcoordEpsilon, bool report);
+
+// Appends up to levelCount successively simplified index buffers per mesh, level l targeting ratio^l of the
+// triangles for a ratio in (0, 1). A mesh's levels end at the first level that no longer reduces its triangles.
+void build_lods(scenefile::Extensions& extensions, scene::Scene& scene, unsigned levelCount, float ratio);
+
+// Replaces the float vertex streams by compact encodings stored as extension chunks, or adds the
+// encodings next to the float streams if keepFloats is set.
+void quantize_vertices(scenefile::Extensions& extensions, scene::Scene& scene, bool unormTexcoords, bool keepFloats);
+
+// Axis-aligned bounds of the given bounds after transformation.
+template <class Bounds>
+Bounds transform_bounds(Bounds const& bounds, math::mat4x3 const& transform)
+{
+	Bounds result;
+	for (int i = 0; i < 3; ++i)
+	{
+		result.min.c[i] = result.max.c[i] = transform.cls[3].c[i];
+
+		for (int j = 0; j < 3; ++j)
+		{
+			float a = transform.cls[j].c[i] * bounds.min.c[j];
+			float b = transform.cls[j].c[i] * bounds.max.c[j];
+			result.min.c[i] += (a < b) ? a : b;
+			result.max.c[i] += (a < b) ? b : a;
+		}
+	}
+	return result;
+}
+
+// Vertices referenced by a mesh. Meshes written by write_meshes own disjoint, contiguous ranges.
+struct VertexRange
+{
+	unsigned first, last;
+	bool shared; // overlaps the range of another mesh
+};
+
+std::vector<VertexRange> mesh_vertex_ranges(scene::Scene const& scene);
+
+// Moves vertex first + i to first + remap[i] in all vertex attribute streams.
+void remap_vertices(scene::Scene& scene, unsigned first, std::vector<unsigned> const& remap);
@@ -0,0 +1,38 @@
+#include "pch.h"
+
+#include "sceneview.h"
+
+#include "stdx"
+
+#include <cstring>
+#include <type_traits>
+
+namespace scenefile
+{
+
+MappedScene::MappedScene(char const* path)
+	: mapping(path)
+{
+	auto cursor = mapping.data(), end = mapping.data() + mapping.size();
+
+	for_each_section(*this, [&](auto& view, char const* name)
+	{
+		typedef typename std::decay<decltype(view)>::type::value_type element_t;
+
+		count_t count;
+		if (size_t(end - cursor) < sizeof(count))
+			throwx( std::runtime_error(std::string("Scene file truncated before section ") + name + ": " + path) );
+		memcpy(&count, cursor, sizeof(count)); // unaligned
+		cursor += sizeof(count);
+
+		if (count > size_t(end - cursor) / sizeof(element_t))
+			throwx( std::runtime_error(std::string("Scene file truncated in section ") + name + ": " + path) );
+		view.bytes = cursor;
+		view.count = size_t(count);
+		cursor += view.count * sizeof(element_t);
+	});
+
+	trailingBytes = size_t(end - cursor);
+}
+
+} // namespace
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#include <scenex>
+
+#include "mapfile.h"
+#include "scenefile.h"
+
+namespace scenefile
+{
+
+// Read-only range of elements inside a file mapping. Sections are stored back to back without
+// padding, so elements behind odd-sized sections (e.g. texture paths) may be misaligned: elements
+// are copied out on access instead of being referenced in place.
+template <class T>
+struct ElementView
+{
+	static_assert(std::is_trivially_copyable<T>::value, "Scene file elements are stored as raw bytes");
+
+	typedef T value_type;
+
+	char const* bytes = nullptr;
+	size_t count = 0;
+
+	struct iterator
+	{
+		char const* element;
+
+		T operator *() const { T value; memcpy(&value, element, sizeof(T)); return value; }
+		iterator& operator ++() { element += sizeof(T); return *this; }
+		bool operator !=(iterator const& r) const { return element != r.element; }
+		bool operator ==(iterator const& r) const { return element == r.element; }
+	};
+
+	char const* data() const { return bytes; } // possibly misaligned for T
+	size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+	iterator begin() const { iterator it = { bytes }; return it; }
+	iterator end() const { iterator it = { bytes + count * sizeof(T) }; return it; }
+	T operator [](size_t i) const { T value; memcpy(&value, bytes + i * sizeof(T), sizeof(T)); return value; }
+};
+
+template <class Vector>
+using view_of = ElementView<typename Vector::value_type>;
+
+// Zero-copy view of a scene file written by scene::dump_scene or write_scene. Opening only walks
+// the section headers, elements are paged in on first access. Members mirror scene::Scene, so
+// for_each_section applies.
+class MappedScene
+{
+public:
+	explicit MappedScene(char const* path);
+
+	MappedFile const& file() const { return mapping; }
+	// Bytes following the last section, 0 for well-formed files
+	size_t trailing_bytes() const { return trailingBytes; }
+
+private:
+	MappedFile mapping;
+	size_t trailingBytes = 0;
+
+public:
+	view_of<decltype(scene::Scene::positions)> positions;
+	view_of<decltype(scene::Scene::normals)> normals;
+	view_of<decltype(scene::Scene::colors)> colors;
+	view_of<decltype(scene::Scene::texcoords)> texcoords;
+	view_of<decltype(scene::Scene::tangents)> tangents;
+	view_of<decltype(scene::Scene::bitangents)> bitangents;
+	view_of<decltype(scene::Scene::indices)> indices;
+	view_of<decltype(scene::Scene::materials)> materials;
+	view_of<decltype(scene::Scene::meshes)> meshes;
+	view_of<decltype(scene::Scene::textures)> textures;
+	view_of<decltype(scene::Scene::texturePaths)> texturePaths;
+	view_of<decltype(scene::Scene::instances)> instances;
+};
+
+} // namespace
@@ -0,0 +1,350 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+
+#ifndef WIN32
+	#include <sys/socket.h>
+	#include <sys/un.h>
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <poll.h>
+	#include <cerrno>
+
+	#ifndef MSG_NOSIGNAL
+		#define MSG_NOSIGNAL 0 // SO_NOSIGPIPE instead
+	#endif
+#endif
+
+#include "importpool.h"
+
+int scene_tool(char const* tool, char const* const* args, char const* const* args_end);
+std::vector<std::string> scene_command_args(std::string const& command, bool& replay);
+void create_assimp_logger(bool toStderr);
+
+void serve_help()
+{
+	std::cout << " Syntax: scenecvt serve [/socket <path>] [/Pi <n>]"  << std::endl << std::endl;
+
+	std::cout << " Arguments:"  << std::endl;
+	std::cout << "  /socket <path> Accept requests on local UNIX socket <path> instead of stdin (POSIX only)"  << std::endl;
+	std::cout << "  /Pi <int>      Keep <int> importers warm (default 2)"  << std::endl << std::endl;
+
+	std::cout << " Requests are 'scene' tool command lines, one per line. Each is answered by a line"  << std::endl;
+	std::cout << " '[serve] OK <ms> ms' or '[serve] FAILED <ms> ms: <error>'. 'quit' ends the session,"  << std::endl;
+	std::cout << " 'shutdown' stops the server."  << std::endl;
+}
+
+namespace
+{
+
+enum class Request
+{
+	converted,
+	quit,
+	shutdown
+};
+
+// Runs the given request line, returning the reply line (empty for blank lines).
+Request handle_request(std::string line, std::string& reply)
+{
+	line.erase(line.find_last_not_of(" \t\r") + 1);
+	line.erase(0, line.find_first_not_of(" \t"));
+
+	reply.clear();
+	if (line.empty() || line[0] == '#') return Request::converted;
+	if (stdx::strieq(line.c_str(), "quit")) return Request::quit;
+	if (stdx::strieq(line.c_str(), "shutdown")) return Request::shutdown;
+
+	auto start = std::chrono::steady_clock::now();
+	std::string error;
+
+	// Isolate request failures from the server
+	try
+	{
+		bool replay;
+		auto args = scene_command_args(line, replay);
+		if (!args.empty() && stdx::strieq(args.front().c_str(), "scene"))
+			args.erase(args.begin());
+		if (args.size() < 2)
+			throwx( std::runtime_error("Request requires input & output") );
+
+		std::vector<char const*> toolArgs;
+		for (auto& arg : args)
+			toolArgs.push_back(arg.c_str());
+
+		set_command_replay(replay);
+		if (scene_tool("scene", toolArgs.data(), toolArgs.data() + toolArgs.size()) != 0)
+			error = "Non-zero exit code";
+	}
+	catch (std::exception const& excpt)
+	{
+		error = excpt.what();
+		if (error.empty()) error = "Unknown error";
+	}
+	catch (...)
+	{
+		error = "Unknown error";
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::ostringstream out;
+	out << "[serve] " << (error.empty() ? "OK " : "FAILED ") << ms << " ms";
+	if (!error.empty())
+		out << ": " << error;
+	reply = out.str();
+	return Request::converted;
+}
+
+// Replies go to stdout, conversion logs written to std::cout are redirected to stderr meanwhile.
+int serve_stdin()
+{
+	std::ostream replies(std::cout.rdbuf());
+	replies << "[serve] Ready on stdin" << std::endl;
+
+	auto stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+	std::string line, reply;
+	while (std::getline(std::cin, line))
+	{
+		auto request = handle_request(line, reply);
+		if (request != Request::converted) break;
+		if (!reply.empty())
+			replies << reply << std::endl;
+	}
+	std::cout.rdbuf(stdoutBuffer);
+	return 0;
+}
+
+#ifndef WIN32
+
+// Accepts connections on a UNIX domain socket, each served by its own detached thread. Requests
+// of one connection are run in order, connections run concurrently. Accepting waits on the listener
+// & a self-pipe written by stop(), as shutdown() does not wake accept() on all platforms.
+class SocketServer
+{
+public:
+	explicit SocketServer(char const* path)
+		: path(path)
+	{
+		sockaddr_un address = { };
+		address.sun_family = AF_UNIX;
+		if (this->path.size() >= sizeof(address.sun_path))
+			throwx( std::runtime_error("Socket path too long: " + this->path) );
+		memcpy(address.sun_path, path, this->path.size() + 1);
+
+		listener = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (listener < 0)
+			throwx( std::runtime_error("Cannot create socket") );
+
+		// Replace stale socket of a previous server
+		unlink(path);
+		if (bind(listener, reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0
+			|| fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK) != 0)
+		{
+			close(listener);
+			throwx( std::runtime_error("Cannot listen on socket: " + this->path) );
+		}
+
+		if (pipe(wakePipe) != 0)
+		{
+			close(listener);
+			unlink(path);
+			throwx( std::runtime_error("Cannot create server wake pipe") );
+		}
+	}
+
+	~SocketServer()
+	{
+		close(listener);
+		close(wakePipe[0]);
+		close(wakePipe[1]);
+		unlink(path.c_str());
+	}
+
+	void run()
+	{
+		std::string error;
+
+		while (!stopping)
+		{
+			pollfd waits[2] = { { listener, POLLIN, 0 }, { wakePipe[0], POLLIN, 0 } };
+			if (poll(waits, 2, -1) < 0)
+			{
+				if (errno == EINTR) continue;
+				error = "Socket poll failed";
+				break;
+			}
+			if (stopping || waits[1].revents != 0) break;
+			if (waits[0].revents & (POLLERR | POLLNVAL))
+			{
+				error = "Socket listener failed";
+				break;
+			}
+
+			int connection = accept(listener, nullptr, nullptr);
+			if (connection < 0)
+			{
+				// Aborted before accepted, or out of resources until sessions end
+				if (errno == EINTR || errno == ECONNABORTED || errno == EAGAIN || errno == EWOULDBLOCK)
+					continue;
+				if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+				{
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+					continue;
+				}
+				error = "Socket accept failed";
+				break;
+			}
+
+			// Blocking sessions, accepted sockets inherit the listener's flags on some platforms
+			fcntl(connection, F_SETFL, fcntl(connection, F_GETFL) & ~O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+			int noSigPipe = 1;
+			setsockopt(connection, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+			std::lock_guard<std::mutex> lock(mutex);
+			// Connected while stopping
+			if (stopping)
+			{
+				close(connection);
+				break;
+			}
+			connections.push_back(connection);
+			std::thread(&SocketServer::serve, this, connection).detach();
+		}
+
+		if (!error.empty())
+			stop();
+
+		// Sessions leave once their connections are closed
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			sessionsDone.wait(lock, [&]() { return connections.empty(); });
+		}
+
+		if (!error.empty())
+			throwx( std::runtime_error(error + ": " + path) );
+	}
+
+private:
+	std::string path;
+	int listener;
+	int wakePipe[2];
+	std::atomic<bool> stopping = { false };
+
+	std::mutex mutex;
+	std::condition_variable sessionsDone;
+	std::vector<int> connections; // one per running session
+
+	void serve(int connection)
+	{
+		std::string pending, reply;
+		char buffer[4096];
+
+		for (bool open = true; open; )
+		{
+			auto received = recv(connection, buffer, sizeof(buffer), 0);
+			if (received <= 0) break;
+			pending.append(buffer, size_t(received));
+
+			for (size_t lineEnd; open && (lineEnd = pending.find('\n')) != std::string::npos; )
+			{
+				auto line = pending.substr(0, lineEnd);
+				pending.erase(0, lineEnd + 1);
+
+				auto request = handle_request(line, reply);
+				if (request == Request::shutdown)
+					stop();
+				if (request != Request::converted)
+					open = false;
+				else if (!reply.empty())
+				{
+					reply += '\n';
+					send(connection, reply.data(), reply.size(), MSG_NOSIGNAL);
+				}
+			}
+		}
+
+		// Last access to the server, which may be destroyed as soon as the lock is released
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto it = connections.begin(); it != connections.end(); ++it)
+			if (*it == connection)
+			{
+				connections.erase(it);
+				break;
+			}
+		close(connection);
+		sessionsDone.notify_all();
+	}
+
+	// Unblocks accept & all sessions waiting for requests
+	void stop()
+	{
+		stopping = true;
+		char wake = 0;
+		(void) !write(wakePipe[1], &wake, 1);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (auto connection : connections)
+			shutdown(connection, SHUT_RD);
+	}
+};
+
+#endif
+
+} // namespace
+
+int serve_tool(char const* tool, char const* const* args, char const* const* args_end)
+{
+	char const* socketPath = nullptr;
+	unsigned warmImporters = 2;
+
+	for (auto arg = args; arg < args_end; ++arg)
+	{
+		if (stdx::strieq(*arg, "help")) {
+			serve_help();
+			return 0;
+		}
+		else if (stdx::check_flag(*arg, "socket")) {
+			if (arg + 1 < args_end)
+				socketPath = *++arg;
+			else
+				std::cout << "Argument requires path, consult 'serve help' for help: " << *arg << std::endl;
+		} else if (stdx::check_flag(*arg, "Pi")) {
+			if (arg + 1 < args_end && sscanf(arg[1], "%u", &warmImporters) == 1)
+				++arg;
+			else
+				std::cout << "Argument requires number, consult 'serve help' for help: " << *arg << std::endl;
+		}
+		else
+			std::cout << "Unrecognized argument, consult 'serve help' for help: " << *arg << std::endl;
+	}
+
+	// Pay startup costs before the first request, keeping Assimp logs out of replies on stdout
+	create_assimp_logger(true);
+	ImporterPool::shared().warm_up(warmImporters);
+
+	if (!socketPath)
+		return serve_stdin();
+
+#ifdef WIN32
+	throwx( std::runtime_error("Socket mode requires POSIX, use stdin") );
+#else
+	SocketServer server(socketPath);
+	std::cout << "[serve] Ready on " << socketPath << std::endl;
+	server.run();
+	return 0;
+#endif
+}
@@ -0,0 +1,265 @@
+#include "pch.h"
+
+#include "simd.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+	#define SIMD_X86
+	#include <immintrin.h>
+	#ifdef _MSC_VER
+		#include <intrin.h>
+		#define SIMD_TARGET_AVX2
+	#else
+		#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+	#endif
+#endif
+
+namespace simd
+{
+
+namespace
+{
+
+// Scalar fallbacks
+
+void pack_colors_scalar(unsigned* dest, float const* src, size_t count)
+{
+	for (auto destEnd = dest + count; dest < destEnd; ++dest, src += 4)
+		*dest = pack_color(src[0], src[1], src[2], src[3]);
+}
+
+void narrow_xy_scalar(float* dest, float const* src, size_t count)
+{
+	for (auto destEnd = dest + 2 * count; dest < destEnd; dest += 2, src += 3)
+	{
+		dest[0] = src[0];
+		dest[1] = src[1];
+	}
+}
+
+void rebase_indices_scalar(unsigned* indices, size_t count, unsigned base)
+{
+	for (auto indicesEnd = indices + count; indices < indicesEnd; ++indices)
+		*indices += base;
+}
+
+// Zeros are canonicalized to +0 (x + 0 = +0 for x = -0), else the sign of a zero extremum would depend on evaluation order
+void minmax_xyz_scalar(float* min3, float* max3, float const* src, size_t count)
+{
+	for (auto srcEnd = src + 3 * count; src < srcEnd; src += 3)
+		for (int c = 0; c < 3; ++c)
+		{
+			float v = src[c] + 0.0f;
+			min3[c] = (v < min3[c]) ? v : min3[c];
+			max3[c] = (v > max3[c]) ? v : max3[c];
+		}
+}
+
+#ifdef SIMD_X86
+
+// SSE2
+
+inline __m128i pack_color_sse2(__m128 rgba, __m128 scale, __m128 lo, __m128 hi)
+{
+	// Reorder to BGRA, i.e. little-endian ARGB after packing to bytes
+	auto bgra = _mm_shuffle_ps(rgba, rgba, _MM_SHUFFLE(3, 0, 1, 2));
+	// Same operand order as pack_color for identical NaN handling
+	bgra = _mm_min_ps(_mm_max_ps(_mm_mul_ps(bgra, scale), lo), hi);
+	return _mm_cvttps_epi32(bgra);
+}
+
+void pack_colors_sse2(unsigned* dest, float const* src, size_t count)
+{
+	auto scale = _mm_set1_ps(256.0f), lo = _mm_setzero_ps(), hi = _mm_set1_ps(255.0f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, src += 16)
+	{
+		auto c0 = pack_color_sse2(_mm_loadu_ps(src), scale, lo, hi);
+		auto c1 = pack_color_sse2(_mm_loadu_ps(src + 4), scale, lo, hi);
+		auto c2 = pack_color_sse2(_mm_loadu_ps(src + 8), scale, lo, hi);
+		auto c3 = pack_color_sse2(_mm_loadu_ps(src + 12), scale, lo, hi);
+		// Values are in [0, 255], saturation never kicks in
+		auto packed = _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dest + i), packed);
+	}
+
+	pack_colors_scalar(dest + i, src, count - i);
+}
+
+void narrow_xy_sse2(float* dest, float const* src, size_t count)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, src += 12, dest += 8)
+	{
+		auto v0 = _mm_loadu_ps(src);     // x0 y0 z0 x1
+		auto v1 = _mm_loadu_ps(src + 4); // y1 z1 x2 y2
+		auto v2 = _mm_loadu_ps(src + 8); // z2 x3 y3 z3
+
+		auto t = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(0, 0, 3, 3)); // x1 x1 y1 y1
+		_mm_storeu_ps(dest, _mm_shuffle_ps(v0, t, _MM_SHUFFLE(2, 0, 1, 0)));
+		_mm_storeu_ps(dest + 4, _mm_shuffle_ps(v1, v2, _MM_SHUFFLE(2, 1, 3, 2)));
+	}
+
+	narrow_xy_scalar(dest, src, count - i);
+}
+
+void rebase_indices_sse2(unsigned* indices, size_t count, unsigned base)
+{
+	auto offset = _mm_set1_epi32(int(base));
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		auto p = reinterpret_cast<__m128i*>(indices + i);
+		_mm_storeu_si128(p, _mm_add_epi32(_mm_loadu_si128(p), offset));
+	}
+
+	rebase_indices_scalar(indices + i, count - i, base);
+}
+
+void minmax_xyz_sse2(float* min3, float* max3, float const* src, size_t count)
+{
+	size_t i = 0;
+	if (count >= 4)
+	{
+		// Components repeat with period 3 across 4-wide registers: xyzx yzxy zxyz
+		auto min0 = _mm_setr_ps(min3[0], min3[1], min3[2], min3[0]), max0 = _mm_setr_ps(max3[0], max3[1], max3[2], max3[0]);
+		auto min1 = _mm_setr_ps(min3[1], min3[2], min3[0], min3[1]), max1 = _mm_setr_ps(max3[1], max3[2], max3[0], max3[1]);
+		auto min2 = _mm_setr_ps(min3[2], min3[0], min3[1], min3[2]), max2 = _mm_setr_ps(max3[2], max3[0], max3[1], max3[2]);
+
+		auto zero = _mm_setzero_ps();
+		for (; i + 4 <= count; i += 4, src += 12)
+		{
+			auto v0 = _mm_add_ps(_mm_loadu_ps(src), zero), v1 = _mm_add_ps(_mm_loadu_ps(src + 4), zero), v2 = _mm_add_ps(_mm_loadu_ps(src + 8), zero);
+			min0 = _mm_min_ps(v0, min0); max0 = _mm_max_ps(v0, max0);
+			min1 = _mm_min_ps(v1, min1); max1 = _mm_max_ps(v1, max1);
+			min2 = _mm_min_ps(v2, min2); max2 = _mm_max_ps(v2, max2);
+		}
+
+		float mins[12], maxs[12];
+		_mm_storeu_ps(mins, min0); _mm_storeu_ps(mins + 4, min1); _mm_storeu_ps(mins + 8, min2);
+		_mm_storeu_ps(maxs, max0); _mm_storeu_ps(maxs + 4, max1); _mm_storeu_ps(maxs + 8, max2);
+		// Stored lanes again form 4 consecutive xyz vectors
+		for (int j = 0; j < 12; ++j)
+		{
+			min3[j % 3] = (mins[j] < min3[j % 3]) ? mins[j] : min3[j % 3];
+			max3[j % 3] = (maxs[j] > max3[j % 3]) ? maxs[j] : max3[j % 3];
+		}
+	}
+
+	minmax_xyz_scalar(min3, max3, src, count - i);
+}
+
+// AVX2
+
+SIMD_TARGET_AVX2 inline __m256i pack_color_avx2(__m256 rgba, __m256 scale, __m256 lo, __m256 hi)
+{
+	auto bgra = _mm256_shuffle_ps(rgba, rgba, _MM_SHUFFLE(3, 0, 1, 2));
+	bgra = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(bgra, scale), lo), hi);
+	return _mm256_cvttps_epi32(bgra);
+}
+
+SIMD_TARGET_AVX2 void pack_colors_avx2(unsigned* dest, float const* src, size_t count)
+{
+	auto scale = _mm256_set1_ps(256.0f), lo = _mm256_setzero_ps(), hi = _mm256_set1_ps(255.0f);
+	// Packing works per 128-bit lane, yielding colors 0 2 4 6 1 3 5 7
+	auto order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8, src += 32)
+	{
+		auto c01 = pack_color_avx2(_mm256_loadu_ps(src), scale, lo, hi);
+		auto c23 = pack_color_avx2(_mm256_loadu_ps(src + 8), scale, lo, hi);
+		auto c45 = pack_color_avx2(_mm256_loadu_ps(src + 16), scale, lo, hi);
+		auto c67 = pack_color_avx2(_mm256_loadu_ps(src + 24), scale, lo, hi);
+		auto packed = _mm256_packus_epi16(_mm256_packs_epi32(c01, c23), _mm256_packs_epi32(c45, c67));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dest + i), _mm256_permutevar8x32_epi32(packed, order));
+	}
+
+	pack_colors_sse2(dest + i, src, count - i);
+}
+
+SIMD_TARGET_AVX2 void rebase_indices_avx2(unsigned* indices, size_t count, unsigned base)
+{
+	auto offset = _mm256_set1_epi32(int(base));
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		auto p = reinterpret_cast<__m256i*>(indices + i);
+		_mm256_storeu_si256(p, _mm256_add_epi32(_mm256_loadu_si256(p), offset));
+	}
+
+	rebase_indices_sse2(indices + i, count - i, base);
+}
+
+bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuid(regs, 0);
+	if (regs[0] < 7) return false;
+	__cpuid(regs, 1);
+	bool osxsave = (regs[2] & (1 << 27)) != 0;
+	bool avx = (regs[2] & (1 << 28)) != 0;
+	if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+	__cpuidex(regs, 7, 0);
+	return (regs[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+#endif
+
+Kernels const& kernels()
+{
+	static Kernels const selected = available_kernels().back();
+	return selected;
+}
+
+} // namespace
+
+std::vector<Kernels> available_kernels()
+{
+	std::vector<Kernels> available;
+	Kernels scalar = { "scalar", pack_colors_scalar, narrow_xy_scalar, rebase_indices_scalar, minmax_xyz_scalar };
+	available.push_back(scalar);
+#ifdef SIMD_X86
+	Kernels sse2 = { "SSE2", pack_colors_sse2, narrow_xy_sse2, rebase_indices_sse2, minmax_xyz_sse2 };
+	available.push_back(sse2);
+	if (cpu_has_avx2())
+	{
+		Kernels avx2 = { "AVX2", pack_colors_avx2, narrow_xy_sse2, rebase_indices_avx2, minmax_xyz_sse2 };
+		available.push_back(avx2);
+	}
+#endif
+	return available;
+}
+
+void pack_colors(unsigned* dest, float const* srcRGBA, size_t count)
+{
+	kernels().pack_colors(dest, srcRGBA, count);
+}
+
+void narrow_xy(float* dest, float const* srcXYZ, size_t count)
+{
+	kernels().narrow_xy(dest, srcXYZ, count);
+}
+
+void rebase_indices(unsigned* indices, size_t count, unsigned base)
+{
+	kernels().rebase_indices(indices, count, base);
+}
+
+void minmax_xyz(float* min3, float* max3, float const* srcXYZ, size_t count)
+{
+	kernels().minmax_xyz(min3, max3, srcXYZ, count);
+}
+
+char const* instruction_set()
+{
+	return kernels().name;
+}
+
+} // namespace
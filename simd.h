@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Vectorized conversion kernels, dispatched at runtime to the best instruction set available (AVX2, SSE2, scalar).
+namespace simd
+{
+
+// Scalar reference for pack_colors: scales [0, 1] color channels to 8 bits, packed as ARGB.
+inline unsigned pack_color(float r, float g, float b, float a)
+{
+	// Clamping order & NaN handling chosen to match min/max instructions
+	auto&& to_byte = [](float c) -> unsigned
+	{
+		c *= 256.0f;
+		c = (c > 0.0f) ? c : 0.0f;
+		c = (c < 255.0f) ? c : 255.0f;
+		return unsigned(c);
+	};
+	return (to_byte(a) << 24U) | (to_byte(r) << 16U) | (to_byte(g) << 8U) | to_byte(b);
+}
+
+// Packs count RGBA float colors into 8-bit ARGB, bit-exact to pack_color.
+void pack_colors(unsigned* dest, float const* srcRGBA, size_t count);
+// Copies the first two components of count 3-component vectors.
+void narrow_xy(float* dest, float const* srcXYZ, size_t count);
+// Adds base to count indices in place.
+void rebase_indices(unsigned* indices, size_t count, unsigned base);
+// Extends the given min & max by count 3-component vectors, ignoring NaNs & taking -0 as +0.
+void minmax_xyz(float* min3, float* max3, float const* srcXYZ, size_t count);
+
+// Name of the instruction set selected at runtime.
+char const* instruction_set();
+
+// Kernels of one instruction set, exposed to test the vectorized paths against the scalar one.
+struct Kernels
+{
+	char const* name;
+	void (*pack_colors)(unsigned*, float const*, size_t);
+	void (*narrow_xy)(float*, float const*, size_t);
+	void (*rebase_indices)(unsigned*, size_t, unsigned);
+	void (*minmax_xyz)(float*, float*, float const*, size_t);
+};
+
+// Kernel sets this CPU supports, scalar first & the one selected at runtime last.
+std::vector<Kernels> available_kernels();
+
+} // namespace
@@ -0,0 +1,134 @@
+#include "pch.h"
+
+#include "stdx"
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cfloat>
+#include <cstring>
+#include <cmath>
+
+#include "simd.h"
+
+bool const stdx::is_debugger_present = IsDebuggerPresent() != FALSE;
+
+namespace
+{
+
+// Inputs mixing ordinary values with clamping boundaries, signed zeros, denormals, infinities & NaNs
+std::vector<float> test_floats(size_t count, std::mt19937& rng)
+{
+	float const edges[] = {
+		0.0f, -0.0f, 1.0f, -1.0f, 0.5f, 255.0f / 256.0f, 1.0f / 256.0f, 0.99999994f, 1.0000001f,
+		FLT_MIN, -FLT_MIN, FLT_MIN / 2.0f, FLT_MAX, -FLT_MAX,
+		std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+		std::numeric_limits<float>::quiet_NaN(), -std::numeric_limits<float>::quiet_NaN()
+	};
+	size_t const edgeCount = sizeof(edges) / sizeof(edges[0]);
+
+	std::uniform_real_distribution<float> unit(-0.5f, 1.5f);
+	std::uniform_int_distribution<size_t> pick(0, 3 * edgeCount);
+
+	std::vector<float> values(count);
+	for (auto& v : values)
+	{
+		size_t i = pick(rng);
+		v = (i < edgeCount) ? edges[i] : unit(rng);
+	}
+	return values;
+}
+
+struct Checker
+{
+	char const* kernelSet;
+	unsigned failures = 0;
+
+	void check(bool equal, char const* kernel, size_t count, size_t offset)
+	{
+		if (equal) return;
+		if (failures++ < 16)
+			std::cout << kernelSet << " " << kernel << " differs from scalar for count " << count << ", offset " << offset << std::endl;
+	}
+};
+
+// Runs the given kernel set & the scalar one on the same inputs, comparing all output bytes
+// including a guard region behind the outputs, which must stay untouched.
+void compare(Checker& checker, simd::Kernels const& scalar, simd::Kernels const& tested, size_t count, size_t offset, std::mt19937& rng)
+{
+	size_t const guard = 8;
+
+	{
+		auto src = test_floats(4 * count + offset, rng);
+		std::vector<unsigned> expected(count + guard, 0xCDCDCDCDU), actual(expected);
+		scalar.pack_colors(expected.data(), src.data() + offset, count);
+		tested.pack_colors(actual.data(), src.data() + offset, count);
+		checker.check(memcmp(expected.data(), actual.data(), expected.size() * sizeof(unsigned)) == 0, "pack_colors", count, offset);
+	}
+
+	{
+		auto src = test_floats(3 * count + offset, rng);
+		std::vector<float> expected(2 * count + guard, -3.0f), actual(expected);
+		scalar.narrow_xy(expected.data(), src.data() + offset, count);
+		tested.narrow_xy(actual.data(), src.data() + offset, count);
+		checker.check(memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0, "narrow_xy", count, offset);
+	}
+
+	{
+		std::uniform_int_distribution<unsigned> index;
+		std::vector<unsigned> expected(count + offset + guard);
+		for (auto& i : expected)
+			i = index(rng);
+		auto actual = expected;
+		unsigned base = (count & 1) ? index(rng) : 0xFFFFFFFFU; // wraps around
+		scalar.rebase_indices(expected.data() + offset, count, base);
+		tested.rebase_indices(actual.data() + offset, count, base);
+		checker.check(memcmp(expected.data(), actual.data(), expected.size() * sizeof(unsigned)) == 0, "rebase_indices", count, offset);
+	}
+
+	{
+		auto src = test_floats(3 * count + offset, rng);
+		if (count & 1) // zeros as extrema, of either sign
+			for (auto& v : src)
+				v = (v == 0.0f || v != v) ? v : std::abs(v);
+		auto start = test_floats(6, rng);
+		float const empty[6] = { FLT_MAX, FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		if (count & 2) memcpy(start.data(), empty, sizeof(empty));
+
+		float expected[6], actual[6];
+		memcpy(expected, start.data(), sizeof(expected));
+		memcpy(actual, start.data(), sizeof(actual));
+		scalar.minmax_xyz(expected, expected + 3, src.data() + offset, count);
+		tested.minmax_xyz(actual, actual + 3, src.data() + offset, count);
+		checker.check(memcmp(expected, actual, sizeof(expected)) == 0, "minmax_xyz", count, offset);
+	}
+}
+
+} // namespace
+
+// Checks that all vectorized kernels available on this CPU are bit-exact with the scalar kernels,
+// for lengths covering full vectors & all tail sizes at unaligned offsets.
+int main()
+{
+	auto kernelSets = simd::available_kernels();
+	auto& scalar = kernelSets.front();
+
+	unsigned failures = 0;
+	for (auto& tested : kernelSets)
+	{
+		Checker checker = { tested.name };
+		std::mt19937 rng(1);
+
+		for (size_t count = 0; count <= 67; ++count)
+			for (size_t offset = 0; offset < 4; ++offset)
+				for (int repeat = 0; repeat < 8; ++repeat)
+					compare(checker, scalar, tested, count, offset, rng);
+		compare(checker, scalar, tested, 100003, 1, rng);
+
+		std::cout << tested.name << ": " << (checker.failures ? "FAILED" : "bit-exact") << std::endl;
+		failures += checker.failures;
+	}
+
+	return failures ? 1 : 0;
+}
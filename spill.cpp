@@ -0,0 +1,167 @@
+#include "pch.h"
+
+#include "spill.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <cstdio>
+#include <algorithm>
+
+#include <scenex>
+#include <filex>
+
+#include "scenefile.h"
+
+namespace
+{
+
+size_t const spill_copy_block = 1 << 20;
+
+enum SectionKind
+{
+	section_geometry,
+	section_vertex_attribute, // zero-filled for chunks that lack it
+	section_resident
+};
+
+SectionKind section_kind(scene::Scene const& scene, void const* section)
+{
+	if (section == &scene.materials || section == &scene.textures || section == &scene.texturePaths)
+		return section_resident;
+	if (section == &scene.normals || section == &scene.colors || section == &scene.texcoords
+		|| section == &scene.tangents || section == &scene.bitangents)
+		return section_vertex_attribute;
+	return section_geometry;
+}
+
+// Section positions in file order, see scenefile::for_each_section
+size_t const section_indices = 6;
+size_t const section_meshes = 8;
+size_t const section_instances = 11;
+
+} // namespace
+
+SpilledScene::SpilledScene(std::string const& tempPrefix)
+	: tempPrefix(tempPrefix)
+{
+	scene::Scene layout;
+	scenefile::for_each_section(layout, [&](auto const& section, char const* name)
+	{
+		files.emplace_back();
+		auto& file = files.back();
+		if (section_kind(layout, &section) != section_resident)
+		{
+			file.path = tempPrefix + "." + name + ".tmp";
+			file.stream = stdx::write_binary_file(file.path.c_str(), std::ios_base::trunc);
+			if (!file.stream)
+				throwx( std::runtime_error("Cannot create spill file: " + file.path) );
+		}
+	});
+}
+
+SpilledScene::~SpilledScene()
+{
+	for (auto& file : files)
+		if (!file.path.empty())
+		{
+			file.stream.close();
+			remove(file.path.c_str());
+		}
+}
+
+void SpilledScene::spill(scene::Scene& chunk)
+{
+	size_t sectionIdx = 0;
+	scenefile::for_each_section(chunk, [&](auto& section, char const*)
+	{
+		auto& file = files[sectionIdx++];
+		if (file.path.empty()) return;
+
+		file.stream.write(reinterpret_cast<char const*>(section.data()), sizeof(section[0]) * section.size());
+		if (!file.stream)
+			throwx( std::runtime_error("Spill file write: " + file.path) );
+		file.chunkCounts.push_back(section.size());
+
+		// Release right away
+		typename std::decay<decltype(section)>::type().swap(section);
+	});
+
+	chunkVertexCounts.push_back(files[0].chunkCounts.back());
+	vertexCount += chunkVertexCounts.back();
+}
+
+size_t SpilledScene::element_count(size_t section) const
+{
+	size_t count = 0;
+	for (auto chunkCount : files[section].chunkCounts)
+		count += chunkCount;
+	return count;
+}
+
+size_t SpilledScene::index_count() const { return element_count(section_indices); }
+size_t SpilledScene::mesh_count() const { return element_count(section_meshes); }
+size_t SpilledScene::instance_count() const { return element_count(section_instances); }
+
+void SpilledScene::write_scene(char const* path, scene::Scene const& resident)
+{
+	auto out = stdx::write_binary_file(path, std::ios_base::trunc);
+	std::vector<char> buffer;
+
+	size_t sectionIdx = 0;
+	scenefile::for_each_section(resident, [&](auto const& section, char const*)
+	{
+		auto& file = files[sectionIdx++];
+		auto kind = section_kind(resident, &section);
+		size_t elementSize = sizeof(section[0]);
+
+		if (kind == section_resident)
+		{
+			scenefile::write_section(out, section.data(), elementSize, section.size());
+			return;
+		}
+
+		// Attribute streams cover all vertices if any chunk provides them
+		size_t count = element_count(sectionIdx - 1);
+		bool zeroFill = (kind == section_vertex_attribute && count > 0);
+		if (zeroFill)
+			count = vertexCount;
+
+		scenefile::count_t fileCount = count;
+		out.write(reinterpret_cast<char const*>(&fileCount), sizeof(fileCount));
+
+		file.stream.close();
+		std::ifstream in(file.path.c_str(), std::ios_base::binary);
+
+		for (size_t chunkIdx = 0; chunkIdx < file.chunkCounts.size(); ++chunkIdx)
+		{
+			size_t chunkBytes = file.chunkCounts[chunkIdx] * elementSize;
+			if (zeroFill && file.chunkCounts[chunkIdx] == 0)
+			{
+				buffer.assign(std::min(chunkVertexCounts[chunkIdx] * elementSize, spill_copy_block), 0);
+				for (size_t bytes = chunkVertexCounts[chunkIdx] * elementSize; bytes > 0; )
+				{
+					size_t blockBytes = std::min(bytes, buffer.size());
+					out.write(buffer.data(), blockBytes);
+					bytes -= blockBytes;
+				}
+				continue;
+			}
+
+			buffer.resize(std::min(chunkBytes, spill_copy_block));
+			for (size_t bytes = chunkBytes; bytes > 0; )
+			{
+				size_t blockBytes = std::min(bytes, buffer.size());
+				in.read(buffer.data(), blockBytes);
+				out.write(buffer.data(), blockBytes);
+				bytes -= blockBytes;
+			}
+		}
+
+		if (!in)
+			throwx( std::runtime_error("Spill file read: " + file.path) );
+	});
+
+	if (!out)
+		throwx( std::runtime_error("Scene file write") );
+}
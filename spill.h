@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace scene { struct Scene; }
+
+// Out-of-core scene assembly. Geometry streams of merged chunks are appended to one temporary
+// file per section right after conversion, the final scene file is written by concatenating
+// them, so that only one chunk needs to be resident at a time. Materials, textures & texture
+// paths are small and stay in a resident scene.
+class SpilledScene
+{
+public:
+	// Temporary files are named <tempPrefix>.<section>.tmp
+	explicit SpilledScene(std::string const& tempPrefix);
+	// Removes all temporary files
+	~SpilledScene();
+
+	SpilledScene(SpilledScene const&) = delete;
+	SpilledScene& operator =(SpilledScene const&) = delete;
+
+	// Appends the geometry streams of the given chunk in merge order and releases them.
+	void spill(scene::Scene& chunk);
+
+	// Writes the scene file, byte-compatible with write_scene on the merged scene. Vertex
+	// attributes missing from some chunks are zero-filled, as allocate_scene does.
+	void write_scene(char const* path, scene::Scene const& resident);
+
+	size_t vertex_count() const { return vertexCount; }
+	size_t index_count() const;
+	size_t mesh_count() const;
+	size_t instance_count() const;
+
+private:
+	struct SpillFile
+	{
+		std::string path;
+		std::ofstream stream;
+		std::vector<size_t> chunkCounts; // elements per spilled chunk
+	};
+
+	std::string tempPrefix;
+	std::vector<SpillFile> files; // one per section, in file order
+	std::vector<size_t> chunkVertexCounts;
+	size_t vertexCount = 0;
+
+	size_t element_count(size_t section) const;
+};
@@ -0,0 +1,194 @@
+#include "pch.h"
+
+#include "stats.h"
+
+#include "stdx"
+
+#include <fstream>
+#include <algorithm>
+
+#include <assimp/ProgressHandler.hpp>
+
+#ifdef WIN32
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+double process_cpu_seconds()
+{
+#ifdef WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+		return 0.0;
+	auto&& seconds = [](FILETIME const& t) { return double((std::uint64_t(t.dwHighDateTime) << 32U) | t.dwLowDateTime) * 1.0e-7; };
+	return seconds(kernel) + seconds(user);
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0.0;
+	return double(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + double(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1.0e-6;
+#endif
+}
+
+std::uint64_t peak_rss_bytes()
+{
+#ifdef WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	#ifdef __APPLE__
+		return std::uint64_t(usage.ru_maxrss); // bytes
+	#else
+		return std::uint64_t(usage.ru_maxrss) * 1024U; // kilobytes
+	#endif
+#endif
+}
+
+namespace
+{
+
+// Times each post-processing step from its start notification to the next.
+class StageProgressHandler : public Assimp::ProgressHandler
+{
+public:
+	StageProgressHandler(ConversionStats& stats, std::string const& prefix)
+		: stats(stats), prefix(prefix), step(-1), wallStart(), cpuStart(0.0) { }
+
+	bool Update(float) override { return true; }
+
+	void UpdatePostProcess(int currentStep, int numberOfSteps) override
+	{
+		auto wallNow = std::chrono::steady_clock::now();
+		auto cpuNow = process_cpu_seconds();
+
+		if (step >= 0)
+			stats.add_stage(prefix + std::to_string(step + 1) + "/" + std::to_string(numberOfSteps)
+				, std::chrono::duration<double>(wallNow - wallStart).count(), cpuNow - cpuStart);
+
+		step = (currentStep < numberOfSteps) ? currentStep : -1;
+		wallStart = wallNow;
+		cpuStart = cpuNow;
+	}
+
+private:
+	ConversionStats& stats;
+	std::string prefix;
+	int step;
+	std::chrono::steady_clock::time_point wallStart;
+	double cpuStart;
+};
+
+void write_json_string(std::ostream& file, std::string const& str)
+{
+	file << '"';
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\') file << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20) file << ' ';
+		else file << c;
+	}
+	file << '"';
+}
+
+} // namespace
+
+ConversionStats::ConversionStats()
+	: wallStart(std::chrono::steady_clock::now())
+	, cpuStart(process_cpu_seconds())
+{
+}
+
+ConversionStats::Stage::Stage(ConversionStats& stats, std::string name)
+	: stats(stats)
+	, name(std::move(name))
+	, wallStart(std::chrono::steady_clock::now())
+	, cpuStart(process_cpu_seconds())
+{
+}
+
+ConversionStats::Stage::~Stage()
+{
+	stats.add_stage(std::move(name), std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count(), process_cpu_seconds() - cpuStart);
+}
+
+void ConversionStats::add_stage(std::string name, double wallSeconds, double cpuSeconds)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	StageRecord stage = { std::move(name), wallSeconds, cpuSeconds };
+	stages.push_back(std::move(stage));
+}
+
+void ConversionStats::add_count(char const* group, char const* name, std::uint64_t value)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& count : counts)
+		if (count.group == group && count.name == name)
+		{
+			count.value += value;
+			return;
+		}
+	Count count = { group, name, value };
+	counts.push_back(std::move(count));
+}
+
+Assimp::ProgressHandler* ConversionStats::track_progress(std::string const& prefix)
+{
+	return new StageProgressHandler(*this, prefix);
+}
+
+void ConversionStats::write_json(char const* path, char const* output, unsigned converterVersion) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::ofstream file(path, std::ios_base::trunc);
+	file << "{\n";
+	file << "\t\"output\": "; write_json_string(file, output); file << ",\n";
+	file << "\t\"converterVersion\": " << converterVersion << ",\n";
+	file << "\t\"wallSeconds\": " << std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count() << ",\n";
+	file << "\t\"cpuSeconds\": " << (process_cpu_seconds() - cpuStart) << ",\n";
+	file << "\t\"peakRssBytes\": " << peak_rss_bytes() << ",\n";
+
+	file << "\t\"stages\": [";
+	for (size_t i = 0; i < stages.size(); ++i)
+	{
+		file << (i ? ",\n\t\t" : "\n\t\t") << "{ \"name\": ";
+		write_json_string(file, stages[i].name);
+		file << ", \"wallSeconds\": " << stages[i].wallSeconds << ", \"cpuSeconds\": " << stages[i].cpuSeconds << " }";
+	}
+	file << "\n\t],\n";
+
+	// Counts grouped in order of first appearance
+	std::vector<std::string> groups;
+	for (auto& count : counts)
+		if (std::find(groups.begin(), groups.end(), count.group) == groups.end())
+			groups.push_back(count.group);
+
+	file << "\t\"counts\": {";
+	for (size_t i = 0; i < groups.size(); ++i)
+	{
+		file << (i ? ",\n\t\t" : "\n\t\t");
+		write_json_string(file, groups[i]);
+		file << ": {";
+		bool first = true;
+		for (auto& count : counts)
+			if (count.group == groups[i])
+			{
+				file << (first ? " " : ", ");
+				write_json_string(file, count.name);
+				file << ": " << count.value;
+				first = false;
+			}
+		file << " }";
+	}
+	file << "\n\t}\n";
+	file << "}\n";
+
+	if (!file)
+		throwx( std::runtime_error("Stats file write") );
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+
+namespace Assimp { class ProgressHandler; }
+
+// Process-wide CPU time (user + system) in seconds.
+double process_cpu_seconds();
+// Process-wide peak resident set size in bytes.
+std::uint64_t peak_rss_bytes();
+
+// Stage timings & counters of one conversion, written as a JSON report by /Stats. CPU times are
+// process-wide, stages running concurrently (e.g. parallel imports) see each other's CPU time.
+class ConversionStats
+{
+public:
+	ConversionStats();
+
+	// Records the time from construction to destruction as a stage.
+	class Stage
+	{
+	public:
+		Stage(ConversionStats& stats, std::string name);
+		~Stage();
+
+	private:
+		ConversionStats& stats;
+		std::string name;
+		std::chrono::steady_clock::time_point wallStart;
+		double cpuStart;
+	};
+
+	void add_stage(std::string name, double wallSeconds, double cpuSeconds);
+	// Adds to the named counter of the given group.
+	void add_count(char const* group, char const* name, std::uint64_t value);
+
+	// Returns a new progress handler recording Assimp post-processing steps as stages. Ownership passes to the importer.
+	Assimp::ProgressHandler* track_progress(std::string const& prefix);
+
+	void write_json(char const* path, char const* output, unsigned converterVersion) const;
+
+private:
+	struct StageRecord
+	{
+		std::string name;
+		double wallSeconds, cpuSeconds;
+	};
+	struct Count
+	{
+		std::string group, name;
+		std::uint64_t value;
+	};
+
+	std::chrono::steady_clock::time_point wallStart;
+	double cpuStart;
+
+	mutable std::mutex mutex;
+	std::vector<StageRecord> stages;
+	std::vector<Count> counts;
+};
@@ -0,0 +1,371 @@
+#include "pch.h"
+
+#include "stdx"
+#include "mathx"
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cmath>
+#include <cfloat>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <scenex>
+
+#include "scenepass.h"
+#include "parallel.h"
+#include "hash.h"
+
+namespace
+{
+
+size_t const weld_block_size = 1 << 16;
+unsigned const weld_partition_bits = 6;
+unsigned const weld_partition_count = 1U << weld_partition_bits;
+
+struct CellEntry
+{
+	std::uint64_t key;
+	unsigned vertex;
+
+	bool operator <(CellEntry const& r) const { return key < r.key || (key == r.key && vertex < r.vertex); }
+};
+
+// Integer grid cell of a position; exact float bits if welding coincident positions only.
+struct CellCoords
+{
+	std::int64_t c[3];
+};
+
+inline CellCoords cell_of(math::vec3 const& p, float invCellSize)
+{
+	CellCoords cell;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (invCellSize > 0.0f)
+			cell.c[i] = std::int64_t(std::floor(std::max(std::min(double(p.c[i]) * invCellSize, 4.0e18), -4.0e18)));
+		else
+		{
+			float v = (p.c[i] == 0.0f) ? 0.0f : p.c[i]; // -0 == +0
+			std::int32_t bits;
+			memcpy(&bits, &v, sizeof(bits));
+			cell.c[i] = bits;
+		}
+	}
+	return cell;
+}
+
+inline std::uint64_t cell_key(CellCoords const& cell)
+{
+	return murmur_hash64(cell.c, sizeof(cell.c), 0x5745u);
+}
+
+template <size_t N>
+inline bool within(float const (&a)[N], float const (&b)[N], float epsilonSq)
+{
+	float distSq = 0.0f;
+	for (size_t i = 0; i < N; ++i)
+		distSq += (a[i] - b[i]) * (a[i] - b[i]);
+	return distSq <= epsilonSq;
+}
+
+// Spatial hash grid over all positions: entries sorted by (cell key, vertex) in partitions selected by the key's top bits.
+struct WeldGrid
+{
+	std::vector<CellEntry> entries;
+	unsigned partitionBegin[weld_partition_count + 1];
+
+	void build(std::vector<math::vec3> const& positions, float invCellSize)
+	{
+		size_t vertexCount = positions.size();
+		size_t blockCount = (vertexCount + weld_block_size - 1) / weld_block_size;
+
+		std::vector<std::uint64_t> keys(vertexCount);
+		std::vector<unsigned> blockCounts(blockCount * weld_partition_count, 0);
+		parallel_for(blockCount, [&](size_t block)
+		{
+			auto counts = &blockCounts[block * weld_partition_count];
+			for (size_t i = block * weld_block_size, end = std::min(i + weld_block_size, vertexCount); i < end; ++i)
+			{
+				keys[i] = cell_key(cell_of(positions[i], invCellSize));
+				++counts[keys[i] >> (64 - weld_partition_bits)];
+			}
+		});
+
+		// Block offsets within partitions, in vertex order
+		unsigned offset = 0;
+		for (unsigned p = 0; p < weld_partition_count; ++p)
+		{
+			partitionBegin[p] = offset;
+			for (size_t block = 0; block < blockCount; ++block)
+			{
+				auto count = blockCounts[block * weld_partition_count + p];
+				blockCounts[block * weld_partition_count + p] = offset;
+				offset += count;
+			}
+		}
+		partitionBegin[weld_partition_count] = offset;
+
+		entries.resize(vertexCount);
+		parallel_for(blockCount, [&](size_t block)
+		{
+			auto cursors = &blockCounts[block * weld_partition_count];
+			for (size_t i = block * weld_block_size, end = std::min(i + weld_block_size, vertexCount); i < end; ++i)
+			{
+				CellEntry entry = { keys[i], unsigned(i) };
+				entries[cursors[keys[i] >> (64 - weld_partition_bits)]++] = entry;
+			}
+		});
+
+		parallel_for(weld_partition_count, [&](size_t p)
+		{
+			std::sort(entries.begin() + partitionBegin[p], entries.begin() + partitionBegin[p + 1]);
+		});
+	}
+
+	// Vertices of the given cell & those colliding with it, ascending.
+	std::pair<CellEntry const*, CellEntry const*> cell(std::uint64_t key) const
+	{
+		auto p = key >> (64 - weld_partition_bits);
+		CellEntry lower = { key, 0 };
+		auto begin = std::lower_bound(entries.data() + partitionBegin[p], entries.data() + partitionBegin[p + 1], lower);
+		auto end = begin;
+		while (end < entries.data() + partitionBegin[p + 1] && end->key == key) ++end;
+		return std::make_pair(begin, end);
+	}
+};
+
+// Vertex groups welding never merges across: the merged vertex ranges of meshes & the gaps between them.
+// Keeps mesh vertex ranges disjoint & compact for later per-mesh passes.
+std::vector<unsigned> vertex_groups(scene::Scene const& scene)
+{
+	auto ranges = mesh_vertex_ranges(scene);
+	std::sort(ranges.begin(), ranges.end(), [](VertexRange const& a, VertexRange const& b) { return a.first < b.first; });
+
+	std::vector<unsigned> starts;
+	unsigned covered = 0;
+	for (auto& range : ranges)
+	{
+		if (range.first == range.last) continue;
+
+		if (range.first >= covered)
+		{
+			if (range.first > covered)
+				starts.push_back(covered); // unreferenced vertices
+			starts.push_back(range.first);
+		}
+		covered = std::max(covered, range.last);
+	}
+	if (covered < scene.positions.size())
+		starts.push_back(covered);
+
+	std::vector<unsigned> groups(scene.positions.size());
+	parallel_for(starts.size(), [&](size_t i)
+	{
+		auto end = (i + 1 < starts.size()) ? starts[i + 1] : unsigned(groups.size());
+		std::fill(groups.begin() + starts[i], groups.begin() + end, unsigned(i));
+	});
+	return groups;
+}
+
+// Keeps the representatives in order, taking their attributes from the given source vertices.
+template <class T>
+void compact_stream(std::vector<T>& stream, std::vector<unsigned> const& newIndices, std::vector<unsigned> const& representatives
+	, std::vector<unsigned> const& sources, size_t keptCount)
+{
+	if (stream.empty()) return;
+
+	std::vector<T> kept(keptCount);
+	parallel_for((stream.size() + weld_block_size - 1) / weld_block_size, [&](size_t block)
+	{
+		for (size_t i = block * weld_block_size, end = std::min(i + weld_block_size, stream.size()); i < end; ++i)
+			if (representatives[i] == i)
+				kept[newIndices[i]] = stream[sources[i]];
+	});
+	stream.swap(kept);
+}
+
+} // namespace
+
+void weld_vertices(scene::Scene& scene, float positionEpsilon, float normalEpsilon, float texcoordEpsilon, bool report)
+{
+	size_t vertexCount = scene.positions.size();
+	size_t blockCount = (vertexCount + weld_block_size - 1) / weld_block_size;
+	if (vertexCount == 0) return;
+
+	positionEpsilon = std::max(positionEpsilon, 0.0f);
+	float invCellSize = (positionEpsilon > 0.0f) ? 1.0f / positionEpsilon : 0.0f;
+	int reach = (positionEpsilon > 0.0f) ? 1 : 0;
+	float positionEpsilonSq = positionEpsilon * positionEpsilon;
+	float normalEpsilonSq = std::max(normalEpsilon, 0.0f) * std::max(normalEpsilon, 0.0f);
+	float texcoordEpsilonSq = std::max(texcoordEpsilon, 0.0f) * std::max(texcoordEpsilon, 0.0f);
+
+	auto groups = vertex_groups(scene);
+
+	WeldGrid grid;
+	grid.build(scene.positions, invCellSize);
+
+	auto&& matches = [&](size_t a, size_t b)
+	{
+		return within(scene.positions[a].c, scene.positions[b].c, positionEpsilonSq)
+			&& (scene.normals.empty() || within(scene.normals[a].c, scene.normals[b].c, normalEpsilonSq))
+			&& (scene.tangents.empty() || within(scene.tangents[a].c, scene.tangents[b].c, normalEpsilonSq))
+			&& (scene.bitangents.empty() || within(scene.bitangents[a].c, scene.bitangents[b].c, normalEpsilonSq))
+			&& (scene.texcoords.empty() || within(scene.texcoords[a].c, scene.texcoords[b].c, texcoordEpsilonSq))
+			&& (scene.colors.empty() || scene.colors[a] == scene.colors[b]);
+	};
+
+	// Candidates: lowest matching vertex in the neighboring cells, within the same group & overall
+	std::vector<unsigned> candidates(vertexCount), seamCandidates(vertexCount);
+	parallel_for(blockCount, [&](size_t block)
+	{
+		std::uint64_t keys[27];
+		for (size_t v = block * weld_block_size, end = std::min(v + weld_block_size, vertexCount); v < end; ++v)
+		{
+			auto cell = cell_of(scene.positions[v], invCellSize);
+			unsigned keyCount = 0;
+			for (int dz = -reach; dz <= reach; ++dz)
+				for (int dy = -reach; dy <= reach; ++dy)
+					for (int dx = -reach; dx <= reach; ++dx)
+					{
+						CellCoords neighbor = { { cell.c[0] + dx, cell.c[1] + dy, cell.c[2] + dz } };
+						auto key = cell_key(neighbor);
+						if (std::find(keys, keys + keyCount, key) == keys + keyCount)
+							keys[keyCount++] = key;
+					}
+
+			unsigned candidate = unsigned(v), seamCandidate = unsigned(v);
+			for (unsigned k = 0; k < keyCount; ++k)
+			{
+				auto range = grid.cell(keys[k]);
+				for (auto e = range.first; e < range.second && e->vertex < candidate; ++e)
+					if (matches(e->vertex, v))
+					{
+						seamCandidate = std::min(seamCandidate, e->vertex);
+						if (groups[e->vertex] == groups[v])
+						{
+							candidate = e->vertex;
+							break;
+						}
+					}
+			}
+			candidates[v] = candidate;
+			seamCandidates[v] = seamCandidate;
+		}
+	});
+
+	// Representatives are their own candidates, which bounds the error to one epsilon & keeps results deterministic.
+	// Matches in other groups are not merged, but snapped to identical attributes for watertight seams.
+	std::vector<unsigned> representatives(vertexCount), sources(vertexCount);
+	std::vector<unsigned> blockKept(blockCount + 1, 0), blockSnapped(blockCount, 0);
+	parallel_for(blockCount, [&](size_t block)
+	{
+		for (size_t v = block * weld_block_size, end = std::min(v + weld_block_size, vertexCount); v < end; ++v)
+		{
+			auto c = candidates[v], s = seamCandidates[v];
+			representatives[v] = (candidates[c] == c) ? c : unsigned(v);
+			sources[v] = (seamCandidates[s] == s) ? s : unsigned(v);
+			blockKept[block + 1] += (representatives[v] == v);
+			blockSnapped[block] += (representatives[v] == v && sources[v] != v);
+		}
+	});
+	size_t snappedCount = 0;
+	for (auto snapped : blockSnapped)
+		snappedCount += snapped;
+	for (size_t block = 0; block < blockCount; ++block)
+		blockKept[block + 1] += blockKept[block];
+	size_t keptCount = blockKept[blockCount];
+
+	std::vector<unsigned> newIndices(vertexCount);
+	parallel_for(blockCount, [&](size_t block)
+	{
+		auto next = blockKept[block];
+		for (size_t v = block * weld_block_size, end = std::min(v + weld_block_size, vertexCount); v < end; ++v)
+			if (representatives[v] == v)
+				newIndices[v] = next++;
+	});
+
+	compact_stream(scene.positions, newIndices, representatives, sources, keptCount);
+	compact_stream(scene.normals, newIndices, representatives, sources, keptCount);
+	compact_stream(scene.colors, newIndices, representatives, sources, keptCount);
+	compact_stream(scene.texcoords, newIndices, representatives, sources, keptCount);
+	compact_stream(scene.tangents, newIndices, representatives, sources, keptCount);
+	compact_stream(scene.bitangents, newIndices, representatives, sources, keptCount);
+
+	// Rewrite & compact triangles in place per mesh, dropping collapsed ones
+	size_t meshCount = scene.meshes.size();
+	std::vector<unsigned> meshKept(meshCount + 1, 0);
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		auto& mesh = scene.meshes[meshIdx];
+		auto indices = scene.indices.data() + mesh.primitives.first;
+		auto kept = indices;
+		for (auto triangle = indices, trianglesEnd = indices + (mesh.primitives.last - mesh.primitives.first); triangle < trianglesEnd; triangle += 3)
+		{
+			unsigned a = newIndices[representatives[triangle[0]]];
+			unsigned b = newIndices[representatives[triangle[1]]];
+			unsigned c = newIndices[representatives[triangle[2]]];
+			if (a == b || b == c || c == a) continue;
+			kept[0] = a;
+			kept[1] = b;
+			kept[2] = c;
+			kept += 3;
+		}
+		meshKept[meshIdx + 1] = unsigned(kept - indices);
+	});
+
+	std::vector<unsigned> meshOrder(meshCount);
+	for (size_t i = 0; i < meshCount; ++i)
+		meshOrder[i] = unsigned(i);
+	std::sort(meshOrder.begin(), meshOrder.end(), [&](unsigned a, unsigned b) { return scene.meshes[a].primitives.first < scene.meshes[b].primitives.first; });
+
+	std::vector<unsigned> meshFirst(meshCount);
+	unsigned indexCount = 0;
+	for (auto meshIdx : meshOrder)
+	{
+		meshFirst[meshIdx] = indexCount;
+		indexCount += meshKept[meshIdx + 1];
+	}
+
+	std::vector<unsigned> keptIndices(indexCount);
+	parallel_for(meshCount, [&](size_t meshIdx)
+	{
+		auto& mesh = scene.meshes[meshIdx];
+		auto indices = scene.indices.data() + mesh.primitives.first;
+		std::copy(indices, indices + meshKept[meshIdx + 1], keptIndices.data() + meshFirst[meshIdx]);
+
+		mesh.primitives.first = meshFirst[meshIdx];
+		mesh.primitives.last = meshFirst[meshIdx] + meshKept[meshIdx + 1];
+
+		// Snapped vertices may lie up to one epsilon outside the original bounds
+		if (mesh.primitives.first < mesh.primitives.last)
+		{
+			auto& bounds = mesh.bounds;
+			bounds.min = bounds.max = scene.positions[keptIndices[mesh.primitives.first]];
+			for (auto i = mesh.primitives.first; i < mesh.primitives.last; ++i)
+			{
+				auto& p = scene.positions[keptIndices[i]];
+				for (int c = 0; c < 3; ++c)
+				{
+					bounds.min.c[c] = std::min(bounds.min.c[c], p.c[c]);
+					bounds.max.c[c] = std::max(bounds.max.c[c], p.c[c]);
+				}
+			}
+		}
+	});
+
+	size_t removedIndexCount = scene.indices.size() - keptIndices.size();
+	scene.indices.swap(keptIndices);
+
+	parallel_for(scene.instances.size(), [&](size_t instanceIdx)
+	{
+		auto& instance = scene.instances[instanceIdx];
+		instance.bounds = transform_bounds(scene.meshes[instance.mesh].bounds, instance.transform);
+	});
+
+	if (report)
+		std::cout << "Welding: " << (vertexCount - keptCount) << " of " << vertexCount << " vertices merged, "
+			<< snappedCount << " seam vertices aligned, " << (removedIndexCount / 3) << " collapsed triangles removed" << std::endl;
+}